@@ -49,6 +49,17 @@ const WCHAR Tbl[] = {	/*  CP437(0x80-0xFF) to Unicode conversion table */
 	0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
 	0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x2D, 0x1B, 0x1C, 0x1D, 0x26, 0x2E, 0x2A, 0x78, 0x71, 0x7D, 0x66, 0x7A, 0x27, 0x2F, 0x2C,
+	0x2B, 0x28, 0x0E, 0x0F, 0x12, 0x00, 0x10, 0x25, 0x19, 0x1A, 0x61, 0x05, 0x20, 0x03, 0x04, 0x06,
+	0x11, 0x07, 0x0A, 0x02, 0x08, 0x09, 0x0D, 0x21, 0x0C, 0x0B, 0x24, 0x15, 0x22, 0x13, 0x14, 0x76,
+	0x17, 0x23, 0x16, 0x01, 0x18, 0x1F, 0x62, 0x69, 0x64, 0x68, 0x6A, 0x60, 0x6B, 0x6E, 0x63, 0x65,
+	0x67, 0x6D, 0x7C, 0x1E, 0x79, 0x7B, 0x6C, 0x6F, 0x77, 0x70, 0x73, 0x72, 0x29, 0x74, 0x75, 0x44,
+	0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A, 0x55, 0x56, 0x49, 0x38,
+	0x37, 0x3B, 0x54, 0x53, 0x48, 0x3E, 0x3D, 0x3C, 0x46, 0x47, 0x4C, 0x35, 0x36, 0x39, 0x51, 0x52,
+	0x4B, 0x4F, 0x50, 0x4A, 0x58, 0x57, 0x4E, 0x5F, 0x5C, 0x5B, 0x5D, 0x5E, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 720
 #define _TBLDEF 1
@@ -68,9 +79,20 @@ const WCHAR Tbl[] = {	/*  CP720(0x80-0xFF) to Unicode conversion table */
 	0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
 	0x0636, 0x0637, 0x0638, 0x0639, 0x063A, 0x0641, 0x00B5, 0x0642,
 	0x0643, 0x0644, 0x0645, 0x0646, 0x0647, 0x0648, 0x0649, 0x064A,
-	0x2261, 0x064B, 0x064C, 0x064D, 0x064E, 0x064F, 0xO650, 0x2248,
+	0x2261, 0x064B, 0x064C, 0x064D, 0x064E, 0x064F, 0x0650, 0x2248,
 	0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x00, 0x01, 0x04, 0x06, 0x0D, 0x0E, 0x0F, 0x10, 0x7F, 0x1C, 0x14, 0x2E, 0x78, 0x7D, 0x66, 0x7A,
+	0x2F, 0x05, 0x03, 0x07, 0x0A, 0x02, 0x08, 0x09, 0x0C, 0x0B, 0x13, 0x17, 0x16, 0x18, 0x19, 0x1A,
+	0x1B, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B,
+	0x2C, 0x2D, 0x60, 0x61, 0x62, 0x63, 0x64, 0x15, 0x65, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D,
+	0x6E, 0x6F, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x11, 0x12, 0x7C, 0x79, 0x7B, 0x77, 0x70, 0x44,
+	0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A, 0x55, 0x56, 0x49, 0x38,
+	0x37, 0x3B, 0x54, 0x53, 0x48, 0x3E, 0x3D, 0x3C, 0x46, 0x47, 0x4C, 0x35, 0x36, 0x39, 0x51, 0x52,
+	0x4B, 0x4F, 0x50, 0x4A, 0x58, 0x57, 0x4E, 0x5F, 0x5C, 0x5B, 0x5D, 0x5E, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 737
 #define _TBLDEF 1
@@ -93,6 +115,17 @@ const WCHAR Tbl[] = {	/*  CP737(0x80-0xFF) to Unicode conversion table */
 	0x038F, 0x00B1, 0x2265, 0x2264, 0x03AA, 0x03AB, 0x00F7, 0x2248,
 	0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x78, 0x71, 0x7D, 0x7A, 0x76, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x00, 0x01, 0x02,
+	0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12,
+	0x13, 0x14, 0x15, 0x16, 0x17, 0x74, 0x75, 0x61, 0x62, 0x63, 0x65, 0x18, 0x19, 0x1A, 0x1B, 0x1C,
+	0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x2A, 0x29, 0x2B, 0x2C,
+	0x2D, 0x2E, 0x2F, 0x60, 0x64, 0x68, 0x66, 0x67, 0x69, 0x7C, 0x79, 0x7B, 0x77, 0x73, 0x72, 0x44,
+	0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A, 0x55, 0x56, 0x49, 0x38,
+	0x37, 0x3B, 0x54, 0x53, 0x48, 0x3E, 0x3D, 0x3C, 0x46, 0x47, 0x4C, 0x35, 0x36, 0x39, 0x51, 0x52,
+	0x4B, 0x4F, 0x50, 0x4A, 0x58, 0x57, 0x4E, 0x5F, 0x5C, 0x5B, 0x5D, 0x5E, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 775
 #define _TBLDEF 1
@@ -115,6 +148,17 @@ const WCHAR Tbl[] = {	/*  CP775(0x80-0xFF) to Unicode conversion table */
 	0x00AD, 0x00B1, 0x201C, 0x00BE, 0x00B6, 0x00A7, 0x00F7, 0x201E,
 	0x00B0, 0x2219, 0x00B7, 0x00B9, 0x00B3, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x16, 0x1C, 0x1F, 0x27, 0x75, 0x28, 0x2E, 0x2A, 0x70, 0x29, 0x78, 0x71, 0x7D, 0x7C, 0x66,
+	0x74, 0x7A, 0x7B, 0x2F, 0x2C, 0x2B, 0x73, 0x0E, 0x0F, 0x12, 0x10, 0x60, 0x65, 0x19, 0x1E, 0x1D,
+	0x1A, 0x61, 0x04, 0x06, 0x11, 0x02, 0x22, 0x64, 0x14, 0x76, 0x1B, 0x01, 0x20, 0x03, 0x35, 0x50,
+	0x00, 0x07, 0x36, 0x51, 0x6D, 0x09, 0x38, 0x53, 0x37, 0x52, 0x15, 0x05, 0x21, 0x0C, 0x3D, 0x54,
+	0x68, 0x69, 0x6A, 0x6B, 0x2D, 0x08, 0x63, 0x67, 0x6E, 0x6C, 0x62, 0x13, 0x0A, 0x0B, 0x17, 0x18,
+	0x3E, 0x55, 0x47, 0x57, 0x46, 0x56, 0x0D, 0x25, 0x23, 0x24, 0x4F, 0x58, 0x6F, 0x72, 0x26, 0x77,
+	0x79, 0x44, 0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A, 0x49, 0x3B,
+	0x48, 0x3C, 0x4C, 0x39, 0x4B, 0x4A, 0x4E, 0x5F, 0x5C, 0x5B, 0x5D, 0x5E, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 850
 #define _TBLDEF 1
@@ -137,6 +181,17 @@ const WCHAR Tbl[] = {	/*  CP850(0x80-0xFF) to Unicode conversion table */
 	0x00AD, 0x00B1, 0x2017, 0x00BE, 0x00B6, 0x00A7, 0x00F7, 0x00B8,
 	0x00B0, 0x00A8, 0x00B7, 0x00B9, 0x00B3, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x2D, 0x3D, 0x1C, 0x4F, 0x3E, 0x5D, 0x75, 0x79, 0x38, 0x26, 0x2E, 0x2A, 0x70, 0x29, 0x6E,
+	0x78, 0x71, 0x7D, 0x7C, 0x6F, 0x66, 0x74, 0x7A, 0x77, 0x7B, 0x27, 0x2F, 0x2C, 0x2B, 0x73, 0x28,
+	0x37, 0x35, 0x36, 0x47, 0x0E, 0x0F, 0x12, 0x00, 0x54, 0x10, 0x52, 0x53, 0x5E, 0x56, 0x57, 0x58,
+	0x51, 0x25, 0x63, 0x60, 0x62, 0x65, 0x19, 0x1E, 0x1D, 0x6B, 0x69, 0x6A, 0x1A, 0x6D, 0x68, 0x61,
+	0x05, 0x20, 0x03, 0x46, 0x04, 0x06, 0x11, 0x07, 0x0A, 0x02, 0x08, 0x09, 0x0D, 0x21, 0x0C, 0x0B,
+	0x50, 0x24, 0x15, 0x22, 0x13, 0x64, 0x14, 0x76, 0x1B, 0x17, 0x23, 0x16, 0x01, 0x6C, 0x67, 0x18,
+	0x55, 0x1F, 0x72, 0x44, 0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A,
+	0x49, 0x3B, 0x48, 0x3C, 0x4C, 0x39, 0x4B, 0x4A, 0x4E, 0x5F, 0x5C, 0x5B, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 852
 #define _TBLDEF 1
@@ -159,6 +214,17 @@ const WCHAR Tbl[] = {	/*  CP852(0x80-0xFF) to Unicode conversion table */
 	0x00AD, 0x02DD, 0x02DB, 0x02C7, 0x02D8, 0x00A7, 0x00F7, 0x00B8,
 	0x00B0, 0x00A8, 0x02D9, 0x0171, 0x0158, 0x0159, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x4F, 0x75, 0x79, 0x2E, 0x2A, 0x70, 0x78, 0x6F, 0x77, 0x2F, 0x35, 0x36, 0x0E, 0x00, 0x10,
+	0x53, 0x56, 0x57, 0x60, 0x62, 0x19, 0x1E, 0x69, 0x1A, 0x6D, 0x61, 0x20, 0x03, 0x04, 0x07, 0x02,
+	0x09, 0x21, 0x0C, 0x22, 0x13, 0x14, 0x76, 0x23, 0x01, 0x6C, 0x46, 0x47, 0x24, 0x25, 0x0F, 0x06,
+	0x2C, 0x1F, 0x52, 0x54, 0x51, 0x50, 0x28, 0x29, 0x37, 0x58, 0x11, 0x12, 0x15, 0x16, 0x1D, 0x08,
+	0x63, 0x64, 0x55, 0x65, 0x0A, 0x0B, 0x68, 0x6A, 0x7C, 0x7D, 0x17, 0x18, 0x38, 0x2D, 0x66, 0x67,
+	0x5D, 0x6E, 0x1B, 0x1C, 0x5E, 0x05, 0x6B, 0x7B, 0x0D, 0x2B, 0x3D, 0x3E, 0x26, 0x27, 0x73, 0x74,
+	0x7A, 0x72, 0x71, 0x44, 0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A,
+	0x49, 0x3B, 0x48, 0x3C, 0x4C, 0x39, 0x4B, 0x4A, 0x4E, 0x5F, 0x5C, 0x5B, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 855
 #define _TBLDEF 1
@@ -181,6 +247,17 @@ const WCHAR Tbl[] = {	/*  CP855(0x80-0xFF) to Unicode conversion table */
 	0x00AD, 0x044B, 0x042B, 0x0437, 0x0417, 0x0448, 0x0428, 0x044D,
 	0x042D, 0x0449, 0x0429, 0x0447, 0x0427, 0x00A7, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x4F, 0x7D, 0x2E, 0x70, 0x2F, 0x05, 0x01, 0x03, 0x07, 0x09, 0x0B, 0x0D, 0x0F, 0x11, 0x13,
+	0x15, 0x17, 0x19, 0x1B, 0x21, 0x23, 0x6C, 0x2D, 0x27, 0x29, 0x6A, 0x74, 0x38, 0x3E, 0x47, 0x51,
+	0x53, 0x55, 0x57, 0x5D, 0x62, 0x64, 0x66, 0x68, 0x2B, 0x36, 0x25, 0x7C, 0x76, 0x7A, 0x1F, 0x72,
+	0x6E, 0x78, 0x1D, 0x60, 0x20, 0x22, 0x6B, 0x2C, 0x26, 0x28, 0x69, 0x73, 0x37, 0x3D, 0x46, 0x50,
+	0x52, 0x54, 0x56, 0x58, 0x61, 0x63, 0x65, 0x67, 0x2A, 0x35, 0x24, 0x7B, 0x75, 0x79, 0x1E, 0x71,
+	0x6D, 0x77, 0x1C, 0x5E, 0x04, 0x00, 0x02, 0x06, 0x08, 0x0A, 0x0C, 0x0E, 0x10, 0x12, 0x14, 0x16,
+	0x18, 0x1A, 0x6F, 0x44, 0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A,
+	0x49, 0x3B, 0x48, 0x3C, 0x4C, 0x39, 0x4B, 0x4A, 0x4E, 0x5F, 0x5C, 0x5B, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 857
 #define _TBLDEF 1
@@ -203,6 +280,17 @@ const WCHAR Tbl[] = {	/*  CP857(0x80-0xFF) to Unicode conversion table */
 	0x00AD, 0x00B1, 0x0000, 0x00BE, 0x00B6, 0x00A7, 0x00F7, 0x00B8,
 	0x00B0, 0x00A8, 0x00B7, 0x00B9, 0x00B3, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x55, 0x67, 0x72, 0x7F, 0x2D, 0x3D, 0x1C, 0x4F, 0x3E, 0x5D, 0x75, 0x79, 0x38, 0x51, 0x2E, 0x2A,
+	0x70, 0x29, 0x6E, 0x78, 0x71, 0x7D, 0x7C, 0x6F, 0x66, 0x74, 0x7A, 0x77, 0x7B, 0x50, 0x2F, 0x2C,
+	0x2B, 0x73, 0x28, 0x37, 0x35, 0x36, 0x47, 0x0E, 0x0F, 0x12, 0x00, 0x54, 0x10, 0x52, 0x53, 0x5E,
+	0x56, 0x57, 0x58, 0x25, 0x63, 0x60, 0x62, 0x65, 0x19, 0x68, 0x1D, 0x6B, 0x69, 0x6A, 0x1A, 0x61,
+	0x05, 0x20, 0x03, 0x46, 0x04, 0x06, 0x11, 0x07, 0x0A, 0x02, 0x08, 0x09, 0x6C, 0x21, 0x0C, 0x0B,
+	0x24, 0x15, 0x22, 0x13, 0x64, 0x14, 0x76, 0x1B, 0x17, 0x23, 0x16, 0x01, 0x6D, 0x26, 0x27, 0x18,
+	0x0D, 0x1E, 0x1F, 0x44, 0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A,
+	0x49, 0x3B, 0x48, 0x3C, 0x4C, 0x39, 0x4B, 0x4A, 0x4E, 0x5F, 0x5C, 0x5B, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 858
 #define _TBLDEF 1
@@ -225,6 +313,17 @@ const WCHAR Tbl[] = {	/*  CP858(0x80-0xFF) to Unicode conversion table */
 	0x00AD, 0x00B1, 0x2017, 0x00BE, 0x00B6, 0x00A7, 0x00F7, 0x00B8,
 	0x00B0, 0x00A8, 0x00B7, 0x00B9, 0x00B3, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x2D, 0x3D, 0x1C, 0x4F, 0x3E, 0x75, 0x79, 0x38, 0x26, 0x2E, 0x2A, 0x70, 0x29, 0x6E, 0x78,
+	0x71, 0x7D, 0x7C, 0x6F, 0x66, 0x74, 0x7A, 0x77, 0x7B, 0x27, 0x2F, 0x2C, 0x2B, 0x73, 0x28, 0x37,
+	0x35, 0x36, 0x47, 0x0E, 0x0F, 0x12, 0x5D, 0x00, 0x54, 0x10, 0x52, 0x53, 0x5E, 0x56, 0x57, 0x58,
+	0x51, 0x25, 0x63, 0x60, 0x62, 0x65, 0x19, 0x1E, 0x1D, 0x6B, 0x69, 0x6A, 0x1A, 0x6D, 0x68, 0x61,
+	0x05, 0x20, 0x03, 0x46, 0x04, 0x06, 0x11, 0x07, 0x0A, 0x02, 0x08, 0x09, 0x0D, 0x21, 0x0C, 0x0B,
+	0x50, 0x24, 0x15, 0x22, 0x13, 0x64, 0x14, 0x76, 0x1B, 0x17, 0x23, 0x16, 0x01, 0x6C, 0x67, 0x18,
+	0x1F, 0x72, 0x55, 0x44, 0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x3C, 0x4D,
+	0x3A, 0x49, 0x3B, 0x48, 0x4C, 0x39, 0x4B, 0x4A, 0x4E, 0x5F, 0x5C, 0x5B, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 862
 #define _TBLDEF 1
@@ -247,6 +346,17 @@ const WCHAR Tbl[] = {	/*  CP862(0x80-0xFF) to Unicode conversion table */
 	0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
 	0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x2D, 0x1B, 0x1C, 0x1D, 0x26, 0x2E, 0x2A, 0x78, 0x71, 0x7D, 0x66, 0x7A, 0x27, 0x2F, 0x2C,
+	0x2B, 0x28, 0x25, 0x61, 0x20, 0x21, 0x24, 0x22, 0x76, 0x23, 0x1F, 0x62, 0x69, 0x64, 0x68, 0x6A,
+	0x60, 0x6B, 0x6E, 0x63, 0x65, 0x67, 0x6D, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+	0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+	0x19, 0x1A, 0x7C, 0x1E, 0x79, 0x7B, 0x6C, 0x6F, 0x77, 0x70, 0x73, 0x72, 0x29, 0x74, 0x75, 0x44,
+	0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A, 0x55, 0x56, 0x49, 0x38,
+	0x37, 0x3B, 0x54, 0x53, 0x48, 0x3E, 0x3D, 0x3C, 0x46, 0x47, 0x4C, 0x35, 0x36, 0x39, 0x51, 0x52,
+	0x4B, 0x4F, 0x50, 0x4A, 0x58, 0x57, 0x4E, 0x5F, 0x5C, 0x5B, 0x5D, 0x5E, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 866
 #define _TBLDEF 1
@@ -269,6 +379,17 @@ const WCHAR Tbl[] = {	/*  CP866(0x80-0xFF) to Unicode conversion table */
 	0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040E, 0x045E,
 	0x00B0, 0x2219, 0x00B7, 0x221A, 0x2116, 0x00A4, 0x25A0, 0x00A0
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x7F, 0x7D, 0x78, 0x7A, 0x70, 0x72, 0x74, 0x76, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+	0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+	0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+	0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x71, 0x73, 0x75, 0x77, 0x7C, 0x79, 0x7B, 0x44,
+	0x33, 0x5A, 0x3F, 0x40, 0x59, 0x43, 0x34, 0x42, 0x41, 0x45, 0x4D, 0x3A, 0x55, 0x56, 0x49, 0x38,
+	0x37, 0x3B, 0x54, 0x53, 0x48, 0x3E, 0x3D, 0x3C, 0x46, 0x47, 0x4C, 0x35, 0x36, 0x39, 0x51, 0x52,
+	0x4B, 0x4F, 0x50, 0x4A, 0x58, 0x57, 0x4E, 0x5F, 0x5C, 0x5B, 0x5D, 0x5E, 0x30, 0x31, 0x32, 0x7E
+};
 
 #elif _CODE_PAGE == 874
 #define _TBLDEF 1
@@ -291,6 +412,17 @@ const WCHAR Tbl[] = {	/*  CP874(0x80-0xFF) to Unicode conversion table */
 	0x0E50, 0x0E51, 0x0E52, 0x0E53, 0x0E54, 0x0E55, 0x0E56, 0x0E57,
 	0x0E58, 0x0E59, 0x0E5A, 0x0E5B, 0x0000, 0x0000, 0x0000, 0x0000
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x02, 0x03, 0x04, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x18,
+	0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x5B, 0x5C, 0x5D, 0x5E, 0x7C, 0x7D, 0x7E, 0x7F, 0x20,
+	0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30,
+	0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F, 0x40,
+	0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50,
+	0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5F, 0x60, 0x61, 0x62, 0x63, 0x64,
+	0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0x73, 0x74,
+	0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x16, 0x17, 0x11, 0x12, 0x13, 0x14, 0x15, 0x05, 0x00
+};
 
 #elif _CODE_PAGE == 1250
 #define _TBLDEF 1
@@ -313,6 +445,17 @@ const WCHAR Tbl[] = {	/*  CP1250(0x80-0xFF) to Unicode conversion table */
 	0x0111, 0x0144, 0x0148, 0x00F3, 0x00F4, 0x0151, 0x00F6, 0x00F7,
 	0x0159, 0x016F, 0x00FA, 0x0171, 0x00FC, 0x00FD, 0x0163, 0x02D9
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x03, 0x08, 0x10, 0x18, 0x20, 0x24, 0x26, 0x27, 0x28, 0x29, 0x2B, 0x2C, 0x2D, 0x2E, 0x30,
+	0x31, 0x34, 0x35, 0x36, 0x37, 0x38, 0x3B, 0x41, 0x42, 0x44, 0x47, 0x49, 0x4B, 0x4D, 0x4E, 0x53,
+	0x54, 0x56, 0x57, 0x5A, 0x5C, 0x5D, 0x5F, 0x61, 0x62, 0x64, 0x67, 0x69, 0x6B, 0x6D, 0x6E, 0x73,
+	0x74, 0x76, 0x77, 0x7A, 0x7C, 0x7D, 0x43, 0x63, 0x25, 0x39, 0x46, 0x66, 0x48, 0x68, 0x4F, 0x6F,
+	0x50, 0x70, 0x4A, 0x6A, 0x4C, 0x6C, 0x45, 0x65, 0x3C, 0x3E, 0x23, 0x33, 0x51, 0x71, 0x52, 0x72,
+	0x55, 0x75, 0x40, 0x60, 0x58, 0x78, 0x0C, 0x1C, 0x2A, 0x3A, 0x0A, 0x1A, 0x5E, 0x7E, 0x0D, 0x1D,
+	0x59, 0x79, 0x5B, 0x7B, 0x0F, 0x1F, 0x2F, 0x3F, 0x0E, 0x1E, 0x21, 0x22, 0x7F, 0x32, 0x3D, 0x16,
+	0x17, 0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x19
+};
 
 #elif _CODE_PAGE == 1251
 #define _TBLDEF 1
@@ -335,6 +478,17 @@ const WCHAR Tbl[] = {	/*  CP1251(0x80-0xFF) to Unicode conversion table */
 	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
 	0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x18, 0x20, 0x24, 0x26, 0x27, 0x29, 0x2B, 0x2C, 0x2D, 0x2E, 0x30, 0x31, 0x35, 0x36, 0x37, 0x3B,
+	0x28, 0x00, 0x01, 0x2A, 0x3D, 0x32, 0x2F, 0x23, 0x0A, 0x0C, 0x0E, 0x0D, 0x21, 0x0F, 0x40, 0x41,
+	0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51,
+	0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5C, 0x5B, 0x5D, 0x5E, 0x5F, 0x60, 0x61,
+	0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71,
+	0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F, 0x38, 0x10,
+	0x03, 0x3A, 0x3E, 0x33, 0x3F, 0x3C, 0x1A, 0x1C, 0x1E, 0x1D, 0x22, 0x1F, 0x25, 0x34, 0x16, 0x17,
+	0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x08, 0x19, 0x39
+};
 
 #elif _CODE_PAGE == 1252
 #define _TBLDEF 1
@@ -357,6 +511,17 @@ const WCHAR Tbl[] = {	/*  CP1252(0x80-0xFF) to Unicode conversion table */
 	0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
 	0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x0D, 0x0F, 0x10, 0x1D, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A,
+	0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A,
+	0x3B, 0x3C, 0x3D, 0x5B, 0x3E, 0x3F, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5A, 0x5C, 0x5D, 0x5E, 0x5F, 0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A,
+	0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A,
+	0x7B, 0x7C, 0x7D, 0x7E, 0x7F, 0x0C, 0x1C, 0x0A, 0x1A, 0x1F, 0x0E, 0x1E, 0x03, 0x08, 0x18, 0x16,
+	0x17, 0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x19
+};
 
 #elif _CODE_PAGE == 1253
 #define _TBLDEF 1
@@ -379,6 +544,17 @@ const WCHAR Tbl[] = {	/*  CP1253(0x80-0xFF) to Unicode conversion table */
 	0x03C0, 0x03C1, 0x03C2, 0x03C3, 0x03C4, 0x03C5, 0x03C6, 0x03C7,
 	0x03C8, 0x03C9, 0x03CA, 0x03CB, 0x03CC, 0x03CD, 0x03CE, 0x0000
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x08, 0x0A, 0x0D, 0x0E, 0x0F, 0x10, 0x18, 0x1A, 0x1C, 0x1D, 0x1E, 0x1F, 0x2A, 0x52, 0x7F,
+	0x0C, 0x20, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2B, 0x2C, 0x2D, 0x2E, 0x30, 0x31, 0x32,
+	0x33, 0x35, 0x36, 0x37, 0x3B, 0x3D, 0x03, 0x34, 0x21, 0x22, 0x38, 0x39, 0x3A, 0x3C, 0x3E, 0x3F,
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+	0x50, 0x51, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5C, 0x5B, 0x5D, 0x5E, 0x5F, 0x60,
+	0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70,
+	0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x16, 0x17,
+	0x2F, 0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x19
+};
 
 #elif _CODE_PAGE == 1254
 #define _TBLDEF 1
@@ -401,6 +577,17 @@ const WCHAR Tbl[] = {	/*  CP1254(0x80-0xFF) to Unicode conversion table */
 	0x011F, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
 	0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x0131, 0x015F, 0x00FF
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x0D, 0x0E, 0x0F, 0x10, 0x1D, 0x1E, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38,
+	0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x5B, 0x3E, 0x3F, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+	0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5A, 0x5C, 0x5F, 0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B,
+	0x6C, 0x6D, 0x6E, 0x6F, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C,
+	0x7F, 0x50, 0x70, 0x5D, 0x7D, 0x0C, 0x1C, 0x5E, 0x7E, 0x0A, 0x1A, 0x1F, 0x03, 0x08, 0x18, 0x16,
+	0x17, 0x11, 0x12, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x02, 0x19
+};
 
 #elif _CODE_PAGE == 1255
 #define _TBLDEF 1
@@ -423,6 +610,17 @@ const WCHAR Tbl[] = {	/*  CP1255(0x80-0xFF) to Unicode conversion table */
 	0x05E0, 0x05E1, 0x05E2, 0x05E3, 0x05E4, 0x05E5, 0x05E6, 0x05E7,
 	0x05E8, 0x05E9, 0x05EA, 0x0000, 0x0000, 0x200E, 0x200F, 0x0000
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x0A, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x1A, 0x1C, 0x1D, 0x1E, 0x1F, 0x4A, 0x59, 0x5A, 0x5B,
+	0x5C, 0x5D, 0x5E, 0x5F, 0x7B, 0x7C, 0x7F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+	0x3B, 0x3C, 0x3D, 0x3E, 0x3F, 0x2A, 0x3A, 0x03, 0x08, 0x18, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45,
+	0x46, 0x47, 0x48, 0x49, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52, 0x53, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72,
+	0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x54, 0x55, 0x56, 0x57, 0x58, 0x7D, 0x7E, 0x16,
+	0x17, 0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x19
+};
 
 #elif _CODE_PAGE == 1256
 #define _TBLDEF 1
@@ -444,7 +642,18 @@ const WCHAR Tbl[] = {	/*  CP1256(0x80-0xFF) to Unicode conversion table */
 	0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x0649, 0x064A, 0x00EE, 0x00EF,
 	0x064B, 0x064C, 0x064D, 0x064E, 0x00F4, 0x064F, 0x0650, 0x00F7,
 	0x0651, 0x00F9, 0x0652, 0x00FB, 0x00FC, 0x200E, 0x200F, 0x06D2
-}
+};
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x20, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31,
+	0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3B, 0x3C, 0x3D, 0x3E, 0x57, 0x60, 0x62, 0x67,
+	0x68, 0x69, 0x6A, 0x6B, 0x6E, 0x6F, 0x74, 0x77, 0x79, 0x7B, 0x7C, 0x0C, 0x1C, 0x03, 0x08, 0x21,
+	0x3A, 0x3F, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E,
+	0x4F, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+	0x61, 0x63, 0x64, 0x65, 0x66, 0x6C, 0x6D, 0x70, 0x71, 0x72, 0x73, 0x75, 0x76, 0x78, 0x7A, 0x0A,
+	0x01, 0x0D, 0x0F, 0x1A, 0x0E, 0x18, 0x10, 0x1F, 0x2A, 0x40, 0x7F, 0x1D, 0x1E, 0x7D, 0x7E, 0x16,
+	0x17, 0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x19
+};
 
 #elif _CODE_PAGE == 1257
 #define _TBLDEF 1
@@ -467,6 +676,17 @@ const WCHAR Tbl[] = {	/*  CP1257(0x80-0xFF) to Unicode conversion table */
 	0x0161, 0x0144, 0x0146, 0x00F3, 0x014D, 0x00F5, 0x00F6, 0x00F7,
 	0x0173, 0x014E, 0x015B, 0x016B, 0x00FC, 0x017C, 0x017E, 0x02D9
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x03, 0x08, 0x0A, 0x0C, 0x10, 0x18, 0x1A, 0x1C, 0x1F, 0x21, 0x25, 0x20, 0x22, 0x23, 0x24,
+	0x26, 0x27, 0x0D, 0x29, 0x2B, 0x2C, 0x2D, 0x2E, 0x1D, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35,
+	0x36, 0x37, 0x0F, 0x38, 0x39, 0x3B, 0x3C, 0x3D, 0x3E, 0x44, 0x45, 0x49, 0x53, 0x55, 0x56, 0x57,
+	0x28, 0x5C, 0x5F, 0x64, 0x65, 0x3F, 0x69, 0x73, 0x75, 0x76, 0x77, 0x7C, 0x42, 0x62, 0x40, 0x60,
+	0x43, 0x63, 0x48, 0x68, 0x47, 0x67, 0x4B, 0x6B, 0x46, 0x66, 0x4C, 0x6C, 0x4E, 0x6E, 0x41, 0x61,
+	0x4D, 0x6D, 0x4F, 0x6F, 0x59, 0x51, 0x71, 0x52, 0x72, 0x54, 0x74, 0x79, 0x2A, 0x3A, 0x5A, 0x7A,
+	0x50, 0x70, 0x5B, 0x7B, 0x58, 0x78, 0x4A, 0x6A, 0x5D, 0x7D, 0x5E, 0x7E, 0x0E, 0x7F, 0x1E, 0x16,
+	0x17, 0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x00, 0x19
+};
 
 #elif _CODE_PAGE == 1258
 #define _TBLDEF 1
@@ -489,6 +709,17 @@ const WCHAR Tbl[] = {	/*  CP1258(0x80-0xFF) to Unicode conversion table */
 	0x0111, 0x00F1, 0x0323, 0x00F3, 0x00F4, 0x01A1, 0x00F6, 0x00F7,
 	0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x01B0, 0x20AB, 0x00FF
 };
+static
+const BYTE Srt[] = {	/*  Tbl indexes in ascending order of Unicode */
+	0x01, 0x0A, 0x0D, 0x0E, 0x0F, 0x10, 0x1A, 0x1D, 0x1E, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26,
+	0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36,
+	0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F, 0x40, 0x41, 0x42, 0x44, 0x45, 0x46, 0x47,
+	0x48, 0x49, 0x4A, 0x4B, 0x4D, 0x4E, 0x4F, 0x51, 0x53, 0x54, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5B,
+	0x5C, 0x5F, 0x60, 0x61, 0x62, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6D, 0x6E, 0x6F,
+	0x71, 0x73, 0x74, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7F, 0x43, 0x63, 0x50, 0x70, 0x0C,
+	0x1C, 0x1F, 0x03, 0x55, 0x75, 0x5D, 0x7D, 0x08, 0x18, 0x4C, 0x6C, 0x5E, 0x52, 0x72, 0x16, 0x17,
+	0x11, 0x12, 0x02, 0x13, 0x14, 0x04, 0x06, 0x07, 0x15, 0x05, 0x09, 0x0B, 0x1B, 0x7E, 0x00, 0x19
+};
 
 #endif
 
@@ -498,12 +729,50 @@ const WCHAR Tbl[] = {	/*  CP1258(0x80-0xFF) to Unicode conversion table */
 #endif
 
 
+/* Upper case of U+0080-U+00FF, ASCII is done in line. The mappings of
+   0xA1-0xAF to full width forms are kept from the original search table. */
+#define UP1(c)	(((c) >= 0xE0 && (c) != 0xF7 && (c) != 0xFF) ? (c) - 0x20 : \
+				 (c) == 0xFF ? 0x178 : (c) == 0xA1 ? 0x21 : (c) == 0xA2 ? 0xFFE0 : \
+				 (c) == 0xA3 ? 0xFFE1 : (c) == 0xA5 ? 0xFFE5 : (c) == 0xAC ? 0xFFE2 : \
+				 (c) == 0xAF ? 0xFFE3 : (c))
+#define UP4(c)	UP1(c), UP1((c) + 1), UP1((c) + 2), UP1((c) + 3)
+#define UP16(c)	UP4(c), UP4((c) + 4), UP4((c) + 8), UP4((c) + 12)
+
+static
+const WCHAR Upper[] = {
+	UP16(0x80), UP16(0x90), UP16(0xA0), UP16(0xB0),
+	UP16(0xC0), UP16(0xD0), UP16(0xE0), UP16(0xF0)
+};
+
+/* Lower case ranges above U+00FF, in ascending order */
+static
+const struct {
+	WCHAR first, last;
+	WCHAR diff;		/* Lower - upper */
+	BYTE alt;		/* 1: every other code from first, pairs of Latin Extended-A */
+} UpRange[] = {
+	{ 0x0101, 0x0137, 0x01, 1 },
+	{ 0x013A, 0x0148, 0x01, 1 },
+	{ 0x014B, 0x0177, 0x01, 1 },
+	{ 0x017A, 0x017E, 0x01, 1 },
+	{ 0x0192, 0x0192, 0x01, 0 },
+	{ 0x03B1, 0x03C1, 0x20, 0 },	/* Greek */
+	{ 0x03C3, 0x03CA, 0x20, 0 },
+	{ 0x0430, 0x044F, 0x20, 0 },	/* Cyrillic */
+	{ 0x0451, 0x045C, 0x50, 0 },
+	{ 0x045E, 0x045F, 0x50, 0 },
+	{ 0x2170, 0x217F, 0x10, 0 },	/* Roman numerals */
+	{ 0xFF41, 0xFF5A, 0x20, 0 }		/* Full width Latin */
+};
+
+
 WCHAR ff_convert (	/* Converted character, Returns zero on error */
 	WCHAR	src,	/* Character code to be converted */
 	UINT	dir		/* 0: Unicode to OEMCP, 1: OEMCP to Unicode */
 )
 {
 	WCHAR c;
+	UINT lo, hi, i;
 
 
 	if (src < 0x80) {	/* ASCII */
@@ -513,11 +782,13 @@ WCHAR ff_convert (	/* Converted character, Returns zero on error */
 		if (dir) {		/* OEMCP to Unicode */
 			c = (src >= 0x100) ? 0 : Tbl[src - 0x80];
 
-		} else {		/* Unicode to OEMCP */
-			for (c = 0; c < 0x80; c++) {
-				if (src == Tbl[c]) break;
+		} else {		/* Unicode to OEMCP, binary search in Srt, lowest code on duplicates */
+			lo = 0; hi = sizeof(Srt);
+			while (lo < hi) {
+				i = (lo + hi) / 2;
+				if (Tbl[Srt[i]] < src) lo = i + 1; else hi = i;
 			}
-			c = (c + 0x80) & 0xFF;
+			c = (lo < sizeof(Srt) && Tbl[Srt[lo]] == src) ? Srt[lo] + 0x80 : 0;
 		}
 	}
 
@@ -529,12 +800,19 @@ WCHAR ff_wtoupper (	/* Upper converted character */
 	WCHAR chr		/* Input character */
 )
 {
-	static const WCHAR tbl_lower[] = { 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0xA1, 0x00A2, 0x00A3, 0x00A5, 0x00AC, 0x00AF, 0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF, 0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0x0FF, 0x101, 0x103, 0x105, 0x107, 0x109, 0x10B, 0x10D, 0x10F, 0x111, 0x113, 0x115, 0x117, 0x119, 0x11B, 0x11D, 0x11F, 0x121, 0x123, 0x125, 0x127, 0x129, 0x12B, 0x12D, 0x12F, 0x131, 0x133, 0x135, 0x137, 0x13A, 0x13C, 0x13E, 0x140, 0x142, 0x144, 0x146, 0x148, 0x14B, 0x14D, 0x14F, 0x151, 0x153, 0x155, 0x157, 0x159, 0x15B, 0x15D, 0x15F, 0x161, 0x163, 0x165, 0x167, 0x169, 0x16B, 0x16D, 0x16F, 0x171, 0x173, 0x175, 0x177, 0x17A, 0x17C, 0x17E, 0x192, 0x3B1, 0x3B2, 0x3B3, 0x3B4, 0x3B5, 0x3B6, 0x3B7, 0x3B8, 0x3B9, 0x3BA, 0x3BB, 0x3BC, 0x3BD, 0x3BE, 0x3BF, 0x3C0, 0x3C1, 0x3C3, 0x3C4, 0x3C5, 0x3C6, 0x3C7, 0x3C8, 0x3C9, 0x3CA, 0x430, 0x431, 0x432, 0x433, 0x434, 0x435, 0x436, 0x437, 0x438, 0x439, 0x43A, 0x43B, 0x43C, 0x43D, 0x43E, 0x43F, 0x440, 0x441, 0x442, 0x443, 0x444, 0x445, 0x446, 0x447, 0x448, 0x449, 0x44A, 0x44B, 0x44C, 0x44D, 0x44E, 0x44F, 0x451, 0x452, 0x453, 0x454, 0x455, 0x456, 0x457, 0x458, 0x459, 0x45A, 0x45B, 0x45C, 0x45E, 0x45F, 0x2170, 0x2171, 0x2172, 0x2173, 0x2174, 0x2175, 0x2176, 0x2177, 0x2178, 0x2179, 0x217A, 0x217B, 0x217C, 0x217D, 0x217E, 0x217F, 0xFF41, 0xFF42, 0xFF43, 0xFF44, 0xFF45, 0xFF46, 0xFF47, 0xFF48, 0xFF49, 0xFF4A, 0xFF4B, 0xFF4C, 0xFF4D, 0xFF4E, 0xFF4F, 0xFF50, 0xFF51, 0xFF52, 0xFF53, 0xFF54, 0xFF55, 0xFF56, 0xFF57, 0xFF58, 0xFF59, 0xFF5A, 0 };
-	static const WCHAR tbl_upper[] = { 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x21, 0xFFE0, 0xFFE1, 0xFFE5, 0xFFE2, 0xFFE3, 0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF, 0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0x178, 0x100, 0x102, 0x104, 0x106, 0x108, 0x10A, 0x10C, 0x10E, 0x110, 0x112, 0x114, 0x116, 0x118, 0x11A, 0x11C, 0x11E, 0x120, 0x122, 0x124, 0x126, 0x128, 0x12A, 0x12C, 0x12E, 0x130, 0x132, 0x134, 0x136, 0x139, 0x13B, 0x13D, 0x13F, 0x141, 0x143, 0x145, 0x147, 0x14A, 0x14C, 0x14E, 0x150, 0x152, 0x154, 0x156, 0x158, 0x15A, 0x15C, 0x15E, 0x160, 0x162, 0x164, 0x166, 0x168, 0x16A, 0x16C, 0x16E, 0x170, 0x172, 0x174, 0x176, 0x179, 0x17B, 0x17D, 0x191, 0x391, 0x392, 0x393, 0x394, 0x395, 0x396, 0x397, 0x398, 0x399, 0x39A, 0x39B, 0x39C, 0x39D, 0x39E, 0x39F, 0x3A0, 0x3A1, 0x3A3, 0x3A4, 0x3A5, 0x3A6, 0x3A7, 0x3A8, 0x3A9, 0x3AA, 0x410, 0x411, 0x412, 0x413, 0x414, 0x415, 0x416, 0x417, 0x418, 0x419, 0x41A, 0x41B, 0x41C, 0x41D, 0x41E, 0x41F, 0x420, 0x421, 0x422, 0x423, 0x424, 0x425, 0x426, 0x427, 0x428, 0x429, 0x42A, 0x42B, 0x42C, 0x42D, 0x42E, 0x42F, 0x401, 0x402, 0x403, 0x404, 0x405, 0x406, 0x407, 0x408, 0x409, 0x40A, 0x40B, 0x40C, 0x40E, 0x40F, 0x2160, 0x2161, 0x2162, 0x2163, 0x2164, 0x2165, 0x2166, 0x2167, 0x2168, 0x2169, 0x216A, 0x216B, 0x216C, 0x216D, 0x216E, 0x216F, 0xFF21, 0xFF22, 0xFF23, 0xFF24, 0xFF25, 0xFF26, 0xFF27, 0xFF28, 0xFF29, 0xFF2A, 0xFF2B, 0xFF2C, 0xFF2D, 0xFF2E, 0xFF2F, 0xFF30, 0xFF31, 0xFF32, 0xFF33, 0xFF34, 0xFF35, 0xFF36, 0xFF37, 0xFF38, 0xFF39, 0xFF3A, 0 };
-	int i;
+	UINT lo, hi, i;
+
 
+	if (chr < 0x80) return (chr >= 'a' && chr <= 'z') ? chr - 0x20 : chr;
+	if (chr < 0x100) return Upper[chr - 0x80];
 
-	for (i = 0; tbl_lower[i] && chr != tbl_lower[i]; i++) ;
+	lo = 0; hi = sizeof(UpRange) / sizeof(UpRange[0]);
+	while (lo < hi) {		/* First range ending at or after chr */
+		i = (lo + hi) / 2;
+		if (UpRange[i].last < chr) lo = i + 1; else hi = i;
+	}
+	if (lo == sizeof(UpRange) / sizeof(UpRange[0]) || chr < UpRange[lo].first) return chr;
+	if (UpRange[lo].alt && ((chr - UpRange[lo].first) & 1)) return chr;
 
-	return tbl_lower[i] ? tbl_upper[i] : chr;
+	return chr - UpRange[lo].diff;
 }
@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "timer.h"
+#include "hw_config.h"
+#include "ff.h"
+#include "crc.h"
+#include "logbuf.h"
+#include "download.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+struct download_stats_s download_stats;
+
+/*
+ * One frame goes out from the USART interrupt while the next one is
+ * read into the other: the line never waits for the card.
+ */
+static uint8_t frame[2][DL_FRAME_MAX];
+static uint8_t tx_frame;
+/* frame[tx_frame ^ 1] is complete and waits for the line */
+static bool prepared;
+
+/* Request being received, room for the path terminator over the CRC */
+static uint8_t rx[DL_HDR_SIZE + DL_REQUEST_MAX + DL_CRC_SIZE];
+static uint16_t rx_len;
+
+static bool active = FALSE;
+static uint32_t baud = DL_BAUD;
+/* Applied once the reply is on the line */
+static uint32_t new_baud;
+static bool closing;
+static tick_t heard_at;
+
+/* READ transfer: frames base .. next - 1 are in flight */
+static FIL file;
+static bool reading = FALSE;
+static DWORD read_offset;
+static DWORD read_length;
+static uint16_t frames;
+static uint16_t base;
+static uint16_t next;
+/* Bit n: frame base + n is to be sent again */
+static uint32_t resend;
+static tick_t progress_at;
+
+static uint8_t *download_out(void){
+	return frame[tx_frame ^ 1] + DL_HDR_SIZE;
+}
+
+/* Header and CRC around the payload of the frame to prepare */
+static void download_seal(uint8_t type, uint16_t seq, uint16_t len){
+	uint8_t *f = frame[tx_frame ^ 1];
+
+	f[0] = DL_SYNC0;
+	f[1] = DL_SYNC1;
+	f[DL_HDR_TYPE] = type;
+	f[DL_HDR_FLAGS] = 0;
+	ST_WORD(f + DL_HDR_SEQ, seq);
+	ST_WORD(f + DL_HDR_LEN, len);
+	ST_WORD(f + DL_HDR_SIZE + len,
+			crc16_block(CRC_FEED, f + DL_HDR_TYPE, DL_HDR_SIZE - DL_HDR_TYPE + len));
+	prepared = TRUE;
+}
+
+static void download_error(uint16_t seq, uint8_t result){
+	*download_out() = result;
+	download_seal(DL_ERROR, seq, 1);
+}
+
+/* Hand the prepared frame to the line once the previous one is out */
+static void download_send(void){
+	uint8_t *f;
+
+	if (prepared == FALSE || USART1_Frame_Busy()) {
+		return;
+	}
+	f = frame[tx_frame ^ 1];
+	tx_frame ^= 1;
+	prepared = FALSE;
+	USART1_Send_Frame(f, DL_HDR_SIZE + LD_WORD(f + DL_HDR_LEN) + DL_CRC_SIZE);
+}
+
+static void download_stop(void){
+	if (reading) {
+		reading = FALSE;
+		prepared = FALSE;
+		f_close(&file);
+	}
+}
+
+static void download_end(void){
+	download_stop();
+	prepared = FALSE;
+	new_baud = 0;
+	closing = FALSE;
+	baud = DL_BAUD;
+	USART1_Set_Baud(DL_BAUD);
+	USART1_Set_Binary(FALSE);
+	active = FALSE;
+	DEBUGF("Download: session closed, %d frames, %d resent.\n",
+			(int)download_stats.frames, (int)download_stats.resent);
+}
+
+/* Collect a frame byte by byte, TRUE once a complete one checks */
+static bool download_rx(uint8_t c){
+	uint16_t len;
+
+	if ((rx_len == 0 && c != DL_SYNC0) || (rx_len == 1 && c != DL_SYNC1)) {
+		rx_len = (c == DL_SYNC0) ? 1 : 0;
+		rx[0] = c;
+		return FALSE;
+	}
+	rx[rx_len++] = c;
+	if (rx_len < DL_HDR_SIZE) {
+		return FALSE;
+	}
+	len = LD_WORD(rx + DL_HDR_LEN);
+	if (len > DL_REQUEST_MAX) {
+		rx_len = 0;
+		download_stats.bad_frames++;
+		return FALSE;
+	}
+	if (rx_len < DL_HDR_SIZE + len + DL_CRC_SIZE) {
+		return FALSE;
+	}
+	rx_len = 0;
+	if (crc16_block(CRC_FEED, rx + DL_HDR_TYPE, DL_HDR_SIZE - DL_HDR_TYPE + len)
+			!= LD_WORD(rx + DL_HDR_SIZE + len)) {
+		download_stats.bad_frames++;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Frame seq of the transfer, read by FatFs straight into the frame */
+static void download_data(uint16_t seq){
+	DWORD ofs = (DWORD)seq * DL_DATA_SIZE;
+	UINT n, br;
+
+	n = (read_length - ofs < DL_DATA_SIZE) ? read_length - ofs : DL_DATA_SIZE;
+	if (f_lseek(&file, read_offset + ofs) != FR_OK
+			|| f_read(&file, download_out(), n, &br) != FR_OK || br != n) {
+		download_stop();
+		download_error(seq, FR_DISK_ERR);
+		return;
+	}
+	download_seal(DL_DATA, seq, n);
+	download_stats.frames++;
+}
+
+/* Next frame of the transfer: one missing, a new one, or the oldest again */
+static void download_read_Mgmt(void){
+	uint16_t seq;
+	uint8_t k;
+
+	if (prepared) {
+		return;
+	}
+	if (resend) {
+		for (k = 0; (resend & (1UL << k)) == 0; k++) {
+		}
+		resend &= ~(1UL << k);
+		seq = base + k;
+		download_stats.resent++;
+	} else if (next != frames && (uint16_t)(next - base) < DL_WINDOW) {
+		seq = next++;
+	} else if (expire_timer(progress_at, DL_RETRY)) {
+		progress_at = tick_1khz();
+		seq = base;
+		download_stats.timeouts++;
+		download_stats.resent++;
+	} else {
+		return;
+	}
+	download_data(seq);
+}
+
+static void download_ack(const uint8_t *req){
+	uint16_t ack = LD_WORD(req);
+	uint32_t map = LD_DWORD(req + 2);
+	uint16_t n;
+	uint8_t i;
+
+	if ((uint16_t)(ack - base) > (uint16_t)(next - base)) {
+		return;						/* stale or not sent yet */
+	}
+	if (ack != base) {
+		resend >>= (uint16_t)(ack - base);
+		base = ack;
+		progress_at = tick_1khz();
+	}
+	if (base == frames) {
+		download_stop();
+		return;
+	}
+
+	n = next - base;
+	if ((req[6] & DL_ACK_RESEND) == 0 || n == 0) {
+		return;
+	}
+	/* Frame base, and the ones missing below the last received */
+	map &= (1UL << (n - 1)) - 1;
+	resend |= 1;
+	for (i = 0; i < 31 && (map >> (i + 1)) != 0; i++) {
+		if ((map & (1UL << i)) == 0) {
+			resend |= 1UL << (i + 1);
+		}
+	}
+}
+
+static void download_hello(uint16_t seq, const uint8_t *req, uint16_t len){
+	uint8_t *out = download_out();
+	uint32_t rate = (len >= 4) ? LD_DWORD(req) : 0;
+
+	/* The USART needs 16 clocks a bit */
+	if (rate == 0 || rate > (uint32_t)sys_clock_freq_stepping / 16 || rate < 1200) {
+		rate = baud;
+	}
+	if (active == FALSE) {
+		active = TRUE;
+		download_stats.sessions++;
+		USART1_Set_Binary(TRUE);
+		/* The file being logged, up to now */
+		logbuf_flush();
+	}
+	if (rate != baud) {
+		new_baud = rate;
+	}
+
+	out[0] = DL_VERSION;
+	out[1] = DL_WINDOW;
+	ST_WORD(out + 2, DL_DATA_SIZE);
+	ST_DWORD(out + 4, rate);
+	download_seal(DL_HELLO, seq, 8);
+}
+
+static void download_list(uint16_t seq, const uint8_t *req, uint16_t len){
+	uint8_t *out = download_out();
+	uint16_t index, n = 0;
+	FILINFO info;
+	DIR dir;
+	FRESULT res;
+
+	if (len < 2) {
+		download_error(seq, DL_E_REQUEST);
+		return;
+	}
+	index = LD_WORD(req);
+#if _USE_LFN
+	info.lfname = NULL;
+	info.lfsize = 0;
+#endif
+	res = f_opendir(&dir, (const char *)req + 2);
+	while (res == FR_OK && n < DL_LIST_ENTRIES) {
+		res = f_readdir(&dir, &info);
+		if (res != FR_OK || info.fname[0] == '\0') {
+			break;
+		}
+		if (index) {
+			index--;
+			continue;
+		}
+		ST_DWORD(out, info.fsize);
+		ST_WORD(out + 4, info.fdate);
+		ST_WORD(out + 6, info.ftime);
+		out[8] = info.fattrib;
+		memcpy(out + 9, info.fname, 13);
+		out += DL_LIST_ENTRY_SIZE;
+		n++;
+	}
+	if (res != FR_OK) {
+		download_error(seq, res);
+		return;
+	}
+	download_seal(DL_LIST, seq, n * DL_LIST_ENTRY_SIZE);
+}
+
+static void download_stat(uint16_t seq, const uint8_t *req){
+	uint8_t *out = download_out();
+	FILINFO info;
+	FRESULT res;
+
+#if _USE_LFN
+	info.lfname = NULL;
+	info.lfsize = 0;
+#endif
+	res = f_stat((const char *)req, &info);
+	memset(out, 0, 10);
+	out[0] = res;
+	if (res == FR_OK) {
+		ST_DWORD(out + 1, info.fsize);
+		ST_WORD(out + 5, info.fdate);
+		ST_WORD(out + 7, info.ftime);
+		out[9] = info.fattrib;
+	}
+	download_seal(DL_STAT, seq, 10);
+}
+
+static void download_read(uint16_t seq, const uint8_t *req, uint16_t len){
+	uint8_t *out = download_out();
+	DWORD offset, length;
+	FRESULT res;
+
+	if (len < 9) {
+		download_error(seq, DL_E_REQUEST);
+		return;
+	}
+	offset = LD_DWORD(req);
+	length = LD_DWORD(req + 4);
+
+	logbuf_flush();
+	res = f_open(&file, (const char *)req + 8, FA_READ);
+	if (res != FR_OK) {
+		download_error(seq, res);
+		return;
+	}
+	if (offset > file.fsize) {
+		f_close(&file);
+		download_error(seq, DL_E_RANGE);
+		return;
+	}
+	/* Longer files take several reads */
+	if (length > file.fsize - offset) {
+		length = file.fsize - offset;
+	}
+	if (length > 0xFFFFUL * DL_DATA_SIZE) {
+		length = 0xFFFFUL * DL_DATA_SIZE;
+	}
+
+	read_offset = offset;
+	read_length = length;
+	frames = (length + DL_DATA_SIZE - 1) / DL_DATA_SIZE;
+	base = next = 0;
+	resend = 0;
+	progress_at = tick_1khz();
+	reading = (frames != 0);
+	if (reading == FALSE) {
+		f_close(&file);
+	}
+
+	out[0] = FR_OK;
+	ST_DWORD(out + 1, length);
+	ST_WORD(out + 5, frames);
+	download_seal(DL_READ, seq, 7);
+}
+
+static void download_request(void){
+	uint8_t type = rx[DL_HDR_TYPE];
+	uint16_t seq = LD_WORD(rx + DL_HDR_SEQ);
+	uint16_t len = LD_WORD(rx + DL_HDR_LEN);
+	uint8_t *req = rx + DL_HDR_SIZE;
+
+	if (active == FALSE && type != DL_HELLO) {
+		return;
+	}
+	heard_at = tick_1khz();
+	if (type == DL_ACK) {
+		if (reading && len >= 7) {
+			download_ack(req);
+		}
+		return;
+	}
+
+	/* Any other request ends the transfer */
+	download_stats.requests++;
+	download_stop();
+	req[len] = '\0';
+
+	switch (type) {
+	case DL_HELLO:
+		download_hello(seq, req, len);
+		break;
+	case DL_LIST:
+		download_list(seq, req, len);
+		break;
+	case DL_STAT:
+		download_stat(seq, req);
+		break;
+	case DL_READ:
+		download_read(seq, req, len);
+		break;
+	case DL_BYE:
+		download_seal(DL_BYE, seq, 0);
+		closing = TRUE;
+		break;
+	default:
+		download_error(seq, DL_E_REQUEST);
+		break;
+	}
+}
+
+void download_Init(void){
+	active = FALSE;
+	reading = FALSE;
+	prepared = FALSE;
+	closing = FALSE;
+	new_baud = 0;
+	baud = DL_BAUD;
+	rx_len = 0;
+}
+
+bool download_active(void){
+	return active;
+}
+
+/* Serve the requests, called from the main loop as often as possible */
+void download_Mgmt(void){
+	uint8_t c;
+
+	download_send();
+
+	/* The rate changes and the session ends once the reply is out */
+	if ((new_baud || closing) && prepared == FALSE && USART1_Frame_Busy() == FALSE) {
+		if (closing) {
+			download_end();
+		} else {
+			baud = new_baud;
+			new_baud = 0;
+			USART1_Set_Baud(baud);
+		}
+	}
+
+	/* A reply waiting for the line holds the next request back */
+	while ((prepared == FALSE || reading) && USART1_Read_Char(&c)) {
+		if (download_rx(c)) {
+			download_request();
+		}
+	}
+
+	if (active && closing == FALSE && expire_timer(heard_at, DL_IDLE_TIMEOUT)) {
+		download_end();
+		return;
+	}
+	if (reading) {
+		download_read_Mgmt();
+	}
+	download_send();
+}
@@ -17,9 +17,11 @@ uint16_t DataVar = 0;
 *--------------------------------------------------*/
 uint16_t VirtAddVarTab[NumbOfVar] = {
   RF1_OFFSET_L, RF1_OFFSET_H, CALIBRATED
+  /* GPSSTAT_EE_BASE onwards, filled by EE_Init() */
 };
 
 static FLASH_Status EE_Format(void);
+static FLASH_Status EE_ErasePageIfUsed(uint32_t Address);
 static uint16_t EE_FindValidPage(uint8_t Operation);
 static uint16_t EE_VerifyPageFullWriteVariable(uint16_t VirtAddress, 
 					       uint16_t Data);
@@ -227,6 +229,10 @@ uint16_t EE_Init(void)
 
   FLASH_Unlock();
 
+  for (VarIdx = 0; VarIdx < GPSSTAT_EE_SIZE; VarIdx++) {
+    VirtAddVarTab[3 + VarIdx] = GPSSTAT_EE_BASE + VarIdx;
+  } /* for (VarIdx = 0; VarIdx < GPSSTAT_EE_SIZE; VarIdx++) */
+
   /* Get Page0 status */
   PageStatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
   /* Get Page1 status */
@@ -240,7 +246,7 @@ uint16_t EE_Init(void)
     if (PageStatus1 == VALID_PAGE) {
 
       /* Erase Page0 */
-      FlashStatus = FLASH_ErasePage(PAGE0_BASE_ADDRESS);
+      FlashStatus = EE_ErasePageIfUsed(PAGE0_BASE_ADDRESS);
       /* If erase operation was failed, a Flash error code is returned */
       if (FlashStatus != FLASH_COMPLETE) {
 	goto ee_init_exit;
@@ -390,7 +396,7 @@ uint16_t EE_Init(void)
       if (PageStatus1 == ERASED) {
 
         /* Erase Page1 */
-        FlashStatus = FLASH_ErasePage(PAGE1_BASE_ADDRESS);
+        FlashStatus = EE_ErasePageIfUsed(PAGE1_BASE_ADDRESS);
 
         /* If erase operation was failed, a Flash error code is returned */
         if (FlashStatus != FLASH_COMPLETE) {
@@ -559,6 +565,25 @@ static uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data)
   return Status;
 }
 
+/*
+ * Erases a page unless it is blank: EE_Init() runs at every reset, each
+ * wake from standby included, the spare page is only worn by transfers
+ * param  Address: page base address
+ * retval : FLASH_COMPLETE or the erase status
+ */
+static FLASH_Status EE_ErasePageIfUsed(uint32_t Address)
+{
+  uint32_t i;
+
+  for (i = 0; i < PAGE_SIZE; i += 4) {
+    if ((*(__IO uint32_t*)(Address + i)) != 0xFFFFFFFF) {
+      return FLASH_ErasePage(Address);
+    } /* if ((*(__IO uint32_t*)(Address + i)) != 0xFFFFFFFF) */
+  } /* for (i = 0; i < PAGE_SIZE; i += 4) */
+
+  return FLASH_COMPLETE;
+}
+
 /*
  * Erases PAGE0 and PAGE1 and writes VALID_PAGE header to PAGE0
  * param  None
@@ -236,6 +236,152 @@ void unlock_fs (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Write back a window sector                                            */
+/*-----------------------------------------------------------------------*/
+#if !_FS_READONLY
+static
+FRESULT write_sect (
+	FATFS *fs,		/* File system object */
+	const BYTE *buf,	/* Sector data */
+	DWORD sect		/* Sector number */
+)
+{
+	if (disk_write(fs->drive, buf, sect, 1) != RES_OK)
+		return FR_DISK_ERR;
+#if _FS_CACHE
+	fs->cache_write++;
+#endif
+	if (sect < (fs->fatbase + fs->sects_fat)) {	/* In FAT area */
+		BYTE nf;
+		for (nf = fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
+			sect += fs->sects_fat;
+			disk_write(fs->drive, buf, sect, 1);
+		}
+	}
+	return FR_OK;
+}
+#endif
+
+
+
+
+#if _FS_CACHE
+#if _FS_TINY
+#error _FS_CACHE requires _FS_TINY 0
+#endif
+/*-----------------------------------------------------------------------*/
+/* Sector cache under the window                                         */
+/*-----------------------------------------------------------------------*/
+/* A sector is either in win[] or in one cache slot, never in both. The  */
+/* window is parked in the cache when it moves and taken back on a hit.  */
+
+static
+int cache_find (	/* Slot index, -1 if not cached */
+	FATFS *fs,
+	DWORD sect
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FS_CACHE; i++) {
+		if (fs->cache_sect[i] == sect) return i;
+	}
+	return -1;
+}
+
+
+static
+void cache_reset (
+	FATFS *fs
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FS_CACHE; i++) fs->cache_sect[i] = 0;
+	fs->cache_hit = fs->cache_miss = fs->cache_write = 0;
+}
+
+
+static
+FRESULT cache_put (		/* Park the window, evicting the least recently used slot */
+	FATFS *fs
+)
+{
+	int i, v;
+
+
+	v = cache_find(fs, fs->winsect);
+	if (v < 0) {
+		for (i = v = 0; i < _FS_CACHE; i++) {
+			if (!fs->cache_sect[i]) { v = i; break; }	/* Empty slot */
+			if (fs->cache_clock - fs->cache_use[i] > fs->cache_clock - fs->cache_use[v]) v = i;
+		}
+#if !_FS_READONLY
+		if (fs->cache_sect[v] && fs->cache_dirty[v]) {
+			if (write_sect(fs, fs->cache[v], fs->cache_sect[v]) != FR_OK)
+				return FR_DISK_ERR;
+		}
+#endif
+	}
+	mem_cpy(fs->cache[v], fs->win, SS(fs));
+	fs->cache_sect[v] = fs->winsect;
+	fs->cache_dirty[v] = fs->wflag;
+	fs->cache_use[v] = ++fs->cache_clock;
+	fs->wflag = 0;
+
+	return FR_OK;
+}
+
+
+static
+BOOL cache_get (		/* Move a cached sector into the window */
+	FATFS *fs,
+	DWORD sect
+)
+{
+	int i;
+
+
+	i = cache_find(fs, sect);
+	if (i < 0) {
+		fs->cache_miss++;
+		return FALSE;
+	}
+	mem_cpy(fs->win, fs->cache[i], SS(fs));
+	fs->wflag = fs->cache_dirty[i];
+	fs->cache_sect[i] = 0;
+	fs->cache_hit++;
+	return TRUE;
+}
+
+
+#if !_FS_READONLY
+static
+FRESULT cache_flush (	/* Write back all dirty slots */
+	FATFS *fs
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FS_CACHE; i++) {
+		if (fs->cache_sect[i] && fs->cache_dirty[i]) {
+			if (write_sect(fs, fs->cache[i], fs->cache_sect[i]) != FR_OK)
+				return FR_DISK_ERR;
+			fs->cache_dirty[i] = 0;
+		}
+	}
+	return FR_OK;
+}
+#endif
+#endif /* _FS_CACHE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Change window offset                                                  */
 /*-----------------------------------------------------------------------*/
@@ -244,33 +390,48 @@ static
 FRESULT move_window (
 	FATFS *fs,		/* File system object */
 	DWORD sector	/* Sector number to make appearance in the fs->win[] */
-)					/* Move to zero only writes back dirty window */
+)					/* Move to zero only writes back dirty window (and cache) */
 {
 	DWORD wsect;
+#if _FS_CACHE
+	int i;
+#endif
 
 
 	wsect = fs->winsect;
+#if _FS_CACHE
+	if (wsect && sector && wsect != sector) {	/* Park the window, dirty or not */
+		if (cache_put(fs) != FR_OK)
+			return FR_DISK_ERR;
+	}
+#endif
 	if (wsect != sector) {	/* Changed current window */
 #if !_FS_READONLY
 		if (fs->wflag) {	/* Write back dirty window if needed */
-			if (disk_write(fs->drive, fs->win, wsect, 1) != RES_OK)
+			if (write_sect(fs, fs->win, wsect) != FR_OK)
 				return FR_DISK_ERR;
 			fs->wflag = 0;
-			if (wsect < (fs->fatbase + fs->sects_fat)) {	/* In FAT area */
-				BYTE nf;
-				for (nf = fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
-					wsect += fs->sects_fat;
-					disk_write(fs->drive, fs->win, wsect, 1);
-				}
-			}
+#if _FS_CACHE
+			i = cache_find(fs, wsect);			/* Drop a stale copy of the rewritten sector */
+			if (i >= 0) fs->cache_sect[i] = 0;
+#endif
 		}
 #endif
 		if (sector) {
-			if (disk_read(fs->drive, fs->win, sector, 1) != RES_OK)
+#if _FS_CACHE
+			if (!cache_get(fs, sector))
+#endif
+			if (disk_read(fs->drive, fs->win, sector, 1) != RES_OK) {
+				fs->winsect = 0;	/* The window holds no valid sector */
 				return FR_DISK_ERR;
+			}
 			fs->winsect = sector;
 		}
 	}
+#if _FS_CACHE && !_FS_READONLY
+	if (!sector && cache_flush(fs) != FR_OK)
+		return FR_DISK_ERR;
+#endif
 
 	return FR_OK;
 }
@@ -420,6 +581,66 @@ FRESULT put_fat (
 
 
 
+#if _FS_FREEMAP && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Free cluster hint                                                     */
+/*-----------------------------------------------------------------------*/
+/* freemap[] bit n covers clusters n*freemap_span to (n+1)*freemap_span-1 */
+/* and is cleared only after a scan saw all of them allocated, so a      */
+/* cleared bit is always right and a set one means "maybe free".         */
+
+static
+void freemap_init (
+	FATFS *fs
+)
+{
+	DWORD epsec, span;
+
+
+	mem_set(fs->freemap, 0xFF, _FS_FREEMAP);
+	span = (fs->max_clust + _FS_FREEMAP * 8 - 1) / (_FS_FREEMAP * 8);
+	if (fs->fs_type != FS_FAT12) {		/* Round up to whole FAT sectors */
+		epsec = SS(fs) / ((fs->fs_type == FS_FAT16) ? 2 : 4);
+		span = (span + epsec - 1) / epsec * epsec;
+	}
+	fs->freemap_span = span;
+}
+
+
+static
+DWORD freemap_skip (	/* Last cluster of the group of clst if it is full, else 0 */
+	FATFS *fs,
+	DWORD clst
+)
+{
+	DWORD g = clst / fs->freemap_span;
+
+
+	if (fs->freemap[g / 8] & (1 << (g % 8))) return 0;
+	return (g + 1) * fs->freemap_span - 1;
+}
+
+
+static
+void freemap_mark (
+	FATFS *fs,
+	DWORD clst,			/* Any cluster of the group */
+	BYTE full			/* 1: group seen all allocated, 0: a cluster freed */
+)
+{
+	DWORD g = clst / fs->freemap_span;
+
+
+	if (full)
+		fs->freemap[g / 8] &= ~(1 << (g % 8));
+	else
+		fs->freemap[g / 8] |= 1 << (g % 8);
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Remove a cluster chain                                 */
 /*-----------------------------------------------------------------------*/
@@ -446,6 +667,9 @@ FRESULT remove_chain (
 			if (nxt == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }	/* Disk error? */
 			res = put_fat(fs, clst, 0);			/* Mark the cluster "empty" */
 			if (res != FR_OK) break;
+#if _FS_FREEMAP
+			freemap_mark(fs, clst, 0);
+#endif
 			if (fs->free_clust != 0xFFFFFFFF) {	/* Update FSInfo */
 				fs->free_clust++;
 				fs->fsi_flag = 1;
@@ -472,6 +696,10 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 )
 {
 	DWORD cs, ncl, scl, mcl;
+#if _FS_FREEMAP
+	DWORD gl;
+	BYTE whole = 0;		/* Current group scanned from its start */
+#endif
 
 
 	mcl = fs->max_clust;
@@ -493,10 +721,25 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free cluster */
 		}
+#if _FS_FREEMAP
+		gl = freemap_skip(fs, ncl);
+		if (gl) {						/* Group known full, skip it */
+			if (scl >= ncl && scl <= gl) return 0;	/* Back to the start: no free cluster */
+			ncl = gl;
+			continue;
+		}
+		if (ncl % fs->freemap_span == 0 || ncl == 2) whole = 1;
+#endif
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occurred */
 			return cs;
+#if _FS_FREEMAP
+		if (whole && (ncl % fs->freemap_span == fs->freemap_span - 1 || ncl == mcl - 1)) {
+			freemap_mark(fs, ncl, 1);	/* Scanned all of the group, nothing free */
+			whole = 0;
+		}
+#endif
 		if (ncl == scl) return 0;		/* No free cluster */
 	}
 
@@ -538,6 +781,77 @@ DWORD clust2sect (	/* !=0: Sector number, 0: Failed - invalid cluster# */
 
 
 
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Fast seek - Get cluster# from the cluster link map table              */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD clmt_clust (	/* 0: Not in the table, >=2: Cluster# */
+	FIL *fp,		/* File object with a cluster link map table */
+	DWORD ofs		/* File offset to be converted to cluster# */
+)
+{
+	DWORD cl, ncl, *tbl;
+
+
+	tbl = fp->cltbl + 1;						/* Top of the table */
+	cl = ofs / SS(fp->fs) / fp->fs->csize;		/* Cluster order from top of the file */
+	for (;;) {
+		ncl = *tbl++;							/* Number of clusters in the fragment */
+		if (!ncl) return 0;						/* End of table */
+		if (cl < ncl) break;					/* In this fragment? */
+		cl -= ncl; tbl++;						/* Next fragment */
+	}
+	return cl + *tbl;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Fast seek - Build the cluster link map table                          */
+/*-----------------------------------------------------------------------*/
+/* cltbl[0] is the table size in items on entry and the number of items */
+/* needed on return. Each fragment takes a length and a start cluster,   */
+/* the table ends with a zero length.                                    */
+
+static
+FRESULT create_linkmap (
+	FIL *fp			/* File object with a cluster link map table */
+)
+{
+	DWORD *tbl, tlen, ulen, cl, pcl, tcl, ncl;
+
+
+	tbl = fp->cltbl;
+	tlen = *tbl++; ulen = 2;					/* Given and needed table size */
+	cl = fp->org_clust;
+	if (cl) {
+		do {
+			tcl = cl; ncl = 0; ulen += 2;		/* Top and length of a fragment */
+			do {
+				pcl = cl; ncl++;
+				cl = get_fat(fp->fs, cl);
+				if (cl <= 1) return FR_INT_ERR;
+				if (cl == 0xFFFFFFFF) return FR_DISK_ERR;
+			} while (cl == pcl + 1);
+			if (ulen <= tlen) {
+				*tbl++ = ncl; *tbl++ = tcl;
+			}
+		} while (cl < fp->fs->max_clust);		/* Until the end of the chain */
+	}
+	*fp->cltbl = ulen;
+	if (ulen > tlen) return FR_NOT_ENOUGH_CORE;
+	*tbl = 0;									/* Terminate the table */
+
+	return FR_OK;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Seek directory index                             */
 /*-----------------------------------------------------------------------*/
@@ -1374,6 +1688,98 @@ void get_fileinfo (		/* No return code */
 
 
 
+#if _FS_DIRCACHE
+/*-----------------------------------------------------------------------*/
+/* Directory entry cache                                                 */
+/*-----------------------------------------------------------------------*/
+/* Keyed by the FNV-1a hash of the path as given to f_open(), a path     */
+/* spelled another way is only a miss. Only files are cached. A relative */
+/* path names another entry after f_chdir(), which empties the cache.    */
+
+#define dcache_reset(fs)	mem_set((fs)->dcache, 0, sizeof((fs)->dcache))
+
+static
+DWORD dcache_hash (
+	const XCHAR *path
+)
+{
+	DWORD h = 0x811C9DC5;
+
+
+	while ((UINT)*path >= ' ') {
+		h ^= (UINT)*path++;
+		h *= 0x01000193;
+	}
+	return h ? h : 1;	/* 0 marks an empty item */
+}
+
+
+static
+DIRCACHE* dcache_find (	/* Item moved to the front, NULL if not cached */
+	FATFS *fs,
+	DWORD hash
+)
+{
+	DIRCACHE dc;
+	int i;
+
+
+	for (i = 0; i < _FS_DIRCACHE && fs->dcache[i].hash != hash; i++) ;
+	if (i == _FS_DIRCACHE) return NULL;
+	if (i) {
+		dc = fs->dcache[i];
+		for ( ; i; i--) fs->dcache[i] = fs->dcache[i - 1];
+		fs->dcache[0] = dc;
+	}
+	fs->dcache_hit++;
+	return &fs->dcache[0];
+}
+
+
+static
+void dcache_put (
+	FATFS *fs,
+	DWORD hash,
+	const BYTE *dir		/* Directory entry in the window */
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FS_DIRCACHE - 1 && fs->dcache[i].hash != hash; i++) ;
+	for ( ; i; i--) fs->dcache[i] = fs->dcache[i - 1];	/* Drop the last or the old item */
+	fs->dcache[0].hash = hash;
+	fs->dcache[0].sect = fs->winsect;
+	fs->dcache[0].ofs = (BYTE)((dir - fs->win) / 32);
+	fs->dcache[0].sclust = ((DWORD)LD_WORD(dir+DIR_FstClusHI) << 16) | LD_WORD(dir+DIR_FstClusLO);
+	fs->dcache[0].fsize = LD_DWORD(dir+DIR_FileSize);
+	fs->dcache[0].attr = dir[DIR_Attr];
+}
+
+
+static
+void dcache_update (	/* Refresh the items of an entry changed in the window */
+	FATFS *fs,
+	const BYTE *dir
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FS_DIRCACHE; i++) {
+		if (fs->dcache[i].hash && fs->dcache[i].sect == fs->winsect
+			&& fs->dcache[i].ofs == (dir - fs->win) / 32) {
+			fs->dcache[i].sclust = ((DWORD)LD_WORD(dir+DIR_FstClusHI) << 16) | LD_WORD(dir+DIR_FstClusLO);
+			fs->dcache[i].fsize = LD_DWORD(dir+DIR_FileSize);
+			fs->dcache[i].attr = dir[DIR_Attr];
+		}
+	}
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Follow a file path                                                    */
 /*-----------------------------------------------------------------------*/
@@ -1509,6 +1915,9 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 	/* The logical drive must be mounted. Following code attempts to mount the volume */
 
 	fs->fs_type = 0;					/* Clear the file system object */
+#if _FS_CACHE
+	cache_reset(fs);					/* Drop the sectors of the previous volume */
+#endif
 	fs->drive = (BYTE)LD2PD(vol);		/* Bind the logical drive and a physical drive */
 	stat = disk_initialize(fs->drive);	/* Initialize low level disk I/O layer */
 	if (stat & STA_NOINIT)				/* Check if the drive is ready */
@@ -1563,6 +1972,7 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 #if !_FS_READONLY
 	/* Initialize allocation information */
 	fs->free_clust = 0xFFFFFFFF;
+	fs->last_clust = 0;			/* No allocation hint without FSInfo */
 	fs->wflag = 0;
 	/* Get fsinfo if needed */
 	if (fmt == FS_FAT32) {
@@ -1578,6 +1988,13 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 	}
 #endif
 	fs->fs_type = fmt;		/* FAT sub-type */
+#if _FS_FREEMAP && !_FS_READONLY
+	freemap_init(fs);
+#endif
+#if _FS_DIRCACHE
+	dcache_reset(fs);
+	fs->dcache_hit = 0;
+#endif
 	fs->winsect = 0;		/* Invalidate sector cache */
 #if _FS_RPATH
 	fs->cdir = 0;			/* Current directory (root dir) */
@@ -1673,6 +2090,10 @@ FRESULT f_open (
 	DIR dj;
 	NAMEBUF(sfn, lfn);
 	BYTE *dir;
+#if _FS_DIRCACHE
+	DWORD hash;
+	DIRCACHE *dc;
+#endif
 
 
 	fp->fs = NULL;		/* Clear file object */
@@ -1684,6 +2105,31 @@ FRESULT f_open (
 	res = chk_mounted(&path, &dj.fs, 0);
 #endif
 	if (res != FR_OK) LEAVE_FF(dj.fs, res);
+#if _FS_DIRCACHE
+	hash = dcache_hash(path);
+	dc = (mode & (FA_CREATE_ALWAYS | FA_CREATE_NEW)) ? NULL : dcache_find(dj.fs, hash);
+	if (dc) {							/* Open an existing file without the directory */
+#if !_FS_READONLY
+		if ((mode & FA_WRITE) && (dc->attr & AM_RDO)) /* R/O violation */
+			LEAVE_FF(dj.fs, FR_DENIED);
+		fp->dir_sect = dc->sect;
+		fp->dir_ptr = dj.fs->win + dc->ofs * 32;
+#endif
+		fp->flag = mode;
+		fp->org_clust = dc->sclust;
+		fp->fsize = dc->fsize;
+		fp->fptr = 0; fp->csect = 255;
+		fp->dsect = 0;
+#if _USE_EXPAND
+		fp->cont_clust = 0;
+#endif
+#if _USE_FASTSEEK
+		fp->cltbl = 0;
+#endif
+		fp->fs = dj.fs; fp->id = dj.fs->id;
+		LEAVE_FF(dj.fs, FR_OK);
+	}
+#endif
 	INITBUF(dj, sfn, lfn);
 	res = follow_path(&dj, path);	/* Follow the file path */
 
@@ -1749,7 +2195,16 @@ FRESULT f_open (
 	fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 	fp->fptr = 0; fp->csect = 255;		/* File pointer */
 	fp->dsect = 0;
+#if _USE_EXPAND
+	fp->cont_clust = 0;
+#endif
+#if _USE_FASTSEEK
+	fp->cltbl = 0;
+#endif
 	fp->fs = dj.fs; fp->id = dj.fs->id;	/* Owner file system object of the file */
+#if _FS_DIRCACHE
+	dcache_put(dj.fs, hash, dir);
+#endif
 
 	LEAVE_FF(dj.fs, FR_OK);
 }
@@ -1789,8 +2244,18 @@ FRESULT f_read (
 		rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
-				clst = (fp->fptr == 0) ?			/* On the top of the file? */
-					fp->org_clust : get_fat(fp->fs, fp->curr_clust);
+				if (fp->fptr == 0)					/* On the top of the file? */
+					clst = fp->org_clust;
+#if _USE_FASTSEEK
+				else if (fp->cltbl && (clst = clmt_clust(fp, fp->fptr)) != 0)
+					;								/* Found in the cluster link map */
+#endif
+#if _USE_EXPAND
+				else if (fp->curr_clust >= fp->cont_org && fp->curr_clust < fp->cont_clust)	/* Inside the contiguous block? */
+					clst = fp->curr_clust + 1;
+#endif
+				else
+					clst = get_fat(fp->fs, fp->curr_clust);
 				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 				fp->curr_clust = clst;				/* Update current cluster */
@@ -1888,6 +2353,16 @@ FRESULT f_write (
 					if (clst == 0)					/* When there is no cluster chain, */
 						fp->org_clust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
 				} else {							/* Middle or end of the file */
+#if _USE_FASTSEEK
+					if (fp->cltbl && (clst = clmt_clust(fp, fp->fptr)) != 0)
+						;							/* Found in the cluster link map */
+					else
+#endif
+#if _USE_EXPAND
+					if (fp->curr_clust >= fp->cont_org && fp->curr_clust < fp->cont_clust)	/* Inside the contiguous block, no FAT access */
+						clst = fp->curr_clust + 1;
+					else
+#endif
 					clst = create_chain(fp->fs, fp->curr_clust);			/* Follow or stretch cluster chain */
 				}
 				if (clst == 0) break;				/* Could not allocate a new cluster (disk full) */
@@ -2000,6 +2475,9 @@ FRESULT f_sync (
 				ST_WORD(dir+DIR_FstClusHI, fp->org_clust >> 16);
 				tim = get_fattime();			/* Updated time */
 				ST_DWORD(dir+DIR_WrtTime, tim);
+#if _FS_DIRCACHE
+				dcache_update(fp->fs, dir);
+#endif
 				fp->flag &= ~FA__WRITTEN;
 				fp->fs->wflag = 1;
 				res = sync(fp->fs);
@@ -2015,6 +2493,55 @@ FRESULT f_sync (
 
 
 
+#if _USE_EXPAND && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Release the clusters of the contiguous block past the file size       */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT trim_chain (
+	FIL *fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	DWORD bcs, lcl, ncl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+
+	bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
+	if (fp->fsize == 0) {					/* Nothing written, remove the entire chain */
+		res = remove_chain(fp->fs, fp->org_clust);
+		fp->org_clust = 0;
+	} else if (fp->fsize <= fp->cont_ofs) {	/* Nothing written into the appended block, remove it */
+		lcl = fp->org_clust;				/* Find the cluster it is linked from */
+		while (res == FR_OK && (ncl = get_fat(fp->fs, lcl)) != fp->cont_org) {
+			if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
+			else if (ncl < 2 || ncl >= fp->fs->max_clust) res = FR_INT_ERR;
+			else lcl = ncl;
+		}
+		if (res == FR_OK) res = put_fat(fp->fs, lcl, 0x0FFFFFFF);
+		if (res == FR_OK) res = remove_chain(fp->fs, fp->cont_org);
+	} else if ((fp->fsize - fp->cont_ofs - 1) / bcs < fp->cont_clust - fp->cont_org) {
+		lcl = fp->cont_org + (fp->fsize - fp->cont_ofs - 1) / bcs;	/* Last cluster holding data */
+		res = put_fat(fp->fs, lcl, 0x0FFFFFFF);
+		if (res == FR_OK) res = remove_chain(fp->fs, lcl + 1);
+	}
+	fp->cont_clust = 0;
+#if _USE_FASTSEEK
+	fp->cltbl = 0;
+#endif
+	fp->flag |= FA__WRITTEN;
+	if (res != FR_OK) fp->flag |= FA__ERROR;
+
+	LEAVE_FF(fp->fs, res);
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Close File                                                            */
 /*-----------------------------------------------------------------------*/
@@ -2034,6 +2561,12 @@ FRESULT f_close (
 	LEAVE_FF(fs, res); /* Patch for FatFs R0.07e Jan 15, 2010 */
 #else
 	res = f_sync(fp);
+#if _USE_EXPAND
+	if (res == FR_OK && fp->cont_clust) {	/* Give back the unused part of the contiguous block */
+		res = trim_chain(fp);
+		if (res == FR_OK) res = f_sync(fp);
+	}
+#endif
 	if (res == FR_OK) fp->fs = NULL;
 	return res;
 #endif
@@ -2086,6 +2619,9 @@ FRESULT f_chdir (
 				else
 					res = FR_NO_PATH;		/* Could not reach the dir (it is a file) */
 			}
+#if _FS_DIRCACHE
+			if (res == FR_OK) dcache_reset(dj.fs);	/* Relative paths are keyed to the old directory */
+#endif
 		}
 		if (res == FR_NO_FILE) res = FR_NO_PATH;
 	}
@@ -2109,12 +2645,21 @@ FRESULT f_lseek (
 {
 	FRESULT res;
 	DWORD clst, bcs, nsect, ifptr;
+#if _USE_EXPAND
+	DWORD ncl;
+#endif
 
 
 	res = validate(fp->fs, fp->id);		/* Check validity of the object */
 	if (res != FR_OK) LEAVE_FF(fp->fs, res);
 	if (fp->flag & FA__ERROR)			/* Check abort flag */
 		LEAVE_FF(fp->fs, FR_INT_ERR);
+#if _USE_FASTSEEK
+	if (fp->cltbl && ofs == CREATE_LINKMAP) {	/* Build the cluster link map table */
+		res = create_linkmap(fp);
+		LEAVE_FF(fp->fs, res);
+	}
+#endif
 	if (ofs > fp->fsize					/* In read-only mode, clip offset with the file size */
 #if !_FS_READONLY
 		 && !(fp->flag & FA_WRITE)
@@ -2123,6 +2668,22 @@ FRESULT f_lseek (
 
 	ifptr = fp->fptr;
 	fp->fptr = nsect = 0; fp->csect = 255;
+#if _USE_FASTSEEK
+	if (fp->cltbl && ofs > 0					/* Past the file size only in write mode, into clusters already in the chain */
+		&& (clst = clmt_clust(fp, ofs - 1)) != 0) {	/* Fast seek with the cluster link map */
+		bcs = (DWORD)fp->fs->csize * SS(fp->fs);
+		fp->curr_clust = clst;
+		fp->fptr = ofs;
+		ofs -= (ofs - 1) / bcs * bcs;			/* Offset in the cluster (1..bcs) */
+		fp->csect = (BYTE)(ofs / SS(fp->fs));
+		if (ofs % SS(fp->fs)) {
+			nsect = clust2sect(fp->fs, clst);
+			if (!nsect) ABORT(fp->fs, FR_INT_ERR);
+			nsect += fp->csect;
+			fp->csect++;
+		}
+	} else
+#endif
 	if (ofs > 0) {
 		bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
 		if (ifptr > 0 &&
@@ -2143,6 +2704,16 @@ FRESULT f_lseek (
 			fp->curr_clust = clst;
 		}
 		if (clst != 0) {
+#if _USE_EXPAND
+			if (clst >= fp->cont_org && clst < fp->cont_clust) {	/* Jump inside the contiguous block */
+				ncl = (ofs - 1) / bcs;
+				if (ncl > fp->cont_clust - clst) ncl = fp->cont_clust - clst;
+				clst += ncl;
+				fp->curr_clust = clst;
+				fp->fptr += ncl * bcs;
+				ofs -= ncl * bcs;
+			}
+#endif
 			while (ofs > bcs) {						/* Cluster following loop */
 #if !_FS_READONLY
 				if (fp->flag & FA_WRITE) {			/* Check if in write mode or not */
@@ -2325,6 +2896,9 @@ FRESULT f_getfree (
 	DWORD n, clst, sect, stat;
 	UINT i;
 	BYTE fat, *p;
+#if _FS_FREEMAP && !_FS_READONLY
+	DWORD e, gfree = 0;
+#endif
 
 
 	/* Get drive number */
@@ -2360,6 +2934,10 @@ FRESULT f_getfree (
 				p = (*fatfs)->win;
 				i = SS(*fatfs);
 			}
+#if _FS_FREEMAP && !_FS_READONLY
+			e = (*fatfs)->max_clust - clst;		/* Cluster# of the entry */
+			if (e % (*fatfs)->freemap_span == 0) gfree = n;
+#endif
 			if (fat == FS_FAT16) {
 				if (LD_WORD(p) == 0) n++;
 				p += 2; i -= 2;
@@ -2367,6 +2945,10 @@ FRESULT f_getfree (
 				if ((LD_DWORD(p) & 0x0FFFFFFF) == 0) n++;
 				p += 4; i -= 4;
 			}
+#if _FS_FREEMAP && !_FS_READONLY
+			if (e % (*fatfs)->freemap_span == (*fatfs)->freemap_span - 1 || clst == 1)
+				freemap_mark(*fatfs, e, n == gfree);	/* Refresh the hint of the group */
+#endif
 		} while (--clst);
 	}
 	(*fatfs)->free_clust = n;
@@ -2414,6 +2996,15 @@ FRESULT f_truncate (
 				if (res == FR_OK) res = remove_chain(fp->fs, ncl);
 			}
 		}
+#if _USE_EXPAND
+		if (fp->fptr <= fp->cont_ofs)	/* The block ends where the chain now ends, or is gone */
+			fp->cont_clust = 0;
+		else if (fp->cont_clust > fp->curr_clust)
+			fp->cont_clust = fp->curr_clust;
+#endif
+#if _USE_FASTSEEK
+		fp->cltbl = 0;			/* The map may point to removed clusters */
+#endif
 	}
 	if (res != FR_OK) fp->flag |= FA__ERROR;
 
@@ -2423,6 +3014,174 @@ FRESULT f_truncate (
 
 
 
+#if _USE_EXPAND && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Append a Contiguous Block to the Cluster Chain of a File              */
+/*-----------------------------------------------------------------------*/
+/* The file size is left as it is. Writes go into the block without any  */
+/* FAT access and f_close() gives back the clusters past the file size. */
+/* A file reopened after that gets a new block after its last cluster.  */
+
+FRESULT f_expand (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes to allocate */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, ncl, scl, tcl, rcl, lcl, ofs, n, stat;
+#if _FS_FREEMAP
+	DWORD gl;
+#endif
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE))			/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	if (fp->cont_clust || !fsz)			/* One block at a time */
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	fs = fp->fs;
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+	ncl = fsz / bcs + ((fsz % bcs) ? 1 : 0);	/* Number of clusters */
+
+	/* Last cluster of the chain and file offset past it */
+	lcl = fp->org_clust; ofs = 0;
+	while (lcl) {
+		ofs += bcs;
+		stat = get_fat(fs, lcl);
+		if (stat == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (stat < 2) LEAVE_FF(fs, FR_INT_ERR);
+		if (stat >= fs->max_clust) break;
+		lcl = stat;
+	}
+
+	/* First free run of ncl clusters, searched from the allocation hint */
+	scl = fs->last_clust + 1;
+	if (scl < 2 || scl >= fs->max_clust) scl = 2;
+	tcl = scl; rcl = 0; n = 0;
+	for (;;) {
+#if _FS_FREEMAP
+		gl = freemap_skip(fs, tcl);
+		if (gl) {						/* Group known full, the run restarts after it */
+			if (scl > tcl && scl <= gl) LEAVE_FF(fs, FR_DENIED);	/* Back to the start */
+			n = 0;
+			tcl = gl;
+			if (++tcl >= fs->max_clust) tcl = 2;
+			if (tcl == scl) LEAVE_FF(fs, FR_DENIED);
+			continue;
+		}
+#endif
+		stat = get_fat(fs, tcl);
+		if (stat == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (stat == 1) LEAVE_FF(fs, FR_INT_ERR);
+		if (stat == 0) {				/* Free cluster, extend the run */
+			if (n++ == 0) rcl = tcl;
+			if (n == ncl) break;
+		} else {
+			n = 0;
+		}
+		if (++tcl >= fs->max_clust) {	/* Wrap around, a run cannot span it */
+			tcl = 2; n = 0;
+		}
+		if (tcl == scl) LEAVE_FF(fs, FR_DENIED);	/* No run large enough */
+	}
+
+	/* Link the run */
+	for (tcl = rcl; res == FR_OK && tcl < rcl + ncl - 1; tcl++)
+		res = put_fat(fs, tcl, tcl + 1);
+	if (res == FR_OK) res = put_fat(fs, tcl, 0x0FFFFFFF);
+	if (res == FR_OK && lcl) res = put_fat(fs, lcl, rcl);
+	if (res != FR_OK) LEAVE_FF(fs, res);
+
+	fs->last_clust = tcl;				/* Update FSINFO */
+	if (fs->free_clust != 0xFFFFFFFF) {
+		fs->free_clust -= ncl;
+		fs->fsi_flag = 1;
+	}
+
+	if (!lcl) fp->org_clust = rcl;
+	fp->cont_org = rcl;
+	fp->cont_ofs = ofs;
+	fp->cont_clust = tcl;
+#if _USE_FASTSEEK
+	fp->cltbl = 0;						/* The map ends before the block */
+#endif
+	fp->flag |= FA__WRITTEN;			/* Start cluster goes to the directory entry at sync */
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Sector at the File Pointer inside the Contiguous Block                */
+/*-----------------------------------------------------------------------*/
+/* 0 unless the file pointer is sector aligned and the next count sectors */
+/* are inside the block, or inside one fragment of the cluster link map, */
+/* so they can be written around the file buffer.                        */
+
+DWORD f_contig_sect (
+	FIL *fp,		/* Pointer to the file object */
+	UINT count		/* Number of sectors */
+)
+{
+	DWORD sect, end;
+
+
+	if (validate(fp->fs, fp->id) != FR_OK) return 0;
+	if ((fp->flag & (FA__ERROR | FA__DIRTY)) || (fp->fptr % SS(fp->fs)) || !count)
+		return 0;
+
+	if (fp->cont_clust && fp->fptr >= fp->cont_ofs) {
+		sect = clust2sect(fp->fs, fp->cont_org) + (fp->fptr - fp->cont_ofs) / SS(fp->fs);
+		end = clust2sect(fp->fs, fp->cont_clust) + fp->fs->csize;
+		if (sect + count > end) return 0;
+		return sect;
+	}
+#if _USE_FASTSEEK
+	sect = f_map_sect(fp, fp->fptr);
+	if (sect && f_map_sect(fp, fp->fptr + (count - 1) * SS(fp->fs)) == sect + count - 1)
+		return sect;
+#endif
+	return 0;
+}
+#endif
+
+
+
+
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Sector of a File Offset from the Cluster Link Map                     */
+/*-----------------------------------------------------------------------*/
+/* The offset may be past the file size as long as the cluster is still */
+/* in the chain, which lets an application look at preallocated space.  */
+
+DWORD f_map_sect (	/* 0: No link map or not mapped, >0: Sector# */
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ofs		/* File offset */
+)
+{
+	DWORD clst;
+
+
+	if (validate(fp->fs, fp->id) != FR_OK) return 0;
+	if (!fp->cltbl || (fp->flag & (FA__ERROR | FA__DIRTY))) return 0;
+
+	clst = clmt_clust(fp, ofs);
+	if (!clst) return 0;
+	return clust2sect(fp->fs, clst) + (ofs / SS(fp->fs) & (fp->fs->csize - 1));
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -2465,6 +3224,9 @@ FRESULT f_unlink (
 		if (res != FR_NO_FILE) LEAVE_FF(dj.fs, res);
 	}
 
+#if _FS_DIRCACHE
+	dcache_reset(dj.fs);
+#endif
 	res = dir_remove(&dj);					/* Remove directory entry */
 	if (res == FR_OK) {
 		if (dclst)
@@ -2586,6 +3348,9 @@ FRESULT f_chmod (
 			} else {						/* File or sub directory */
 				mask &= AM_RDO|AM_HID|AM_SYS|AM_ARC;	/* Valid attribute mask */
 				dir[DIR_Attr] = (value & mask) | (dir[DIR_Attr] & (BYTE)~mask);	/* Apply attribute change */
+#if _FS_DIRCACHE
+				dcache_update(dj.fs, dir);
+#endif
 				dj.fs->wflag = 1;
 				res = sync(dj.fs);
 			}
@@ -2667,6 +3432,9 @@ FRESULT f_rename (
 	if (!dj_old.dir) LEAVE_FF(dj_old.fs, FR_NO_FILE);	/* Is root dir? */
 	mem_cpy(buf, dj_old.dir+DIR_Attr, 21);		/* Save the object information */
 
+#if _FS_DIRCACHE
+	dcache_reset(dj_old.fs);
+#endif
 	mem_cpy(&dj_new, &dj_old, sizeof(DIR));
 	res = follow_path(&dj_new, path_new);		/* Check new object */
 	if (res == FR_OK) res = FR_EXIST;			/* The new object name is already existing */
@@ -2805,6 +3573,12 @@ FRESULT f_mkfs (
 	fs = FatFs[drv];
 	if (!fs) return FR_NOT_ENABLED;
 	fs->fs_type = 0;
+#if _FS_CACHE
+	cache_reset(fs);
+#endif
+#if _FS_DIRCACHE
+	dcache_reset(fs);
+#endif
 	drv = LD2PD(drv);
 
 	/* Get disk statics */
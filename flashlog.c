@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "ff.h"
+#include "crc.h"
+#include "serial_flash.h"
+#include "flashlog.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+/* Restore copies go through a small buffer, the stack is short */
+#define FLASHLOG_CHUNK			64
+
+struct flashlog_stats_s flashlog_stats;
+
+static bool ready = FALSE;
+/* Slots of the store, 0 without a usable chip */
+static uint32_t slots;
+/* Next slot to program, always in an erased sector */
+static uint32_t head;
+/* Oldest entry not drained, next one flashlog_read() looks at */
+static uint32_t tail;
+static uint32_t cursor;
+static uint32_t seq;
+
+/* Found by flashlog_Init(): the entries after drained_seq are restored */
+static uint32_t last_seq;
+static uint32_t last_slot;
+static uint32_t drained_seq;
+static uint32_t pending;
+static uint32_t restored;
+
+static uint32_t flashlog_addr(uint32_t slot){
+	return (slot / FLASHLOG_SLOTS) * SF_SECTOR_SIZE + (slot % FLASHLOG_SLOTS) * FLASHLOG_SLOT_SIZE;
+}
+
+/* Read the header of a slot, -1 when erased or torn */
+static int flashlog_header(uint32_t slot, uint8_t *hdr){
+	serial_flash_read(flashlog_addr(slot), hdr, FLASHLOG_HDR_SIZE);
+	if (LD_WORD(hdr + FLASHLOG_HDR_MAGIC) != FLASHLOG_MAGIC
+			|| LD_WORD(hdr + FLASHLOG_HDR_CRC) != crc16_block(CRC_FEED, hdr, FLASHLOG_HDR_CRC)
+			|| LD_WORD(hdr + FLASHLOG_HDR_FILL) > FLASHLOG_DATA_SIZE) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Find the newest entry and the last marker. Nothing is written here,
+ * the entries to restore wait for their file in flashlog_restore().
+ */
+int flashlog_Init(void){
+	uint8_t hdr[FLASHLOG_HDR_SIZE];
+	uint32_t i, s;
+
+	ready = FALSE;
+	last_seq = last_slot = drained_seq = 0;
+	pending = restored = 0;
+
+	slots = serial_flash_size() / SF_SECTOR_SIZE * FLASHLOG_SLOTS;
+	/* The head sector, the one erased ahead and one to fill at least */
+	if (slots < 3 * FLASHLOG_SLOTS) {
+		slots = 0;
+		return -1;
+	}
+
+	for (i = 0; i < slots; i++) {
+		if (flashlog_header(i, hdr)) {
+			continue;
+		}
+		s = LD_DWORD(hdr + FLASHLOG_HDR_SEQ);
+		if (s >= last_seq) {
+			last_seq = s;
+			last_slot = i;
+		}
+		if (LD_WORD(hdr + FLASHLOG_HDR_FILL) == 0 && LD_DWORD(hdr + FLASHLOG_HDR_FILE) > drained_seq) {
+			drained_seq = LD_DWORD(hdr + FLASHLOG_HDR_FILE);
+		}
+	}
+
+	if (last_seq > drained_seq) {
+		for (i = 0; i < slots; i++) {
+			if (flashlog_header(i, hdr) == 0 && LD_WORD(hdr + FLASHLOG_HDR_FILL)
+					&& LD_DWORD(hdr + FLASHLOG_HDR_SEQ) > drained_seq) {
+				pending++;
+			}
+		}
+	}
+	if (pending) {
+		DEBUGF("Flash log: %d entries to restore.\n", (int)pending);
+	}
+	return 0;
+}
+
+/* Check the data of an entry, then write it at its place in the file */
+static int flashlog_copy(uint32_t slot, const uint8_t *hdr, FIL *file){
+	uint8_t buf[FLASHLOG_CHUNK];
+	uint32_t addr = flashlog_addr(slot) + FLASHLOG_HDR_SIZE;
+	uint16_t fill = LD_WORD(hdr + FLASHLOG_HDR_FILL);
+	uint16_t crc = CRC_FEED, i, n;
+	DWORD ofs = LD_DWORD(hdr + FLASHLOG_HDR_OFS) * FLASHLOG_DATA_SIZE;
+	UINT bw;
+
+	for (i = 0; i < FLASHLOG_DATA_SIZE; i += FLASHLOG_CHUNK) {
+		serial_flash_read(addr + i, buf, FLASHLOG_CHUNK);
+		crc = crc16_block(crc, buf, FLASHLOG_CHUNK);
+	}
+	if (crc != LD_WORD(hdr + FLASHLOG_HDR_DCRC)) {
+		flashlog_stats.crc_errors++;
+		return -1;
+	}
+
+	/* Past the file size this extends it, over clusters already allocated */
+	if (f_lseek(file, ofs) != FR_OK || file->fptr != ofs) {
+		return -2;
+	}
+	for (i = 0; i < fill; i += n) {
+		n = (fill - i < FLASHLOG_CHUNK) ? fill - i : FLASHLOG_CHUNK;
+		serial_flash_read(addr + i, buf, n);
+		if (f_write(file, buf, n, &bw) != FR_OK || bw != n) {
+			return -2;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Copy the entries of the file not drained before the power loss, in
+ * order so a later copy of a sector wins. The file pointer is left at 0.
+ */
+int flashlog_restore(FIL *file){
+	uint8_t hdr[FLASHLOG_HDR_SIZE];
+	uint32_t i, slot;
+	int res = 0;
+
+	if (pending == 0 || file->org_clust == 0) {
+		return 0;
+	}
+
+	/* The oldest slots follow the newest entry */
+	for (i = 1; i <= slots && res == 0; i++) {
+		slot = (last_slot + i) % slots;
+		if (flashlog_header(slot, hdr) || LD_WORD(hdr + FLASHLOG_HDR_FILL) == 0
+				|| LD_DWORD(hdr + FLASHLOG_HDR_SEQ) <= drained_seq
+				|| LD_DWORD(hdr + FLASHLOG_HDR_FILE) != file->org_clust) {
+			continue;
+		}
+		res = flashlog_copy(slot, hdr, file);
+		if (res == -1) {
+			res = 0;
+		} else if (res == 0) {
+			restored++;
+			flashlog_stats.restored++;
+		}
+	}
+
+	if (f_sync(file) != FR_OK) {
+		res = -2;
+	}
+	f_lseek(file, 0);
+	if (res) {
+		DEBUGF("Flash log: restore failed.\n");
+	}
+	return res;
+}
+
+/*
+ * Program the data, then the header that makes the entry valid. The
+ * next flash sector is erased when the head enters a new one.
+ */
+static int flashlog_put(const uint8_t *data, uint16_t fill, DWORD file, DWORD ofs){
+	uint8_t hdr[FLASHLOG_HDR_SIZE];
+	uint32_t addr = flashlog_addr(head);
+	uint32_t next = (head + FLASHLOG_SLOTS) % slots;
+	bool entering = (head % FLASHLOG_SLOTS == 0);
+
+	if (ready == FALSE) {
+		return -2;
+	}
+	if (entering && tail != head && next / FLASHLOG_SLOTS == tail / FLASHLOG_SLOTS) {
+		return -1;
+	}
+
+	ST_WORD(hdr + FLASHLOG_HDR_MAGIC, FLASHLOG_MAGIC);
+	ST_WORD(hdr + FLASHLOG_HDR_FILL, fill);
+	ST_DWORD(hdr + FLASHLOG_HDR_SEQ, seq);
+	ST_DWORD(hdr + FLASHLOG_HDR_FILE, file);
+	ST_DWORD(hdr + FLASHLOG_HDR_OFS, ofs);
+	ST_WORD(hdr + FLASHLOG_HDR_CRC, crc16_block(CRC_FEED, hdr, FLASHLOG_HDR_CRC));
+	ST_WORD(hdr + FLASHLOG_HDR_DCRC, fill ? crc16_block(CRC_FEED, data, FLASHLOG_DATA_SIZE) : CRC_FEED);
+
+	if ((fill && serial_flash_program(addr + FLASHLOG_HDR_SIZE, data, FLASHLOG_DATA_SIZE) != SF_OK)
+			|| serial_flash_program(addr, hdr, FLASHLOG_HDR_SIZE) != SF_OK
+			|| (entering && serial_flash_sector_erase(flashlog_addr(next)) != SF_OK)) {
+		flashlog_stats.errors++;
+		ready = FALSE;
+		DEBUGF("Flash log: program failed, store off.\n");
+		return -2;
+	}
+	head = (head + 1) % slots;
+	seq++;
+	return 0;
+}
+
+/*
+ * Start appending, after the files have been restored: the entries left
+ * are lost. The head moves to a fresh sector and a marker covers all.
+ */
+int flashlog_start(void){
+	if (slots == 0) {
+		return -1;
+	}
+	if (pending > restored) {
+		flashlog_stats.lost += pending - restored;
+		DEBUGF("Flash log: %d entries lost.\n", (int)(pending - restored));
+	}
+	pending = restored = 0;
+
+	head = ((last_slot / FLASHLOG_SLOTS + 1) * FLASHLOG_SLOTS) % slots;
+	tail = cursor = head;
+	seq = last_seq + 1;
+	if (serial_flash_sector_erase(flashlog_addr(head)) != SF_OK) {
+		flashlog_stats.errors++;
+		return -2;
+	}
+	ready = TRUE;
+	return flashlog_drained();
+}
+
+bool flashlog_ready(void){
+	return ready;
+}
+
+/*
+ * Append the sector ofs of the file, fill bytes of it are data. Return
+ * -1 when the store is full and has to be drained first, -2 when the
+ * flash failed.
+ */
+int flashlog_append(const uint8_t *sector, uint16_t fill, FIL *file, DWORD ofs){
+	int res;
+
+	if (fill == 0 || fill > FLASHLOG_DATA_SIZE) {
+		return -2;
+	}
+	res = flashlog_put(sector, fill, file->org_clust, ofs);
+	if (res == 0) {
+		if (fill == FLASHLOG_DATA_SIZE) {
+			flashlog_stats.appends++;
+		} else {
+			flashlog_stats.partials++;
+		}
+	}
+	return res;
+}
+
+/*
+ * Next full sector to drain, the partial copies and the markers are
+ * skipped. Return -1 when there is none, -2 for a damaged one: the
+ * sector is then zero.
+ */
+int flashlog_read(uint8_t *sector){
+	uint8_t hdr[FLASHLOG_HDR_SIZE];
+	uint32_t slot;
+
+	while (cursor != head) {
+		slot = cursor;
+		cursor = (cursor + 1) % slots;
+		if (flashlog_header(slot, hdr) || LD_WORD(hdr + FLASHLOG_HDR_FILL) != FLASHLOG_DATA_SIZE) {
+			continue;
+		}
+		serial_flash_read(flashlog_addr(slot) + FLASHLOG_HDR_SIZE, sector, FLASHLOG_DATA_SIZE);
+		if (crc16_block(CRC_FEED, sector, FLASHLOG_DATA_SIZE) != LD_WORD(hdr + FLASHLOG_HDR_DCRC)) {
+			flashlog_stats.crc_errors++;
+			memset(sector, 0, FLASHLOG_DATA_SIZE);
+			return -2;
+		}
+		flashlog_stats.drained++;
+		return 0;
+	}
+	return -1;
+}
+
+/* The sectors read are on the card */
+void flashlog_release(void){
+	tail = cursor;
+}
+
+/* They are not, read them again */
+void flashlog_rewind(void){
+	cursor = tail;
+}
+
+/* Everything appended is on the card, record it for the next boot */
+int flashlog_drained(void){
+	tail = cursor = head;
+	if (flashlog_put(NULL, 0, seq - 1, 0)) {
+		return -2;
+	}
+	tail = cursor = head;
+	return 0;
+}
+
+/* Percentage of the store holding entries not drained */
+uint8_t flashlog_fill(void){
+	uint32_t used, room;
+
+	if (slots == 0) {
+		return 0;
+	}
+	used = (head + slots - tail) % slots;
+	room = slots - 2 * FLASHLOG_SLOTS;
+	return (used >= room) ? 100 : (uint8_t)(used * 100 / room);
+}
+
+/* Deep power-down once the last program or erase is over */
+void flashlog_idle(void){
+	if (slots && serial_flash_busy() == 0) {
+		serial_flash_sleep();
+	}
+}
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+#include "stm32f10x_bkp.h"
+#include "stm32f10x_pwr.h"
+#include "stm32f10x_rtc.h"
+
+#include "gpsstat.h"
+#include "sim18.h"
+#include "timer.h"
+#include "eeprom.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+/*
+ * The medium density part has BKP_DR1 to DR10 only, all but DR7 taken by
+ * rtc.c and clock_calendar.c: DR7 keeps the hour of the last fix for the
+ * start type guess after a standby. The counters are kept in the flash
+ * EEPROM emulation, GPSSTAT_EE_BASE holds the layout version, then the
+ * TTFF histogram, the fix losses and the mode minutes one half word
+ * each, then the satellite minutes.
+ */
+#define GPSSTAT_REG_LAST_FIX		BKP_DR7
+
+#define GPSSTAT_EE_VERSION			1
+#define GPSSTAT_EE_COUNTERS			(GPSSTAT_START_NUMBER * GPSSTAT_TTFF_BUCKETS + 1 + GPSSTAT_NAV_MODES)
+#define GPSSTAT_EE_SAT_MINUTES		(GPSSTAT_EE_BASE + 1 + GPSSTAT_EE_COUNTERS)
+
+#if 1 + GPSSTAT_EE_COUNTERS + 2 > GPSSTAT_EE_SIZE
+#error GPSSTAT_EE_SIZE too small for the counters
+#endif
+
+#define ONE_MINUTE					(60 * TICK_1S)
+#define ONE_HOUR					3600
+
+struct gpsstat_s{
+	uint16_t ttff[GPSSTAT_START_NUMBER][GPSSTAT_TTFF_BUCKETS];
+	uint16_t fix_loss;
+	uint16_t mode_minutes[GPSSTAT_NAV_MODES];
+	uint32_t sat_minutes;
+};
+
+static const char *start_name[GPSSTAT_START_NUMBER] = {"hot", "warm", "cold"};
+
+static struct gpsstat_s stats;
+static bool running = FALSE;
+static bool fixed = FALSE;
+static enum gpsstat_start_n start_type;
+static tick_t start_tick;
+static tick_t last_poll;
+static uint16_t last_fix_hour;
+
+/* Sub-minute remainders */
+static uint32_t mode_ms[GPSSTAT_NAV_MODES];
+static uint32_t sat_ms;
+
+/* Saturating counter increment */
+static void gpsstat_inc(uint16_t *counter, uint16_t n){
+	*counter = (*counter > 0xFFFF - n) ? 0xFFFF : *counter + n;
+}
+
+/* Hours since 2000 modulo 2^16, 0 for no fix yet */
+static uint16_t gpsstat_hour(void){
+	uint16_t hour = (uint16_t)(RTC_GetCounter() / ONE_HOUR);
+
+	return hour ? hour : 1;
+}
+
+void gpsstat_clear(void){
+	memset(&stats, 0, sizeof(stats));
+	memset(mode_ms, 0, sizeof(mode_ms));
+	sat_ms = 0;
+}
+
+/* Half word counter i of the flash EEPROM layout */
+static uint16_t *gpsstat_counter(uint8_t i){
+	if (i < GPSSTAT_START_NUMBER * GPSSTAT_TTFF_BUCKETS) {
+		return &stats.ttff[i / GPSSTAT_TTFF_BUCKETS][i % GPSSTAT_TTFF_BUCKETS];
+	}
+	i -= GPSSTAT_START_NUMBER * GPSSTAT_TTFF_BUCKETS;
+	return i ? &stats.mode_minutes[i - 1] : &stats.fix_loss;
+}
+
+/* Counters of the previous runs, none for another layout version */
+static void gpsstat_load(void){
+	uint16_t version;
+	uint8_t i;
+
+	if (EE_ReadUShort(GPSSTAT_EE_BASE, &version) == FALSE || version != GPSSTAT_EE_VERSION) {
+		return;
+	}
+	for (i = 0; i < GPSSTAT_EE_COUNTERS; i++) {
+		if (EE_ReadUShort(GPSSTAT_EE_BASE + 1 + i, gpsstat_counter(i)) == FALSE) {
+			*gpsstat_counter(i) = 0;
+		}
+	}
+	if (EE_ReadULong(GPSSTAT_EE_SAT_MINUTES, &stats.sat_minutes) == FALSE) {
+		stats.sat_minutes = 0;
+	}
+}
+
+/*
+ * Write the counters which changed since the last save, the flash
+ * pages only take the few counters of a run.
+ */
+void gpsstat_save(void){
+	uint16_t stored;
+	uint32_t stored_long;
+	uint8_t i;
+
+	if (EE_ReadUShort(GPSSTAT_EE_BASE, &stored) == FALSE || stored != GPSSTAT_EE_VERSION) {
+		EE_WriteUShort(GPSSTAT_EE_BASE, GPSSTAT_EE_VERSION);
+	}
+	for (i = 0; i < GPSSTAT_EE_COUNTERS; i++) {
+		if (EE_ReadUShort(GPSSTAT_EE_BASE + 1 + i, &stored) == FALSE
+				|| stored != *gpsstat_counter(i)) {
+			EE_WriteUShort(GPSSTAT_EE_BASE + 1 + i, *gpsstat_counter(i));
+		}
+	}
+	if (EE_ReadULong(GPSSTAT_EE_SAT_MINUTES, &stored_long) == FALSE
+			|| stored_long != stats.sat_minutes) {
+		EE_WriteULong(GPSSTAT_EE_SAT_MINUTES, stats.sat_minutes);
+	}
+}
+
+/* Call after EE_Init() and before the receiver starts */
+void gpsstat_Init(void){
+	gpsstat_clear();
+	gpsstat_load();
+	last_fix_hour = BKP_ReadBackupRegister(GPSSTAT_REG_LAST_FIX);
+}
+
+/*
+ * Called when the receiver is powered. The start type is guessed from
+ * the age of the last fix unless a cold start was explicitly requested.
+ */
+void gpsstat_start(void){
+	uint32_t age = (uint16_t)(gpsstat_hour() - last_fix_hour) * (uint32_t)ONE_HOUR;
+
+	if (gps_mydata.reset_cfg == GPS_ALMANAC_RESET_MODE_COLDSTART
+			|| gps_mydata.reset_cfg == GPS_ALMANAC_RESET_MODE_FACTORYSTART
+			|| last_fix_hour == 0 || age > GPSSTAT_WARM_START_AGE) {
+		start_type = GPSSTAT_START_COLD;
+	} else if (age > GPSSTAT_HOT_START_AGE) {
+		start_type = GPSSTAT_START_WARM;
+	} else {
+		start_type = GPSSTAT_START_HOT;
+	}
+
+	running = TRUE;
+	fixed = FALSE;
+	start_tick = tick_1khz();
+	last_poll = start_tick;
+}
+
+void gpsstat_stop(void){
+	running = FALSE;
+	gpsstat_save();
+}
+
+static void gpsstat_ttff(uint32_t ms){
+	uint8_t bucket;
+
+	if (ms < GPSSTAT_TTFF_BUCKET_1 * TICK_1S) {
+		bucket = 0;
+	} else if (ms < GPSSTAT_TTFF_BUCKET_2 * TICK_1S) {
+		bucket = 1;
+	} else if (ms < GPSSTAT_TTFF_BUCKET_3 * TICK_1S) {
+		bucket = 2;
+	} else {
+		bucket = 3;
+	}
+	gpsstat_inc(&stats.ttff[start_type][bucket], 1);
+	DEBUGF("GPS stats: %s start, TTFF %dms.\n", start_name[start_type], (int)ms);
+}
+
+/* Polled from the main loop while the receiver runs */
+void gpsstat_Mgmt(void){
+	tick_t now;
+	uint32_t dt;
+	uint8_t mode;
+
+	if (running == FALSE || gps_mydata.lock) {
+		return;
+	}
+
+	now = tick_1khz();
+	dt = now - last_poll;
+	last_poll = now;
+
+	mode = 0;
+	if (gps_mydata.data_valide == 0) {
+		mode = gps_mydata.gps_mode & GPSSTAT_NAV_MODE_MASK;
+	}
+
+	if (mode != 0) {
+		if (fixed == FALSE) {
+			fixed = TRUE;
+			gpsstat_ttff(now - start_tick);
+		}
+		if (gpsstat_hour() != last_fix_hour) {
+			last_fix_hour = gpsstat_hour();
+			PWR_BackupAccessCmd(ENABLE);
+			BKP_WriteBackupRegister(GPSSTAT_REG_LAST_FIX, last_fix_hour);
+		}
+
+		sat_ms += gps_mydata.sat_number * dt;
+		if (sat_ms >= ONE_MINUTE) {
+			stats.sat_minutes += sat_ms / ONE_MINUTE;
+			sat_ms %= ONE_MINUTE;
+		}
+	} else if (fixed == TRUE) {
+		fixed = FALSE;
+		gpsstat_inc(&stats.fix_loss, 1);
+		DEBUGF("GPS stats: fix lost.\n");
+	}
+
+	mode_ms[mode] += dt;
+	if (mode_ms[mode] >= ONE_MINUTE) {
+		gpsstat_inc(&stats.mode_minutes[mode], mode_ms[mode] / ONE_MINUTE);
+		mode_ms[mode] %= ONE_MINUTE;
+	}
+}
+
+void gpsstat_print(void){
+	uint8_t s, b, m;
+	uint32_t fix_minutes = 0;
+	uint32_t sat_minutes = stats.sat_minutes;
+
+	printf("GPS TTFF   <%ds <%ds <%ds >=%ds\n", GPSSTAT_TTFF_BUCKET_1,
+			GPSSTAT_TTFF_BUCKET_2, GPSSTAT_TTFF_BUCKET_3, GPSSTAT_TTFF_BUCKET_3);
+	for (s = 0; s < GPSSTAT_START_NUMBER; s++) {
+		printf("  %-5s", start_name[s]);
+		for (b = 0; b < GPSSTAT_TTFF_BUCKETS; b++) {
+			printf(" %5d", stats.ttff[s][b]);
+		}
+		printf("\n");
+	}
+
+	printf("GPS fix lost: %d\n", stats.fix_loss);
+	printf("GPS nav mode minutes:");
+	for (m = 0; m < GPSSTAT_NAV_MODES; m++) {
+		printf(" %d:%d", m, stats.mode_minutes[m]);
+		if (m != 0) {
+			fix_minutes += stats.mode_minutes[m];
+		}
+	}
+	printf("\n");
+
+	if (fix_minutes) {
+		printf("GPS mean satellites in fix: %d.%d\n",
+				(int)(sat_minutes / fix_minutes),
+				(int)((sat_minutes * 10 / fix_minutes) % 10));
+	}
+}
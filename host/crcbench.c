@@ -0,0 +1,181 @@
+/*
+ * CRC16 of crc.c against the bitwise loop it replaced: every seed and
+ * byte value through crc16_update(), then crc16_block() over random
+ * buffers at every alignment and split point. Exits 1 on a mismatch,
+ * then times the three on a sector sized buffer.
+ *
+ *	crcbench [-n rounds]
+ *
+ * The Makefile builds it with the 256 entry table and, as
+ * crcbench_nibble, with CRC16_NIBBLE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "stm32f10x.h"
+
+#include "crc.h"
+
+#define BENCH_SIZE		512
+#define CHECK_SIZE		1024
+#define CHECK_BUFFERS	2000
+
+static unsigned long mismatches;
+
+/* The former crc16_update() */
+static uint16_t crc16_bitwise(uint16_t crc, uint8_t a){
+	int i;
+
+	crc ^= a;
+	for (i = 0; i < 8; ++i) {
+		if (crc & 1) {
+			crc = (crc >> 1) ^ 0xA001;
+		} else {
+			crc = (crc >> 1);
+		}
+	}
+	return crc;
+}
+
+static uint16_t crc16_bitwise_block(uint16_t crc, const uint8_t *data, uint32_t len){
+	while (len--) {
+		crc = crc16_bitwise(crc, *data++);
+	}
+	return crc;
+}
+
+static void mismatch(const char *what, uint32_t a, uint32_t b, uint16_t got, uint16_t want){
+	if (mismatches++ < 10) {
+		fprintf(stderr, "%s %lu %lu: 0x%04x, expected 0x%04x\n", what,
+				(unsigned long)a, (unsigned long)b, got, want);
+	}
+}
+
+static void check(void){
+	static uint32_t words[CHECK_SIZE / 4 + 2];
+	uint8_t *buf = (uint8_t *)words;
+	uint32_t seed, i, ofs, len, split;
+	uint16_t want, got;
+
+	for (seed = 0; seed < 0x10000; seed++) {
+		for (i = 0; i < 256; i++) {
+			got = crc16_update(seed, i);
+			want = crc16_bitwise(seed, i);
+			if (got != want) {
+				mismatch("crc16_update seed, byte", seed, i, got, want);
+			}
+		}
+	}
+
+	srand(1);
+	for (i = 0; i < CHECK_BUFFERS; i++) {
+		for (len = 0; len < sizeof(words); len++) {
+			buf[len] = rand();
+		}
+		seed = (i & 1) ? CRC_FEED : (uint16_t)rand();
+		len = rand() % (CHECK_SIZE + 1);
+		for (ofs = 0; ofs < 4; ofs++) {
+			want = crc16_bitwise_block(seed, buf + ofs, len);
+			got = crc16_block(seed, buf + ofs, len);
+			if (got != want) {
+				mismatch("crc16_block offset, length", ofs, len, got, want);
+			}
+			split = len ? rand() % len : 0;
+			got = crc16_block(crc16_block(seed, buf + ofs, split), buf + ofs + split, len - split);
+			if (got != want) {
+				mismatch("crc16_block split, length", split, len, got, want);
+			}
+		}
+	}
+
+	/* The usual check value: "123456789" from 0 is 0xBB3D */
+	got = crc16_block(0, (const uint8_t *)"123456789", 9);
+	if (got != 0xBB3D) {
+		mismatch("crc16_block check value", 0, 9, got, 0xBB3D);
+	}
+}
+
+static double now(void){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void bench(unsigned long rounds){
+	static uint32_t words[BENCH_SIZE / 4 + 1];
+	uint8_t *buf = (uint8_t *)words;
+	volatile uint16_t sink;
+	uint16_t crc;
+	unsigned long r;
+	uint32_t i;
+	double t, bitwise;
+
+	for (i = 0; i < sizeof(words); i++) {
+		buf[i] = i * 7;
+	}
+
+	t = now();
+	for (r = 0, crc = CRC_FEED; r < rounds; r++) {
+		crc = crc16_bitwise_block(crc, buf, BENCH_SIZE);
+	}
+	sink = crc;
+	bitwise = now() - t;
+	printf("bitwise loop         %6.1f MB/s\n", rounds * BENCH_SIZE / bitwise / 1e6);
+
+	t = now();
+	for (r = 0, crc = CRC_FEED; r < rounds; r++) {
+		for (i = 0; i < BENCH_SIZE; i++) {
+			crc = crc16_update(crc, buf[i]);
+		}
+	}
+	sink = crc;
+	t = now() - t;
+	printf("crc16_update loop    %6.1f MB/s, %.1fx\n", rounds * BENCH_SIZE / t / 1e6, bitwise / t);
+
+	t = now();
+	for (r = 0, crc = CRC_FEED; r < rounds; r++) {
+		crc = crc16_block(crc, buf, BENCH_SIZE);
+	}
+	sink = crc;
+	t = now() - t;
+	printf("crc16_block aligned  %6.1f MB/s, %.1fx\n", rounds * BENCH_SIZE / t / 1e6, bitwise / t);
+
+	t = now();
+	for (r = 0, crc = CRC_FEED; r < rounds; r++) {
+		crc = crc16_block(crc, buf + 1, BENCH_SIZE);
+	}
+	sink = crc;
+	t = now() - t;
+	printf("crc16_block offset 1 %6.1f MB/s, %.1fx\n", rounds * BENCH_SIZE / t / 1e6, bitwise / t);
+	(void)sink;
+}
+
+int main(int argc, char *argv[]){
+	unsigned long rounds = 20000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: crcbench [-n rounds]\n");
+			return 2;
+		}
+	}
+
+	printf("table                %s\n", CRC16_NIBBLE ? "16 entries" : "256 entries");
+	check();
+	if (mismatches) {
+		fprintf(stderr, "%lu mismatches\n", mismatches);
+		return 1;
+	}
+	printf("equivalence          %d seeds x 256 bytes, %d buffers x 4 offsets: ok\n",
+			0x10000, CHECK_BUFFERS);
+	bench(rounds);
+	return 0;
+}
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stm32f10x.h"
+
+#include "diskio.h"
+#include "diskimg.h"
+
+#define SECTOR_SIZE		512
+
+const struct diskimg_model_s diskimg_model_none = {
+	0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/*
+ * 36MHz/4 SPI, about 1ms to program a block and a 150ms busy every 4MB
+ * written, the allocation unit of most cards.
+ */
+const struct diskimg_model_s diskimg_model_sd = {
+	9000000,	/* spi_hz */
+	20,			/* cmd_us */
+	300,		/* read_us */
+	1000,		/* program_us */
+	8192,		/* stall_every */
+	150000,		/* stall_us */
+	100,		/* poll_us */
+	0			/* sleep */
+};
+
+struct diskimg_stats_s diskimg_stats;
+
+static BYTE *image = NULL;
+static DWORD image_sectors;
+static uint32_t *sector_writes;		/* per sector write counts */
+static uint32_t *sector_reads;		/* per sector read counts */
+static struct diskimg_model_s model;
+static uint64_t clock_us;
+static uint64_t written;			/* blocks written, for the stalls */
+
+/* Pending asynchronous transfer, done when the clock reaches async_end */
+static BOOL async_pending = FALSE;
+static uint64_t async_end;
+static DRESULT async_result = RES_OK;
+static disk_async_callback async_done;
+
+/* disk_write_begin() stream */
+static DWORD stream_next;
+static BYTE stream_left;
+
+static void charge(uint64_t us){
+	struct timespec ts;
+
+	clock_us += us;
+	if (model.sleep && us) {
+		ts.tv_sec = us / 1000000;
+		ts.tv_nsec = (us % 1000000) * 1000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+/* Data token, block and CRC at the SPI clock */
+static uint64_t transfer_us(BYTE count){
+	if (model.spi_hz == 0) {
+		return 0;
+	}
+	return (uint64_t)count * (1 + SECTOR_SIZE + 2) * 8 * 1000000 / model.spi_hz;
+}
+
+static uint64_t read_cost(BYTE count){
+	uint64_t us = model.cmd_us + count * (uint64_t)model.read_us + transfer_us(count);
+
+	if (count > 1) {
+		us += model.cmd_us;				/* CMD12 */
+	}
+	return us;
+}
+
+static uint64_t write_cost(BYTE count){
+	uint64_t us = model.cmd_us + transfer_us(count) + count * (uint64_t)model.program_us;
+
+	if (count > 1) {
+		us += model.cmd_us;				/* ACMD23 */
+	}
+	while (count--) {
+		if (model.stall_every && ++written % model.stall_every == 0) {
+			us += model.stall_us;
+		}
+	}
+	return us;
+}
+
+/* Block until the pending transfer is done */
+static void async_wait(void){
+	if (async_pending == FALSE) {
+		return;
+	}
+	if (clock_us < async_end) {
+		charge(async_end - clock_us);
+	}
+	async_pending = FALSE;
+	if (async_done) {
+		async_done(async_result);
+	}
+}
+
+static DRESULT check(BYTE drv, DWORD sector, BYTE count){
+	if (drv || !count) {
+		return RES_PARERR;
+	}
+	if (image == NULL) {
+		return RES_NOTRDY;
+	}
+	if (sector >= image_sectors || count > image_sectors - sector) {
+		return RES_PARERR;
+	}
+	return RES_OK;
+}
+
+static void read_sectors(BYTE *buff, DWORD sector, BYTE count){
+	BYTE i;
+
+	memcpy(buff, image + (size_t)sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+	for (i = 0; i < count; i++) {
+		sector_reads[sector + i]++;
+	}
+	diskimg_stats.reads++;
+	diskimg_stats.read_sectors += count;
+}
+
+static void write_sectors(const BYTE *buff, DWORD sector, BYTE count){
+	BYTE i;
+
+	memcpy(image + (size_t)sector * SECTOR_SIZE, buff, (size_t)count * SECTOR_SIZE);
+	for (i = 0; i < count; i++) {
+		sector_writes[sector + i]++;
+	}
+	diskimg_stats.writes++;
+	diskimg_stats.write_sectors += count;
+}
+
+/* Map the image, created or extended to sectors, 0 keeps the file size */
+int diskimg_open(const char *path, DWORD sectors){
+	struct stat st;
+	int fd;
+
+	diskimg_close();
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return -1;
+	}
+	if (sectors == 0) {
+		sectors = st.st_size / SECTOR_SIZE;
+	}
+	if (sectors == 0 || ((off_t)sectors * SECTOR_SIZE > st.st_size
+			&& ftruncate(fd, (off_t)sectors * SECTOR_SIZE) < 0)) {
+		fprintf(stderr, "%s: no size\n", path);
+		close(fd);
+		return -1;
+	}
+	image = mmap(NULL, (size_t)sectors * SECTOR_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		image = NULL;
+		perror(path);
+		return -1;
+	}
+	image_sectors = sectors;
+	sector_writes = calloc(sectors, sizeof(uint32_t));
+	sector_reads = calloc(sectors, sizeof(uint32_t));
+	if (sector_writes == NULL || sector_reads == NULL) {
+		diskimg_close();
+		return -1;
+	}
+	return 0;
+}
+
+void diskimg_close(void){
+	if (image == NULL) {
+		return;
+	}
+	async_wait();
+	munmap(image, (size_t)image_sectors * SECTOR_SIZE);
+	free(sector_writes);
+	free(sector_reads);
+	image = NULL;
+	sector_writes = NULL;
+	sector_reads = NULL;
+}
+
+void diskimg_set_model(const struct diskimg_model_s *m){
+	model = *m;
+}
+
+/* Model clock, us */
+uint64_t diskimg_clock(void){
+	return clock_us;
+}
+
+/* Time spent outside the disk calls */
+void diskimg_advance(uint64_t us){
+	charge(us);
+}
+
+uint32_t diskimg_sector_writes(DWORD sector, DWORD count){
+	uint32_t n = 0;
+
+	while (count-- && sector < image_sectors) {
+		n += sector_writes[sector++];
+	}
+	return n;
+}
+
+uint32_t diskimg_sector_reads(DWORD sector, DWORD count){
+	uint32_t n = 0;
+
+	while (count-- && sector < image_sectors) {
+		n += sector_reads[sector++];
+	}
+	return n;
+}
+
+void diskimg_reset_stats(void){
+	memset(&diskimg_stats, 0, sizeof(diskimg_stats));
+	if (sector_writes) {
+		memset(sector_writes, 0, image_sectors * sizeof(uint32_t));
+		memset(sector_reads, 0, image_sectors * sizeof(uint32_t));
+	}
+}
+
+DSTATUS disk_initialize(BYTE drv){
+	return disk_status(drv);
+}
+
+DSTATUS disk_status(BYTE drv){
+	if (drv || image == NULL) {
+		return STA_NOINIT;
+	}
+	return 0;
+}
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count){
+	uint64_t us;
+	DRESULT res = check(drv, sector, count);
+
+	if (res != RES_OK) {
+		return res;
+	}
+	async_wait();
+	read_sectors(buff, sector, count);
+	us = read_cost(count);
+	diskimg_stats.busy_us += us;
+	charge(us);
+	return RES_OK;
+}
+
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count){
+	uint64_t us;
+	DRESULT res = check(drv, sector, count);
+
+	if (res != RES_OK) {
+		return res;
+	}
+	async_wait();
+	write_sectors(buff, sector, count);
+	us = write_cost(count);
+	diskimg_stats.busy_us += us;
+	charge(us);
+	return RES_OK;
+}
+
+/* The stream costs its commands, then each block as in a multiple block write */
+DRESULT disk_write_begin(BYTE drv, DWORD sector, BYTE count){
+	DRESULT res = check(drv, sector, count);
+
+	if (res != RES_OK) {
+		return res;
+	}
+	if (stream_left) {
+		return RES_PARERR;
+	}
+	async_wait();
+	stream_next = sector;
+	stream_left = count;
+	diskimg_stats.writes++;
+	diskimg_stats.busy_us += 2 * model.cmd_us;		/* ACMD23, CMD25 */
+	charge(2 * model.cmd_us);
+	return RES_OK;
+}
+
+DRESULT disk_write_block(BYTE drv, const BYTE *buff){
+	uint64_t us;
+
+	if (drv || stream_left == 0) {
+		return RES_PARERR;
+	}
+	memcpy(image + (size_t)stream_next * SECTOR_SIZE, buff, SECTOR_SIZE);
+	sector_writes[stream_next++]++;
+	stream_left--;
+	diskimg_stats.write_sectors++;
+	us = transfer_us(1) + model.program_us;
+	if (model.stall_every && ++written % model.stall_every == 0) {
+		us += model.stall_us;
+	}
+	diskimg_stats.busy_us += us;
+	charge(us);
+	return RES_OK;
+}
+
+DRESULT disk_write_end(BYTE drv){
+	DRESULT res = stream_left ? RES_ERROR : RES_OK;
+
+	if (drv) {
+		return RES_PARERR;
+	}
+	stream_left = 0;
+	return res;
+}
+
+/* The data moves at once, the completion when the clock gets there */
+DRESULT disk_read_async(BYTE drv, BYTE *buff, DWORD sector, BYTE count, disk_async_callback done){
+	uint64_t us;
+	DRESULT res = check(drv, sector, count);
+
+	if (res != RES_OK) {
+		return res;
+	}
+	async_wait();
+	read_sectors(buff, sector, count);
+	us = read_cost(count);
+	diskimg_stats.busy_us += us;
+	async_end = clock_us + us;
+	async_result = RES_OK;
+	async_done = done;
+	async_pending = TRUE;
+	return RES_OK;
+}
+
+DRESULT disk_write_async(BYTE drv, const BYTE *buff, DWORD sector, BYTE count, disk_async_callback done){
+	uint64_t us;
+	DRESULT res = check(drv, sector, count);
+
+	if (res != RES_OK) {
+		return res;
+	}
+	async_wait();
+	write_sectors(buff, sector, count);
+	diskimg_stats.async_writes++;
+	us = write_cost(count);
+	diskimg_stats.busy_us += us;
+	async_end = clock_us + us;
+	async_result = RES_OK;
+	async_done = done;
+	async_pending = TRUE;
+	return RES_OK;
+}
+
+BOOL disk_async_poll(void){
+	if (async_pending == FALSE) {
+		return FALSE;
+	}
+	if (clock_us >= async_end) {
+		async_wait();
+		return FALSE;
+	}
+	if (model.poll_us) {
+		charge(model.poll_us);
+	} else {
+		charge(async_end - clock_us);
+	}
+	return TRUE;
+}
+
+DRESULT disk_async_result(void){
+	return async_result;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff){
+	if (drv) {
+		return RES_PARERR;
+	}
+	if (image == NULL) {
+		return RES_NOTRDY;
+	}
+
+	switch (ctrl) {
+	case CTRL_SYNC:
+		async_wait();
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD*)buff = image_sectors;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD*)buff = SECTOR_SIZE;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD*)buff = 1;
+		return RES_OK;
+	case MMC_GET_TYPE:
+		*(BYTE*)buff = CT_SD2 | CT_BLOCK;
+		return RES_OK;
+	case CTRL_POWER:
+		if (*(BYTE*)buff == 2) {
+			((BYTE*)buff)[1] = 1;		/* always powered */
+		}
+		return RES_OK;
+	case MMC_GET_ERRORS:
+		memset(buff, 0, sizeof(DISK_ERRORS));	/* the image does not fail */
+		return RES_OK;
+	case MMC_GET_BUSY:
+		memset(buff, 0, sizeof(DISK_BUSY));	/* the waits are charged, not polled */
+		return RES_OK;
+	case MMC_READ_AHEAD:
+		return RES_OK;
+	default:
+		return RES_PARERR;
+	}
+}
+
+void disk_set_yield(disk_yield_hook hook){
+	(void)hook;
+}
+
+void disk_timerproc(void){
+}
@@ -0,0 +1,52 @@
+#ifndef __DISKIMG_H__
+#define __DISKIMG_H__
+
+/*
+ * diskio.h on the host: the card is an image file mapped in memory, a
+ * raw dump of an SD card or a new file. All accesses move a model clock
+ * by the time the SPI card would take, nothing is charged with the zero
+ * model. The asynchronous calls finish when the clock reaches their end,
+ * disk_async_poll() moves it a poll step at a time.
+ */
+
+#include <stdint.h>
+
+#include "integer.h"
+
+/* Card timing, all in us except the SPI clock */
+struct diskimg_model_s{
+	uint32_t spi_hz;		/* SPI clock, 0 for no transfer time */
+	uint32_t cmd_us;		/* command and response */
+	uint32_t read_us;		/* access time before the data token */
+	uint32_t program_us;	/* busy after each written block */
+	uint32_t stall_every;	/* a long busy every n written blocks, 0 never */
+	uint32_t stall_us;		/* that long busy (erase, wear leveling) */
+	uint32_t poll_us;		/* clock step of disk_async_poll() */
+	int sleep;				/* also sleep the modeled time */
+};
+
+/* Zero cost and an SPI SD card at 9MHz as driven by sd_spi_stm32.c */
+extern const struct diskimg_model_s diskimg_model_none;
+extern const struct diskimg_model_s diskimg_model_sd;
+
+struct diskimg_stats_s{
+	uint32_t reads;			/* disk_read() and disk_read_async() calls */
+	uint32_t writes;		/* disk_write() and disk_write_async() calls */
+	uint32_t read_sectors;
+	uint32_t write_sectors;
+	uint32_t async_writes;
+	uint64_t busy_us;		/* modeled time of all the accesses */
+};
+
+extern struct diskimg_stats_s diskimg_stats;
+
+int diskimg_open(const char *path, DWORD sectors);
+void diskimg_close(void);
+void diskimg_set_model(const struct diskimg_model_s *model);
+uint64_t diskimg_clock(void);
+void diskimg_advance(uint64_t us);
+uint32_t diskimg_sector_writes(DWORD sector, DWORD count);
+uint32_t diskimg_sector_reads(DWORD sector, DWORD count);
+void diskimg_reset_stats(void);
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ * Host side of the log download protocol of download.c, on a serial
+ * port or against download.c itself on a disk image (-i), over the line
+ * model of uartsim.c: the transfer times are then those of the card and
+ * the line, and errors can be injected.
+ *
+ *	dlclient [-d device | -i image] [-b baud] [-e error_rate]
+ *		list [dir] | stat path | get path [out]
+ *
+ * The session starts at 115200 baud and moves to -b, 460800 by default.
+ * -e is the probability for each frame to be damaged or lost, -i only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <time.h>
+
+#include "stm32f10x.h"
+
+#include "timer.h"
+#include "ff.h"
+#include "crc.h"
+#include "download.h"
+#include "diskimg.h"
+#include "uartsim.h"
+
+/* After the register definitions, it has macros named as their fields */
+#include <termios.h>
+
+#define DL_REPLY_TIMEOUT	500		/* ms */
+#define DL_DATA_TIMEOUT		300		/* ms without a DATA frame, then an ACK */
+#define DL_TRIES			5
+
+struct dl_frame_s{
+	uint8_t type;
+	uint16_t seq;
+	uint16_t len;
+	uint8_t data[DL_FRAME_MAX];
+};
+
+static int fd = -1;					/* serial port, -1 on the simulated line */
+static uint16_t seq;
+static FATFS fs;
+
+struct dl_link_stats_s{
+	uint32_t bad_frames;
+	uint32_t acks;
+	uint32_t timeouts;
+} link_stats;
+
+static void usage(void){
+	fprintf(stderr, "usage: dlclient [-d device | -i image] [-b baud] [-e error_rate]"
+			" list [dir] | stat path | get path [out]\n");
+	exit(2);
+}
+
+static uint64_t now_us(void){
+	struct timespec t;
+
+	if (fd < 0) {
+		return diskimg_clock();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static speed_t serial_speed(uint32_t baud){
+	switch (baud) {
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	default: return B0;
+	}
+}
+
+static int serial_open(const char *device){
+	struct termios tio;
+
+	fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0 || tcgetattr(fd, &tio) < 0) {
+		perror(device);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	cfsetspeed(&tio, B115200);
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIOFLUSH);
+	return 0;
+}
+
+static void link_set_baud(uint32_t baud){
+	struct termios tio;
+
+	if (fd < 0) {
+		uartsim_set_baud(baud);
+		return;
+	}
+	tcdrain(fd);
+	tcgetattr(fd, &tio);
+	cfsetspeed(&tio, serial_speed(baud));
+	tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void link_write(const uint8_t *buf, uint16_t len){
+	if (fd < 0) {
+		uartsim_write(buf, len);
+	} else if (write(fd, buf, len) != len) {
+		perror("write");
+	}
+}
+
+static int link_read(uint8_t *c, uint32_t timeout_ms){
+	struct timeval tv;
+	fd_set set;
+
+	if (fd < 0) {
+		return uartsim_read(c, timeout_ms);
+	}
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	if (select(fd + 1, &set, NULL, NULL, &tv) <= 0) {
+		return 0;
+	}
+	return read(fd, c, 1) == 1;
+}
+
+static void send_frame(uint8_t type, uint16_t s, const uint8_t *payload, uint16_t len){
+	uint8_t f[DL_HDR_SIZE + DL_REQUEST_MAX + DL_CRC_SIZE];
+
+	f[0] = DL_SYNC0;
+	f[1] = DL_SYNC1;
+	f[DL_HDR_TYPE] = type;
+	f[DL_HDR_FLAGS] = 0;
+	ST_WORD(f + DL_HDR_SEQ, s);
+	ST_WORD(f + DL_HDR_LEN, len);
+	memcpy(f + DL_HDR_SIZE, payload, len);
+	ST_WORD(f + DL_HDR_SIZE + len,
+			crc16_block(CRC_FEED, f + DL_HDR_TYPE, DL_HDR_SIZE - DL_HDR_TYPE + len));
+	link_write(f, DL_HDR_SIZE + len + DL_CRC_SIZE);
+}
+
+/* Next valid frame, 0 when none came for timeout_ms */
+static int read_frame(struct dl_frame_s *fr, uint32_t timeout_ms){
+	uint8_t buf[DL_FRAME_MAX];
+	uint64_t deadline = now_us() + (uint64_t)timeout_ms * 1000;
+	uint32_t n = 0, len = 0, left;
+	uint8_t c;
+
+	for (;;) {
+		left = (now_us() < deadline) ? (uint32_t)((deadline - now_us() + 999) / 1000) : 0;
+		if (left == 0 || link_read(&c, left) == 0) {
+			return 0;
+		}
+		if ((n == 0 && c != DL_SYNC0) || (n == 1 && c != DL_SYNC1)) {
+			n = (c == DL_SYNC0) ? 1 : 0;
+			continue;
+		}
+		buf[n++] = c;
+		if (n == DL_HDR_SIZE) {
+			len = LD_WORD(buf + DL_HDR_LEN);
+			if (len > DL_DATA_SIZE) {
+				link_stats.bad_frames++;
+				n = 0;
+			}
+		}
+		if (n < DL_HDR_SIZE || n < DL_HDR_SIZE + len + DL_CRC_SIZE) {
+			continue;
+		}
+		n = 0;
+		if (crc16_block(CRC_FEED, buf + DL_HDR_TYPE, DL_HDR_SIZE - DL_HDR_TYPE + len)
+				!= LD_WORD(buf + DL_HDR_SIZE + len)) {
+			link_stats.bad_frames++;
+			continue;
+		}
+		fr->type = buf[DL_HDR_TYPE];
+		fr->seq = LD_WORD(buf + DL_HDR_SEQ);
+		fr->len = len;
+		memcpy(fr->data, buf + DL_HDR_SIZE, len);
+		return 1;
+	}
+}
+
+/* Send a request until its reply comes, -1 without one, else the result */
+static int request(uint8_t type, const uint8_t *payload, uint16_t len, struct dl_frame_s *reply){
+	int i;
+
+	seq++;
+	for (i = 0; i < DL_TRIES; i++) {
+		send_frame(type, seq, payload, len);
+		while (read_frame(reply, DL_REPLY_TIMEOUT)) {
+			if (reply->seq != seq) {
+				continue;				/* DATA of an old transfer, a stale reply */
+			}
+			if (reply->type == DL_ERROR) {
+				return reply->len ? reply->data[0] : DL_E_REQUEST;
+			}
+			if (reply->type == type) {
+				return 0;
+			}
+		}
+	}
+	fprintf(stderr, "no reply to request %d\n", type);
+	return -1;
+}
+
+static uint16_t path_payload(uint8_t *p, uint16_t at, const char *path){
+	uint16_t n = strlen(path);
+
+	if (at + n > DL_REQUEST_MAX) {
+		fprintf(stderr, "%s: path too long\n", path);
+		exit(1);
+	}
+	memcpy(p + at, path, n);
+	return at + n;
+}
+
+static int hello(uint32_t baud){
+	struct dl_frame_s r;
+	uint8_t p[4];
+
+	ST_DWORD(p, baud);
+	if (request(DL_HELLO, p, 4, &r) || r.len < 8 || r.data[0] != DL_VERSION
+			|| LD_WORD(r.data + 2) != DL_DATA_SIZE) {
+		fprintf(stderr, "no session\n");
+		return -1;
+	}
+	link_set_baud(LD_DWORD(r.data + 4));
+	return 0;
+}
+
+static void bye(void){
+	struct dl_frame_s r;
+
+	request(DL_BYE, NULL, 0, &r);
+	link_set_baud(DL_BAUD);
+}
+
+static int list(const char *dir){
+	struct dl_frame_s r;
+	uint8_t p[DL_REQUEST_MAX];
+	uint16_t index = 0, i, len;
+	const uint8_t *e;
+	int res;
+
+	do {
+		ST_WORD(p, index);
+		len = path_payload(p, 2, dir);
+		if ((res = request(DL_LIST, p, len, &r)) != 0) {
+			fprintf(stderr, "%s: error %d\n", dir, res);
+			return -1;
+		}
+		for (i = 0; i < r.len / DL_LIST_ENTRY_SIZE; i++) {
+			e = r.data + i * DL_LIST_ENTRY_SIZE;
+			printf("%04d-%02d-%02d %02d:%02d %c %10lu %.13s\n",
+					(LD_WORD(e + 4) >> 9) + 1980, (LD_WORD(e + 4) >> 5) & 15, LD_WORD(e + 4) & 31,
+					LD_WORD(e + 6) >> 11, (LD_WORD(e + 6) >> 5) & 63,
+					(e[8] & AM_DIR) ? 'd' : '-', (unsigned long)LD_DWORD(e), (const char *)e + 9);
+		}
+		index += i;
+	} while (i == DL_LIST_ENTRIES);
+	return 0;
+}
+
+static int stat_file(const char *path, DWORD *size){
+	struct dl_frame_s r;
+	uint8_t p[DL_REQUEST_MAX];
+	int res;
+
+	res = request(DL_STAT, p, path_payload(p, 0, path), &r);
+	if (res == 0 && r.len >= 10) {
+		res = r.data[0];
+	}
+	if (res) {
+		fprintf(stderr, "%s: error %d\n", path, res);
+		return -1;
+	}
+	*size = LD_DWORD(r.data + 1);
+	return 0;
+}
+
+static void ack(uint16_t next, uint32_t map, uint8_t flags){
+	uint8_t p[7];
+
+	ST_WORD(p, next);
+	ST_DWORD(p + 2, map);
+	p[6] = flags;
+	send_frame(DL_ACK, 0, p, 7);
+	link_stats.acks++;
+}
+
+/*
+ * One READ: the frames are written at their place, the ACK after each
+ * one asks for a resend when it shows a new gap.
+ */
+static int read_range(const char *path, DWORD offset, DWORD length, FILE *out, DWORD *got){
+	struct dl_frame_s r;
+	uint8_t p[DL_REQUEST_MAX];
+	uint16_t frames, next = 0, k, ahead = 0;
+	uint32_t map = 0;
+	uint8_t flags;
+	int res, idle = 0;
+
+	ST_DWORD(p, offset);
+	ST_DWORD(p + 4, length);
+	res = request(DL_READ, p, path_payload(p, 8, path), &r);
+	if (res == 0 && r.len >= 7) {
+		res = r.data[0];
+	}
+	if (res) {
+		fprintf(stderr, "%s: error %d\n", path, res);
+		return -1;
+	}
+	*got = LD_DWORD(r.data + 1);
+	frames = LD_WORD(r.data + 5);
+
+	while (next != frames) {
+		if (read_frame(&r, DL_DATA_TIMEOUT) == 0) {
+			if (++idle == DL_TRIES * 4) {
+				fprintf(stderr, "%s: transfer stalled at frame %d\n", path, next);
+				return -1;
+			}
+			link_stats.timeouts++;
+			ack(next, map, DL_ACK_RESEND);
+			continue;
+		}
+		if (r.type != DL_DATA) {
+			continue;
+		}
+		idle = 0;
+		k = r.seq - next;
+		if (r.seq < next || k > 32 || (k && (map & (1UL << (k - 1))))) {
+			ack(next, map, 0);			/* already there */
+			continue;
+		}
+		fseek(out, offset + (long)r.seq * DL_DATA_SIZE, SEEK_SET);
+		fwrite(r.data, 1, r.len, out);
+
+		/* Frames skipped since the last one */
+		flags = (r.seq > ahead) ? DL_ACK_RESEND : 0;
+		if (r.seq >= ahead) {
+			ahead = r.seq + 1;
+		}
+		if (k) {
+			map |= 1UL << (k - 1);
+		} else {
+			next++;
+			while (map & 1) {
+				map >>= 1;
+				next++;
+			}
+			map >>= 1;
+		}
+		ack(next, map, flags);
+	}
+	return 0;
+}
+
+static int get(const char *path, const char *name){
+	FILE *out;
+	DWORD size, offset = 0, got;
+	uint64_t t0 = now_us();
+	double s;
+
+	if (stat_file(path, &size)) {
+		return -1;
+	}
+	out = fopen(name, "wb");
+	if (out == NULL) {
+		perror(name);
+		return -1;
+	}
+	while (offset < size) {
+		if (read_range(path, offset, size - offset, out, &got) || got == 0) {
+			fclose(out);
+			return -1;
+		}
+		offset += got;
+	}
+	fclose(out);
+
+	s = (now_us() - t0) / 1e6;
+	printf("%s: %lu bytes in %.2f s, %.0f B/s", name, (unsigned long)size, s, s ? size / s : 0.0);
+	if (fd < 0) {
+		printf(", %.1f%% of the line at %lu baud\n", s ? size / s * 10 / uartsim_baud() * 100 : 0.0,
+				(unsigned long)uartsim_baud());
+	} else {
+		printf("\n");
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	const char *device = NULL, *image = NULL, *cmd, *path, *name;
+	DWORD size;
+	uint32_t baud = 460800;
+	double errors = 0;
+	int opt, res = 1;
+
+	while ((opt = getopt(argc, argv, "d:i:b:e:")) != -1) {
+		switch (opt) {
+		case 'd': device = optarg; break;
+		case 'i': image = optarg; break;
+		case 'b': baud = strtoul(optarg, NULL, 0); break;
+		case 'e': errors = strtod(optarg, NULL); break;
+		default: usage();
+		}
+	}
+	if (optind >= argc || (device == NULL) == (image == NULL)) {
+		usage();
+	}
+	cmd = argv[optind];
+	path = (optind + 1 < argc) ? argv[optind + 1] : NULL;
+	if (strcmp(cmd, "list") && (path == NULL || (strcmp(cmd, "stat") && strcmp(cmd, "get")))) {
+		usage();
+	}
+
+	if (device) {
+		if (serial_speed(baud) == B0) {
+			fprintf(stderr, "%lu: unsupported rate\n", (unsigned long)baud);
+			return 2;
+		}
+		if (serial_open(device) < 0) {
+			return 1;
+		}
+	} else {
+		if (diskimg_open(image, 0) < 0) {
+			return 1;
+		}
+		diskimg_set_model(&diskimg_model_sd);
+		f_mount(0, &fs);
+		uartsim_init(DL_BAUD, errors, 1);
+		download_Init();
+	}
+
+	if (hello(baud)) {
+		return 1;
+	}
+	if (strcmp(cmd, "list") == 0) {
+		res = list(path ? path : "");
+	} else if (strcmp(cmd, "stat") == 0) {
+		res = stat_file(path, &size);
+		if (res == 0) {
+			printf("%s: %lu bytes\n", path, (unsigned long)size);
+		}
+	} else {
+		name = strrchr(path, '/');
+		name = (optind + 2 < argc) ? argv[optind + 2] : (name ? name + 1 : path);
+		res = get(path, name);
+	}
+	bye();
+
+	if (fd < 0) {
+		printf("line: %lu frames, %lu resent, %lu timeouts; %lu corrupted, %lu host frames lost,"
+				" %lu bad frames, %lu ACKs\n",
+				(unsigned long)download_stats.frames, (unsigned long)download_stats.resent,
+				(unsigned long)download_stats.timeouts, (unsigned long)uartsim_stats.corrupted,
+				(unsigned long)uartsim_stats.dropped, (unsigned long)link_stats.bad_frames,
+				(unsigned long)link_stats.acks);
+		f_mount(0, NULL);
+		diskimg_close();
+	} else {
+		close(fd);
+	}
+	return res ? 1 : 0;
+}
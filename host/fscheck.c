@@ -0,0 +1,658 @@
+/*
+ * Checks of the FatFs extensions of ff.c on a disk image, with the zero
+ * cost card model of diskimg.c. Each check formats a new image, runs
+ * its case, prints what it measured and exits 1 on a failure.
+ *
+ *	fscheck [check ...]
+ *
+ *	expand		f_expand() block: writes without FAT accesses, trim on close,
+ *				a block appended to a reopened file
+ *	fastseek	random reads in a fragmented file, with and without a link map
+ *	cache		sector reads of synced writes and directory changes, the
+ *				Makefile also builds it as fscheck_cacheN with N window cache
+ *				slots
+ *	freemap		free cluster count kept through fill, delete and allocations,
+ *				FAT16 and FAT32
+ *	dircache	f_open() of cached paths: no sector read, entries kept right
+ *				through writes, chmod, rename, unlink, truncation and mkfs,
+ *				and f_chdir() in the fscheck_rpath build
+ *
+ * Without arguments all the checks run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stm32f10x.h"
+
+#include "ff.h"
+#include "diskio.h"
+#include "diskimg.h"
+
+#define IMAGE			"fscheck.img"
+
+#define SEEK_CLUSTERS	400		/* one sector clusters */
+#define SEEK_RUN		16		/* clusters of a fragment */
+#define SEEK_READS		1000
+#define SEEK_MAP		64
+
+#define CACHE_FILES		30
+#define CACHE_WRITES	20		/* synced sectors per file */
+
+#define FILL_SIZE		65536	/* bytes per file filling the volume */
+
+/* In ff.c, not exported by ff.h */
+DWORD get_fat(FATFS *fs, DWORD clst);
+
+static FATFS fs;
+static BYTE buf[8192];
+static BYTE ref[8192];
+static unsigned long failures;
+
+static void fail(const char *check, const char *what, unsigned long got, unsigned long want){
+	fprintf(stderr, "%s: %s %lu, expected %lu\n", check, what, got, want);
+	failures++;
+}
+
+/* A new image of mb MB formatted with clusters of cluster bytes */
+static int volume(const char *check, DWORD mb, WORD cluster){
+	FATFS *p;
+	DWORD n;
+
+	f_mount(0, NULL);
+	unlink(IMAGE);
+	if (diskimg_open(IMAGE, mb * 2048) < 0) {
+		return -1;
+	}
+	diskimg_set_model(&diskimg_model_none);
+	f_mount(0, &fs);
+	if (f_mkfs(0, 0, cluster) != FR_OK || f_getfree("", &n, &p) != FR_OK) {
+		fprintf(stderr, "%s: f_mkfs failed\n", check);
+		failures++;
+		return -1;
+	}
+	diskimg_reset_stats();
+	return 0;
+}
+
+static void pattern(BYTE *p, UINT len, DWORD ofs){
+	UINT i;
+
+	for (i = 0; i < len; i++) {
+		p[i] = (BYTE)((ofs + i) * 7 + ((ofs + i) >> 9));
+	}
+}
+
+/* Free clusters from a scan of the FAT, not the count FatFs keeps */
+static DWORD scan_free(void){
+	DWORD clst, n = 0;
+
+	for (clst = 2; clst < fs.max_clust; clst++) {
+		if (get_fat(&fs, clst) == 0) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/* Cluster run of a file allocated by f_expand(), written 8KB at a time */
+/* Write 40 blocks of buf from the file pointer, count the FAT writes */
+static DWORD expand_write(FIL *file, UINT first){
+	UINT i, bw;
+
+	diskimg_reset_stats();
+	for (i = first; i < first + 40; i++) {
+		pattern(buf, sizeof(buf), (DWORD)i * sizeof(buf));
+		if (f_write(file, buf, sizeof(buf), &bw) != FR_OK || bw != sizeof(buf)) {
+			fail("expand", "bytes written", bw, sizeof(buf));
+			break;
+		}
+	}
+	return diskimg_sector_writes(fs.fatbase, fs.sects_fat * fs.n_fats);
+}
+
+/*
+ * The file closed by check_expand() reopened with another file after
+ * it: a block appended to its chain, written, trimmed, and a block
+ * appended then closed unused.
+ */
+static void check_expand_append(DWORD free_before){
+	const char *check = "expand";
+	DWORD bcs, used, reads, fat_writes;
+	UINT i, bw;
+	FIL file, gap;
+
+	bcs = (DWORD)fs.csize * 512;
+	if (f_open(&gap, "GAP.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
+		f_write(&gap, buf, bcs, &bw);
+		f_close(&gap);
+	}
+	free_before--;
+
+	if (f_open(&file, "EXPAND.BIN", FA_WRITE | FA_READ | FA_OPEN_EXISTING) != FR_OK
+			|| f_lseek(&file, file.fsize) != FR_OK
+			|| f_expand(&file, 1024UL * 1024) != FR_OK) {
+		fprintf(stderr, "%s: f_expand() on a reopened file failed\n", check);
+		failures++;
+		return;
+	}
+	if (f_contig_sect(&file, 1) == 0) {
+		fail(check, "f_contig_sect() at the appended block", 0, 1);
+	}
+	fat_writes = expand_write(&file, 40);
+	reads = diskimg_stats.read_sectors;
+	if (fat_writes != 0) {
+		fail(check, "FAT sectors written into the appended block", fat_writes, 0);
+	}
+	f_close(&file);
+
+	used = (80 * sizeof(buf) + bcs - 1) / bcs;
+	if (scan_free() != free_before - used / 2) {
+		fail(check, "free clusters after the appended block", scan_free(), free_before - used / 2);
+	}
+	if (f_open(&file, "EXPAND.BIN", FA_READ) != FR_OK || file.fsize != 80 * sizeof(buf)) {
+		fail(check, "file size", file.fsize, 80 * sizeof(buf));
+		return;
+	}
+	for (i = 0; i < 80; i++) {
+		if (f_read(&file, buf, sizeof(buf), &bw) != FR_OK || bw != sizeof(buf)) {
+			fail(check, "bytes read", bw, sizeof(buf));
+			break;
+		}
+		pattern(ref, sizeof(ref), (DWORD)i * sizeof(ref));
+		if (memcmp(buf, ref, sizeof(buf))) {
+			fail(check, "data differs at block", i, i);
+		}
+	}
+	f_close(&file);
+
+	/* Appended and closed without a write: the chain is back as it was */
+	free_before = scan_free();
+	if (f_open(&file, "EXPAND.BIN", FA_WRITE | FA_OPEN_EXISTING) != FR_OK
+			|| f_expand(&file, 1024UL * 1024) != FR_OK) {
+		fail(check, "f_expand() of an unused block", 1, 0);
+		return;
+	}
+	f_close(&file);
+	if (scan_free() != free_before) {
+		fail(check, "free clusters after an unused block", scan_free(), free_before);
+	}
+	if (f_open(&file, "EXPAND.BIN", FA_READ) != FR_OK
+			|| f_lseek(&file, 79 * sizeof(buf)) != FR_OK
+			|| f_read(&file, buf, sizeof(buf), &bw) != FR_OK || bw != sizeof(buf)) {
+		fail(check, "bytes read after an unused block", bw, sizeof(buf));
+	}
+	f_close(&file);
+
+	printf("expand               appended to a reopened file: %lu sectors read, "
+			"%lu FAT writes\n", (unsigned long)reads, (unsigned long)fat_writes);
+}
+
+static void check_expand(void){
+	const char *check = "expand";
+	DWORD bcs, before, used, reads, fat_writes, data_writes;
+	UINT i, bw;
+	FIL file;
+
+	if (volume(check, 32, 2048) < 0) {
+		return;
+	}
+	bcs = (DWORD)fs.csize * 512;
+	before = scan_free();
+	if (f_open(&file, "EXPAND.BIN", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK
+			|| f_expand(&file, 1024UL * 1024) != FR_OK) {
+		fprintf(stderr, "%s: f_expand failed\n", check);
+		failures++;
+		return;
+	}
+	if (scan_free() != before - 1024UL * 1024 / bcs) {
+		fail(check, "free clusters after f_expand()", scan_free(), before - 1024UL * 1024 / bcs);
+	}
+
+	diskimg_reset_stats();
+	for (i = 0; i < 40; i++) {
+		pattern(buf, sizeof(buf), (DWORD)i * sizeof(buf));
+		if (f_write(&file, buf, sizeof(buf), &bw) != FR_OK || bw != sizeof(buf)) {
+			fail(check, "bytes written", bw, sizeof(buf));
+			return;
+		}
+	}
+	reads = diskimg_stats.read_sectors;
+	fat_writes = diskimg_sector_writes(fs.fatbase, fs.sects_fat * fs.n_fats);
+	data_writes = diskimg_sector_writes(fs.database, (fs.max_clust - 2) * fs.csize);
+	if (reads != 0) {
+		fail(check, "sectors read by the writes", reads, 0);
+	}
+	if (fat_writes != 0) {
+		fail(check, "FAT sectors written by the writes", fat_writes, 0);
+	}
+	if (data_writes != 40 * sizeof(buf) / 512 || diskimg_stats.write_sectors != data_writes) {
+		fail(check, "sectors written", diskimg_stats.write_sectors, 40 * sizeof(buf) / 512);
+	}
+	f_close(&file);
+
+	used = (40 * sizeof(buf) + bcs - 1) / bcs;
+	if (scan_free() != before - used) {
+		fail(check, "free clusters after f_close()", scan_free(), before - used);
+	}
+	if (f_open(&file, "EXPAND.BIN", FA_READ) != FR_OK || file.fsize != 40 * sizeof(buf)) {
+		fail(check, "file size", file.fsize, 40 * sizeof(buf));
+		return;
+	}
+	for (i = 0; i < 40; i++) {
+		if (f_read(&file, buf, sizeof(buf), &bw) != FR_OK || bw != sizeof(buf)) {
+			fail(check, "bytes read", bw, sizeof(buf));
+			break;
+		}
+		pattern(ref, sizeof(ref), (DWORD)i * sizeof(ref));
+		if (memcmp(buf, ref, sizeof(buf))) {
+			fail(check, "data differs at block", i, i);
+		}
+	}
+	f_close(&file);
+
+	printf("expand               %u x %u bytes: %lu sectors read, %lu FAT writes, "
+			"%lu of %lu clusters kept\n", 40, (unsigned)sizeof(buf), (unsigned long)reads,
+			(unsigned long)fat_writes, (unsigned long)used,
+			(unsigned long)(1024UL * 1024 / bcs));
+
+	check_expand_append(before - used);
+}
+
+/*
+ * Two files grown a fragment at a time interleave their clusters, then
+ * one is read at random offsets without and with a cluster link map.
+ */
+static void check_fastseek(void){
+	const char *check = "fastseek";
+	DWORD map[SEEK_MAP], run, size, ofs, reads[2], fat_reads[2];
+	UINT i, pass, br;
+	FIL file, other;
+	FRESULT res;
+
+	if (volume(check, 32, 512) < 0) {
+		return;
+	}
+	if (f_open(&file, "FRAG.BIN", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK
+			|| f_open(&other, "OTHER.BIN", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+		fprintf(stderr, "%s: cannot create the files\n", check);
+		failures++;
+		return;
+	}
+	run = (DWORD)SEEK_RUN * fs.csize * 512;
+	size = (DWORD)SEEK_CLUSTERS * fs.csize * 512;
+	for (ofs = 0; ofs < size; ofs += run) {
+		pattern(buf, run, ofs);
+		f_write(&file, buf, run, &br);
+		f_write(&other, buf, run, &br);
+	}
+	f_close(&file);
+	f_close(&other);
+	f_unlink("OTHER.BIN");
+
+	for (pass = 0; pass < 2; pass++) {
+		if (f_open(&file, "FRAG.BIN", FA_READ) != FR_OK || file.fsize != size) {
+			fail(check, "file size", file.fsize, size);
+			return;
+		}
+		if (pass) {
+			file.cltbl = map;
+			map[0] = 4;
+			res = f_lseek(&file, CREATE_LINKMAP);
+			if (res != FR_NOT_ENOUGH_CORE || map[0] != 2 + 2 * size / run) {
+				fail(check, "link map size needed", map[0], 2 + 2 * size / run);
+			}
+			map[0] = SEEK_MAP;
+			if (f_lseek(&file, CREATE_LINKMAP) != FR_OK) {
+				fail(check, "link map of fragments", map[0], 2 + 2 * size / run);
+				return;
+			}
+		}
+		diskimg_reset_stats();
+		srand(1);
+		for (i = 0; i < SEEK_READS; i++) {
+			ofs = rand() % (size - 512);
+			if (f_lseek(&file, ofs) != FR_OK
+					|| f_read(&file, buf, 512, &br) != FR_OK || br != 512) {
+				fail(check, "bytes read at", ofs, ofs);
+				break;
+			}
+			pattern(ref, 512, ofs);
+			if (memcmp(buf, ref, 512)) {
+				fail(check, "data differs at", ofs, ofs);
+			}
+		}
+		reads[pass] = diskimg_stats.read_sectors;
+		fat_reads[pass] = diskimg_sector_reads(fs.fatbase, fs.sects_fat * fs.n_fats);
+		f_close(&file);
+	}
+	if (fat_reads[1] != 0) {
+		fail(check, "FAT sectors read with the link map", fat_reads[1], 0);
+	}
+
+	printf("fastseek             %u reads in %lu fragments: %lu sectors read (%lu FAT) "
+			"without a map, %lu (%lu FAT) with\n", SEEK_READS, (unsigned long)(size / run),
+			(unsigned long)reads[0], (unsigned long)fat_reads[0],
+			(unsigned long)reads[1], (unsigned long)fat_reads[1]);
+}
+
+static void cache_name(char *name, UINT f){
+	sprintf(name, (f == 1) ? "DIR/F%02u.BIN" : "F%02u.BIN", f);
+}
+
+/*
+ * Files written a sector at a time with a sync after each, then a
+ * directory made, a file deleted and one moved into it. The volume is
+ * mounted again before reading it all back, so nothing comes from the
+ * cache.
+ */
+static void check_cache(void){
+	const char *check = "cache";
+	char name[16];
+	DWORD reads;
+	UINT f, w, br;
+	FIL file;
+
+	if (volume(check, 32, 512) < 0) {
+		return;
+	}
+#if _FS_CACHE
+	fs.cache_hit = fs.cache_miss = fs.cache_write = 0;	/* the scan of volume() */
+#endif
+	for (f = 0; f < CACHE_FILES; f++) {
+		sprintf(name, "F%02u.BIN", f);
+		if (f_open(&file, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+			fprintf(stderr, "%s: cannot create %s\n", check, name);
+			failures++;
+			return;
+		}
+		for (w = 0; w < CACHE_WRITES; w++) {
+			pattern(buf, 512, (DWORD)(f * CACHE_WRITES + w) * 512);
+			if (f_write(&file, buf, 512, &br) != FR_OK || f_sync(&file) != FR_OK) {
+				fail(check, "sector written", w, w);
+			}
+		}
+		f_close(&file);
+	}
+	if (f_mkdir("DIR") != FR_OK || f_unlink("F00.BIN") != FR_OK
+			|| f_rename("F01.BIN", "DIR/F01.BIN") != FR_OK) {
+		fprintf(stderr, "%s: directory changes failed\n", check);
+		failures++;
+	}
+	reads = diskimg_stats.read_sectors;
+#if _FS_CACHE
+	printf("cache                %u slots: %lu sectors read, %lu hits, %lu misses, %lu written back\n",
+			_FS_CACHE, (unsigned long)reads, (unsigned long)fs.cache_hit,
+			(unsigned long)fs.cache_miss, (unsigned long)fs.cache_write);
+#else
+	printf("cache                no cache: %lu sectors read\n", (unsigned long)reads);
+#endif
+
+	f_mount(0, NULL);
+	f_mount(0, &fs);
+	if (f_open(&file, "F00.BIN", FA_READ) != FR_NO_FILE) {
+		fail(check, "F00.BIN still there", 1, 0);
+	}
+	for (f = 1; f < CACHE_FILES; f++) {
+		cache_name(name, f);
+		if (f_open(&file, name, FA_READ) != FR_OK
+				|| file.fsize != CACHE_WRITES * 512) {
+			fail(check, "file size", f, CACHE_WRITES * 512);
+			continue;
+		}
+		for (w = 0; w < CACHE_WRITES; w++) {
+			pattern(ref, 512, (DWORD)(f * CACHE_WRITES + w) * 512);
+			if (f_read(&file, buf, 512, &br) != FR_OK || br != 512 || memcmp(buf, ref, 512)) {
+				fail(check, "data differs in file", f, f);
+				break;
+			}
+		}
+		f_close(&file);
+	}
+}
+
+static void fill_name(char *name, char prefix, UINT n){
+	sprintf(name, "FILL/%c%06u.BIN", prefix, n);
+}
+
+/* Free count kept by FatFs against a scan of the FAT, then after a remount */
+static void freemap_compare(const char *check, const char *when){
+	FATFS *p;
+	DWORD tracked = fs.free_clust, scanned = scan_free(), n;
+
+	if (tracked != scanned) {
+		fprintf(stderr, "%s: %s: ", check, when);
+		fail(check, "free clusters kept", tracked, scanned);
+	}
+	f_mount(0, NULL);
+	f_mount(0, &fs);
+	if (f_getfree("", &n, &p) != FR_OK || n != scanned) {
+		fprintf(stderr, "%s: %s: ", check, when);
+		fail(check, "free clusters after a remount", n, scanned);
+	}
+}
+
+static void freemap_case(const char *check, DWORD mb, BYTE type){
+	char name[24];
+	DWORD scanned;
+	UINT n, files, bw;
+	FIL file;
+
+	if (volume(check, mb, 512) < 0) {
+		return;
+	}
+	if (fs.fs_type != type || f_mkdir("FILL") != FR_OK) {
+		fail(check, "FAT type", fs.fs_type, type);
+		return;
+	}
+	memset(buf, 0x5A, sizeof(buf));
+
+	/* Fill the volume */
+	for (files = 0; ; files++) {
+		fill_name(name, 'F', files);
+		if (f_open(&file, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+			break;
+		}
+		for (n = 0; n < FILL_SIZE; n += bw) {
+			if (f_write(&file, buf, sizeof(buf), &bw) != FR_OK || bw < sizeof(buf)) {
+				break;
+			}
+		}
+		f_close(&file);
+		if (n < FILL_SIZE) {
+			break;
+		}
+	}
+	freemap_compare(check, "full");
+
+	/* Delete every other file */
+	for (n = 0; n < files; n += 2) {
+		fill_name(name, 'F', n);
+		f_unlink(name);
+	}
+	freemap_compare(check, "every other file deleted");
+
+	/* Allocate the holes again, half by f_write() and half by f_expand() */
+	for (n = 0; n < files / 2; n++) {
+		fill_name(name, (n & 1) ? 'X' : 'W', n);
+		if (f_open(&file, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+			fail(check, "file created", n, n);
+			break;
+		}
+		if (n & 1) {
+			if (f_expand(&file, FILL_SIZE) != FR_OK) {
+				fail(check, "f_expand() into a hole", n, n);
+			}
+		} else if (f_write(&file, buf, sizeof(buf), &bw) != FR_OK || bw != sizeof(buf)) {
+			fail(check, "bytes written into a hole", bw, sizeof(buf));
+		}
+		f_close(&file);
+	}
+	freemap_compare(check, "holes allocated");
+	scanned = scan_free();
+
+	printf("freemap              FAT%u, %lu clusters, %u files of %u bytes: "
+			"%lu free at the end\n",
+			(type == FS_FAT16) ? 16 : 32, (unsigned long)(fs.max_clust - 2), files,
+			FILL_SIZE, (unsigned long)scanned);
+}
+
+static void check_freemap(void){
+	freemap_case("freemap FAT16", 16, FS_FAT16);
+	freemap_case("freemap FAT32", 40, FS_FAT32);
+}
+
+/* Open path, expect res and then the file size */
+static void dircache_open(const char *check, const char *path, BYTE mode, FRESULT want, DWORD size){
+	FRESULT res;
+	FIL file;
+
+	res = f_open(&file, path, mode);
+	if (res != want) {
+		fprintf(stderr, "%s ", path);
+		fail(check, "f_open() result", res, want);
+		return;
+	}
+	if (res == FR_OK) {
+		if (file.fsize != size) {
+			fprintf(stderr, "%s ", path);
+			fail(check, "file size", file.fsize, size);
+		}
+		f_close(&file);
+	}
+}
+
+static void dircache_write(const char *path, BYTE mode, UINT len){
+	FIL file;
+	UINT bw;
+
+	if (f_open(&file, path, mode) == FR_OK) {
+		f_lseek(&file, file.fsize);
+		memset(buf, 'x', len);
+		f_write(&file, buf, len, &bw);
+		f_close(&file);
+	}
+}
+
+static void check_dircache(void){
+	const char *check = "dircache";
+	DWORD hits, reads;
+
+	if (volume(check, 32, 512) < 0) {
+		return;
+	}
+#if _FS_DIRCACHE
+	/* Reopen after write, the second open from the cache reads nothing */
+	dircache_write("A.TXT", FA_WRITE | FA_CREATE_ALWAYS, 1000);
+	dircache_open(check, "A.TXT", FA_READ, FR_OK, 1000);
+	hits = fs.dcache_hit;
+	diskimg_reset_stats();
+	dircache_open(check, "A.TXT", FA_READ, FR_OK, 1000);
+	reads = diskimg_stats.read_sectors;
+	if (fs.dcache_hit != hits + 1 || reads != 0) {
+		fail(check, "sectors read by a cached f_open()", reads, 0);
+	}
+
+	/* Append */
+	dircache_write("A.TXT", FA_WRITE | FA_OPEN_EXISTING, 500);
+	dircache_open(check, "A.TXT", FA_READ, FR_OK, 1500);
+
+	/* Read-only attribute */
+	f_chmod("A.TXT", AM_RDO, AM_RDO);
+	dircache_open(check, "A.TXT", FA_WRITE, FR_DENIED, 0);
+	dircache_open(check, "A.TXT", FA_READ, FR_OK, 1500);
+	f_chmod("A.TXT", 0, AM_RDO);
+	dircache_open(check, "A.TXT", FA_WRITE, FR_OK, 1500);
+
+	/* Rename and unlink */
+	if (f_rename("A.TXT", "B.TXT") != FR_OK) {
+		fail(check, "f_rename()", 1, 0);
+	}
+	dircache_open(check, "A.TXT", FA_READ, FR_NO_FILE, 0);
+	dircache_open(check, "B.TXT", FA_READ, FR_OK, 1500);
+	f_unlink("B.TXT");
+	dircache_open(check, "B.TXT", FA_READ, FR_NO_FILE, 0);
+
+	/* Truncation by FA_CREATE_ALWAYS */
+	dircache_write("C.TXT", FA_WRITE | FA_CREATE_ALWAYS, 2000);
+	dircache_open(check, "C.TXT", FA_READ, FR_OK, 2000);
+	dircache_open(check, "C.TXT", FA_WRITE | FA_CREATE_ALWAYS, FR_OK, 0);
+	dircache_open(check, "C.TXT", FA_READ, FR_OK, 0);
+
+#if _FS_RPATH
+	/* The same relative path in another directory */
+	f_mkdir("D1");
+	f_mkdir("D2");
+	dircache_write("D1/X.TXT", FA_WRITE | FA_CREATE_ALWAYS, 100);
+	dircache_write("D2/X.TXT", FA_WRITE | FA_CREATE_ALWAYS, 200);
+	f_chdir("D1");
+	dircache_open(check, "X.TXT", FA_READ, FR_OK, 100);
+	f_chdir("/D2");
+	dircache_open(check, "X.TXT", FA_READ, FR_OK, 200);
+	f_chdir("/");
+	dircache_open(check, "X.TXT", FA_READ, FR_NO_FILE, 0);
+#endif
+
+	/* A new file system */
+	dircache_open(check, "C.TXT", FA_READ, FR_OK, 0);
+	hits = fs.dcache_hit;
+	f_mkfs(0, 0, 512);
+	dircache_open(check, "C.TXT", FA_READ, FR_NO_FILE, 0);
+
+	printf("dircache             %u entries: %lu sectors read by a cached f_open(), "
+			"%lu hits\n", _FS_DIRCACHE, (unsigned long)reads, (unsigned long)hits);
+#else
+	(void)hits;
+	(void)reads;
+	printf("dircache             not built\n");
+#endif
+}
+
+static const struct {
+	const char *name;
+	void (*run)(void);
+} checks[] = {
+	{ "expand", check_expand },
+	{ "fastseek", check_fastseek },
+	{ "cache", check_cache },
+	{ "freemap", check_freemap },
+	{ "dircache", check_dircache },
+};
+
+int main(int argc, char *argv[]){
+	unsigned int i;
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		for (i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+			if (strcmp(argv[arg], checks[i].name) == 0) {
+				break;
+			}
+		}
+		if (i == sizeof(checks) / sizeof(checks[0])) {
+			fprintf(stderr, "usage: fscheck [check ...]\n");
+			return 2;
+		}
+	}
+	for (i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+		for (arg = 1; arg < argc; arg++) {
+			if (strcmp(argv[arg], checks[i].name) == 0) {
+				break;
+			}
+		}
+		if (argc == 1 || arg < argc) {
+			checks[i].run();
+		}
+	}
+
+	f_mount(0, NULL);
+	diskimg_close();
+	unlink(IMAGE);
+	if (failures) {
+		fprintf(stderr, "%lu failures\n", failures);
+		return 1;
+	}
+	return 0;
+}
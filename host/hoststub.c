@@ -0,0 +1,91 @@
+/*
+ * The few firmware services the logger needs on the host: the RTC and
+ * the millisecond tick both follow the disk image model clock, the
+ * sensors read constants.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "stm32f10x.h"
+
+#include "rtc.h"
+#include "timer.h"
+#include "sim18.h"
+#include "sht1x.h"
+#include "logsched.h"
+#include "ff.h"
+#include "diskimg.h"
+#include "hoststub.h"
+
+#define EPOCH_2000		946684800UL		/* 2000-01-01 in Unix time */
+
+uint32_t host_rtc_base = 0;
+
+uint32_t RTC_GetCounter(void){
+	return host_rtc_base + (uint32_t)(diskimg_clock() / 1000000);
+}
+
+bool rtc_gettime(RTC_t *rtc){
+	time_t t = (time_t)EPOCH_2000 + RTC_GetCounter();
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	rtc->year = tm.tm_year + 1900;
+	rtc->month = tm.tm_mon + 1;
+	rtc->mday = tm.tm_mday;
+	rtc->wday = tm.tm_wday;
+	rtc->hour = tm.tm_hour;
+	rtc->min = tm.tm_min;
+	rtc->sec = tm.tm_sec;
+	rtc->dst = 0;
+	return TRUE;
+}
+
+DWORD get_fattime(void){
+	RTC_t rtc;
+
+	rtc_gettime(&rtc);
+	return ((DWORD)(rtc.year - 1980) << 25) | ((DWORD)rtc.month << 21)
+			| ((DWORD)rtc.mday << 16) | ((DWORD)rtc.hour << 11)
+			| ((DWORD)rtc.min << 5) | ((DWORD)rtc.sec >> 1);
+}
+
+uint32_t tick_1khz(void){
+	return (uint32_t)(diskimg_clock() / 1000);
+}
+
+char expire_timer(uint32_t last, uint32_t expire){
+	uint32_t t = tick_1khz();
+
+	if ((last + expire) > last) {
+		return (t > (last + expire));
+	} else {
+		return (t > (last + expire) && (t < last));
+	}
+}
+
+int32_t sim18_coordonate(const struct coordonate_s *point){
+	return 0;
+}
+
+int16_t SHT1x_get_data(enum sht1x_data_n data){
+	return 0;
+}
+
+uint16_t vbat_value(void){
+	return 4000;
+}
+
+/* Same as logsched.c, which needs the GPS to build */
+uint32_t logsched_distance(int32_t lat, int32_t lon, int32_t lat0, int32_t lon0){
+	uint32_t dy, dx;
+
+	dy = labs(lat - lat0) / 90;
+	dx = (uint32_t)(labs(lon - lon0) * cosf((float)lat * 1e-7f * (float)M_PI / 180.0f)) / 90;
+
+	return (dx > dy) ? (dx + dy / 2) : (dy + dx / 2);
+}
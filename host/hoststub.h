@@ -0,0 +1,7 @@
+#ifndef __HOSTSTUB_H__
+#define __HOSTSTUB_H__
+
+/* RTC counter at model clock 0, s since 2000-01-01 */
+extern uint32_t host_rtc_base;
+
+#endif
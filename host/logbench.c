@@ -0,0 +1,351 @@
+/*
+ * Storage benchmark: the track logger of the firmware, ff.c, logbuf.c,
+ * track.c and trackidx.c, running on a disk image with the SPI SD card
+ * model. Fixes come at a fixed period along a synthetic walk, the model
+ * clock drives the RTC and the tick so the flush, sync and rotation
+ * policies run as on the card.
+ *
+ *	logbench [-n fixes] [-p period_s] [-e fixed|packed] [-f flush_sectors]
+ *		[-F flush_period_s] [-S sync_period_s] [-c cluster_bytes]
+ *		[-s image_MB] [-m none|sd] [-l] [-k] [-x] [-d files] [image]
+ *
+ * -k keeps the file system of an existing image, -l sleeps the modeled
+ * time as well. The cluster size is chosen by f_mkfs() by default.
+ *
+ * -x stages the sectors in the flash store of flashlog.c, on a 1MB M25P
+ * model, and drains them to the card by the drain policy of logbuf.c.
+ *
+ * -d measures path lookups instead: a directory of files with long names
+ * like the daily logs is created, then every file is opened by name.
+ *
+ * The record size is the growth of the track files over the fixes. With
+ * the packed encoding the run fails when it is not PACK_RATIO_MIN to
+ * PACK_RATIO_MAX times smaller than a fixed size record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "stm32f10x.h"
+#include "stm32f10x_rtc.h"
+
+#include "timer.h"
+#include "ff.h"
+#include "diskio.h"
+#include "track.h"
+#include "trackidx.h"
+#include "logbuf.h"
+#include "serial_flash.h"
+#include "flashlog.h"
+#include "diskimg.h"
+#include "sflashsim.h"
+#include "hoststub.h"
+
+#define BENCH_START		(26UL * 365 * 86400 + 8 * 3600)	/* early 2026, 08:00 */
+#define LOOKUP_DIR		"LOOKUP"
+#define LOOKUP_ROUNDS	10
+#define FLASH_SIZE		(1024UL * 1024)
+#define PACK_RATIO_MIN	3.0
+#define PACK_RATIO_MAX	5.0
+
+static FATFS fs;
+
+static void usage(void){
+	fprintf(stderr, "usage: logbench [-n fixes] [-p period_s] [-e fixed|packed]"
+			" [-f flush_sectors] [-F flush_period_s] [-S sync_period_s]"
+			" [-c cluster_bytes] [-s image_MB] [-m none|sd] [-l] [-k] [-x] [-d files] [image]\n");
+	exit(2);
+}
+
+/* A walk with stops, turns and sensor drift, deterministic */
+static void bench_point(struct track_point_s *p, unsigned long i){
+	static int32_t lat = 453000000, lon = 55000000, alt = 120000;
+	static uint16_t course = 4500;
+	uint16_t speed = ((i / 600) % 4) ? 140 + (i % 37) : 0;
+
+	if (i % 45 == 0) {
+		course = (course + 2000 + (i % 7) * 1000) % 36000;
+	}
+	lat += (course < 18000) ? speed / 12 : -(int32_t)(speed / 12);
+	lon += (course > 9000 && course < 27000) ? -(int32_t)(speed / 9) : speed / 9;
+	alt += (i % 11) - 5;
+
+	memset(p, 0, sizeof(*p));
+	p->time = RTC_GetCounter();
+	p->latitude = lat;
+	p->longitude = lon;
+	p->altitude = alt;
+	p->speed = speed;
+	p->course = course;
+	p->sat_number = 7 + (i / 300) % 4;
+	p->hdop = 5 + (i / 120) % 3;
+	p->temperature = 1850 + (int16_t)((i / 60) % 40);
+	p->humidity = 5200 - (uint16_t)((i / 90) % 30);
+	p->battery = 4100 - (uint16_t)(i / 3600);
+	p->flags = TRACK_FLAG_FIX | (speed ? 0 : TRACK_FLAG_STATIONARY);
+}
+
+static double wall_since(const struct timespec *w0){
+	struct timespec w1;
+
+	clock_gettime(CLOCK_MONOTONIC, &w1);
+	return (w1.tv_sec - w0->tv_sec) + (w1.tv_nsec - w0->tv_nsec) * 1e-9;
+}
+
+/* Data bytes of the track files in the root directory */
+static unsigned long track_bytes(void){
+	unsigned long bytes = 0;
+	FILINFO info;
+	DIR dir;
+
+#if _USE_LFN
+	info.lfname = 0;
+	info.lfsize = 0;
+#endif
+	if (f_opendir(&dir, "") != FR_OK) {
+		return 0;
+	}
+	while (f_readdir(&dir, &info) == FR_OK && info.fname[0]) {
+		if (strstr(info.fname, TRACKIDX_TRACK_EXT) && info.fsize > TRACK_HEADER_SIZE) {
+			bytes += info.fsize - TRACK_HEADER_SIZE;
+		}
+	}
+	return bytes;
+}
+
+static void lookup_path(char *path, unsigned long i){
+	sprintf(path, LOOKUP_DIR "/%04lu%02lu%02lu track log.trk",
+			2026 + i / 372, 1 + (i / 31) % 12, 1 + i % 31);
+}
+
+/* Open every file of a directory of n by name, LOOKUP_ROUNDS times */
+static int bench_lookup(unsigned long n){
+	char path[64];
+	unsigned long i, r, lookups = n * LOOKUP_ROUNDS;
+	struct timespec w0;
+	uint64_t t;
+	double wall;
+	FRESULT res;
+	FIL file;
+
+	res = f_mkdir(LOOKUP_DIR);
+	if (res != FR_OK && res != FR_EXIST) {
+		fprintf(stderr, "lookup: no directory\n");
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		lookup_path(path, i);
+		res = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+		if (res != FR_OK) {
+			fprintf(stderr, "lookup: cannot create %s (%d)\n", path, res);
+			return -1;
+		}
+		f_close(&file);
+	}
+
+	diskimg_reset_stats();
+	t = diskimg_clock();
+	clock_gettime(CLOCK_MONOTONIC, &w0);
+	for (r = 0; r < LOOKUP_ROUNDS; r++) {
+		for (i = 0; i < n; i++) {
+			lookup_path(path, i);
+			if (f_open(&file, path, FA_READ) != FR_OK) {
+				fprintf(stderr, "lookup: cannot open %s\n", path);
+				return -1;
+			}
+			f_close(&file);
+		}
+	}
+	wall = wall_since(&w0);
+	t = diskimg_clock() - t;
+
+	printf("directory            %lu files, %lu lookups\n", n, lookups);
+	printf("lookups/s            %.0f host, %.0f card\n", lookups / wall,
+			t ? lookups * 1e6 / t : 0.0);
+	printf("lookup time          %.2f us host, %.3f ms card\n",
+			wall * 1e6 / lookups, t / 1000.0 / lookups);
+	printf("sectors read         %.1f per lookup\n",
+			(double)diskimg_stats.read_sectors / lookups);
+#if _FS_DIRCACHE
+	printf("directory cache      %lu hits\n", (unsigned long)fs.dcache_hit);
+#endif
+#if _FS_CACHE
+	printf("window cache         %lu hits, %lu misses\n",
+			(unsigned long)fs.cache_hit, (unsigned long)fs.cache_miss);
+#endif
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	const char *image = "logbench.img";
+	const struct diskimg_model_s *model = &diskimg_model_sd;
+	struct diskimg_model_s m;
+	struct track_point_s point;
+	unsigned long fixes = 86400, period = 1, i;
+	unsigned long flush_sectors = LOGBUF_FLUSH_SECTORS;
+	unsigned long flush_period = LOGBUF_FLUSH_PERIOD / TICK_1S;
+	unsigned long sync_period = LOGBUF_SYNC_PERIOD / TICK_1S;
+	unsigned long cluster = 0, size_mb = 1024, lookup = 0;
+	uint16_t encoding = TRACK_ENCODING_DEFAULT;
+	int keep = 0, sleep_time = 0, staging = 0, opt;
+	uint64_t t, latency, worst = 0, total = 0;
+	uint32_t fat_writes, data_writes;
+	unsigned long bytes;
+	struct timespec w0;
+	double wall, record, ratio;
+
+	while ((opt = getopt(argc, argv, "n:p:e:f:F:S:c:s:m:lkxd:")) != -1) {
+		switch (opt) {
+		case 'n': fixes = strtoul(optarg, NULL, 0); break;
+		case 'p': period = strtoul(optarg, NULL, 0); break;
+		case 'e':
+			if (strcmp(optarg, "packed") == 0) {
+				encoding = TRACK_ENCODING_PACKED;
+			} else if (strcmp(optarg, "fixed") == 0) {
+				encoding = TRACK_ENCODING_FIXED;
+			} else {
+				usage();
+			}
+			break;
+		case 'f': flush_sectors = strtoul(optarg, NULL, 0); break;
+		case 'F': flush_period = strtoul(optarg, NULL, 0); break;
+		case 'S': sync_period = strtoul(optarg, NULL, 0); break;
+		case 'c': cluster = strtoul(optarg, NULL, 0); break;
+		case 's': size_mb = strtoul(optarg, NULL, 0); break;
+		case 'm':
+			if (strcmp(optarg, "none") == 0) {
+				model = &diskimg_model_none;
+			} else if (strcmp(optarg, "sd") != 0) {
+				usage();
+			}
+			break;
+		case 'l': sleep_time = 1; break;
+		case 'k': keep = 1; break;
+		case 'x': staging = 1; break;
+		case 'd': lookup = strtoul(optarg, NULL, 0); break;
+		default: usage();
+		}
+	}
+	if (optind < argc) {
+		image = argv[optind];
+	}
+	if (period == 0 || cluster > 32768) {
+		usage();
+	}
+
+	if (diskimg_open(image, keep ? 0 : size_mb * 2048) < 0) {
+		return 1;
+	}
+	diskimg_set_model(&diskimg_model_none);
+	host_rtc_base = BENCH_START;
+	f_mount(0, &fs);
+	if (!keep && f_mkfs(0, 0, (WORD)cluster) != FR_OK) {
+		fprintf(stderr, "%s: f_mkfs failed\n", image);
+		return 1;
+	}
+
+	m = *model;
+	m.sleep = sleep_time;
+	diskimg_set_model(&m);
+	diskimg_reset_stats();
+	if (lookup) {
+		opt = bench_lookup(lookup);
+		f_mount(0, NULL);
+		diskimg_close();
+		return opt < 0;
+	}
+	if (staging) {
+		sflashsim_init(FLASH_SIZE);
+		sflashsim_set_model(&sflashsim_model_m25p);
+		serial_flash_init();
+	}
+	track_set_encoding(encoding);
+	logbuf_policy(flush_sectors, flush_period * TICK_1S, sync_period * TICK_1S);
+	flashlog_Init();
+	if (trackidx_Init() < 0) {
+		fprintf(stderr, "%s: no track file\n", image);
+		return 1;
+	}
+	if (staging && flashlog_start() < 0) {
+		fprintf(stderr, "no flash store\n");
+		return 1;
+	}
+	sflashsim_reset_stats();
+	bytes = track_bytes();
+
+	clock_gettime(CLOCK_MONOTONIC, &w0);
+	for (i = 0; i < fixes; i++) {
+		bench_point(&point, i);
+		t = diskimg_clock();
+		track_write(&point);
+		logbuf_Mgmt();
+		trackidx_Mgmt();
+		latency = diskimg_clock() - t;
+		total += latency;
+		if (latency > worst) {
+			worst = latency;
+		}
+		if (latency < period * 1000000ULL) {
+			diskimg_advance(period * 1000000ULL - latency);
+		}
+	}
+	track_close();
+	wall = wall_since(&w0);
+	bytes = track_bytes() - bytes;
+	record = fixes ? (double)bytes / fixes : 0.0;
+	ratio = bytes ? TRACK_RECORD_SIZE / record : 0.0;
+
+	fat_writes = diskimg_sector_writes(fs.fatbase, fs.sects_fat * fs.n_fats);
+	data_writes = diskimg_sector_writes(fs.database, fs.max_clust * fs.csize);
+
+	printf("fixes                %lu every %lu s, %s encoding\n", fixes, period,
+			encoding == TRACK_ENCODING_PACKED ? "packed" : "fixed");
+	printf("policy               flush %lu sectors / %lu s, sync %lu s, cluster %u\n",
+			flush_sectors, flush_period, sync_period, fs.csize * 512);
+	printf("records/s            %.0f host, %.0f card\n", fixes / wall,
+			diskimg_stats.busy_us ? fixes * 1e6 / diskimg_stats.busy_us : 0.0);
+	printf("sectors written      %lu (%.1f per 1000 fixes)\n",
+			(unsigned long)diskimg_stats.write_sectors,
+			diskimg_stats.write_sectors * 1000.0 / fixes);
+	printf("write calls          %lu (%lu async)\n",
+			(unsigned long)diskimg_stats.writes, (unsigned long)diskimg_stats.async_writes);
+	printf("FAT sector writes    %lu\n", (unsigned long)fat_writes);
+	printf("data area writes     %lu\n", (unsigned long)data_writes);
+	printf("other sector writes  %lu\n",
+			(unsigned long)(diskimg_stats.write_sectors - fat_writes - data_writes));
+	printf("sectors read         %lu\n", (unsigned long)diskimg_stats.read_sectors);
+	printf("record size          %.1f bytes, %.1fx smaller than fixed\n", record, ratio);
+#if _FS_CACHE
+	printf("window cache         %lu hits, %lu misses\n",
+			(unsigned long)fs.cache_hit, (unsigned long)fs.cache_miss);
+#endif
+	printf("append latency       %.3f ms mean, %.3f ms worst\n",
+			total / 1000.0 / fixes, worst / 1000.0);
+	printf("card busy            %.1f s\n", diskimg_stats.busy_us / 1e6);
+	if (staging) {
+		sflashsim_update_stats();
+		printf("flash store          %lu sectors, %lu partial copies, %lu drains\n",
+				(unsigned long)flashlog_stats.appends, (unsigned long)flashlog_stats.partials,
+				(unsigned long)logbuf_stats.drains);
+		printf("flash programs       %lu pages, %lu erases, %lu max per sector\n",
+				(unsigned long)serial_flash_stats.pages, (unsigned long)serial_flash_stats.erases,
+				(unsigned long)sflashsim_stats.max_erases);
+		printf("flash busy           %.1f s waited, %.1f s awake, %.1f s asleep\n",
+				serial_flash_stats.busy_us / 1e6, sflashsim_stats.awake_us / 1e6,
+				sflashsim_stats.sleep_us / 1e6);
+		sflashsim_free();
+	}
+
+	f_mount(0, NULL);
+	diskimg_close();
+	if (encoding == TRACK_ENCODING_PACKED
+			&& (ratio < PACK_RATIO_MIN || ratio > PACK_RATIO_MAX)) {
+		fprintf(stderr, "packed records %.1fx smaller, expected %.0fx to %.0fx\n",
+				ratio, PACK_RATIO_MIN, PACK_RATIO_MAX);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "serial_flash.h"
+#include "diskimg.h"
+#include "sflashsim.h"
+
+const struct sflashsim_model_s sflashsim_model_none = {
+	0, 0, 0, 0, 0
+};
+
+const struct sflashsim_model_s sflashsim_model_m25p = {
+	36000000,	/* spi_hz */
+	800,		/* page_us */
+	600000,		/* erase_us, 32KB sector */
+	6000000,	/* bulk_us */
+	30			/* wake_us */
+};
+
+struct serial_flash_stats_s serial_flash_stats;
+struct sflashsim_stats_s sflashsim_stats;
+
+static uint8_t *flash = NULL;
+static uint32_t flash_size;
+static uint32_t *erase_counts;		/* per sector */
+static struct sflashsim_model_s model;
+static serial_flash_yield_hook yield_hook;
+static int asleep = 1;
+static uint64_t busy_end;			/* model clock at the end of the program or erase */
+static uint64_t state_since;		/* model clock of the last sleep or wake up */
+
+/* Command, address and data bytes at the SPI clock */
+static void transfer(uint32_t bytes){
+	if (model.spi_hz) {
+		diskimg_advance((uint64_t)bytes * 8 * 1000000 / model.spi_hz);
+	}
+}
+
+static void account(void){
+	uint64_t now = diskimg_clock();
+
+	if (asleep) {
+		sflashsim_stats.sleep_us += now - state_since;
+	} else {
+		sflashsim_stats.awake_us += now - state_since;
+	}
+	state_since = now;
+}
+
+static void wake(void){
+	if (asleep == 0) {
+		return;
+	}
+	account();
+	asleep = 0;
+	transfer(1);
+	diskimg_advance(model.wake_us);
+	serial_flash_stats.wakeups++;
+}
+
+/* The time counted is the wait, as the driver does */
+static void wait(void){
+	uint64_t start = diskimg_clock(), now;
+	uint32_t us;
+
+	if (start >= busy_end) {
+		return;
+	}
+	if (yield_hook) {
+		yield_hook();
+	}
+	now = diskimg_clock();
+	if (now < busy_end) {
+		diskimg_advance(busy_end - now);
+	}
+	us = (uint32_t)(diskimg_clock() - start);
+	serial_flash_stats.busy_us += us;
+	if (us > serial_flash_stats.busy_max_us) {
+		serial_flash_stats.busy_max_us = us;
+	}
+}
+
+static void start(uint32_t us){
+	busy_end = diskimg_clock() + us;
+}
+
+/* size a multiple of SF_SECTOR_SIZE */
+int sflashsim_init(uint32_t size){
+	sflashsim_free();
+	if (size == 0 || size % SF_SECTOR_SIZE) {
+		return -1;
+	}
+	flash = malloc(size);
+	erase_counts = calloc(size / SF_SECTOR_SIZE + 1, sizeof(uint32_t));
+	if (flash == NULL || erase_counts == NULL) {
+		sflashsim_free();
+		return -1;
+	}
+	memset(flash, 0xFF, size);
+	flash_size = size;
+	asleep = 1;
+	busy_end = 0;
+	state_since = diskimg_clock();
+	return 0;
+}
+
+void sflashsim_free(void){
+	free(flash);
+	free(erase_counts);
+	flash = NULL;
+	erase_counts = NULL;
+	flash_size = 0;
+}
+
+void sflashsim_set_model(const struct sflashsim_model_s *m){
+	model = *m;
+}
+
+/* The array itself, to check or damage it */
+uint8_t *sflashsim_data(void){
+	return flash;
+}
+
+uint32_t sflashsim_sector_erases(uint32_t address){
+	return address < flash_size ? erase_counts[address / SF_SECTOR_SIZE] : 0;
+}
+
+/* Bring the time counts up to the model clock */
+void sflashsim_update_stats(void){
+	uint32_t i;
+
+	account();
+	sflashsim_stats.max_erases = 0;
+	for (i = 0; i < flash_size / SF_SECTOR_SIZE; i++) {
+		if (erase_counts[i] > sflashsim_stats.max_erases) {
+			sflashsim_stats.max_erases = erase_counts[i];
+		}
+	}
+}
+
+void sflashsim_reset_stats(void){
+	memset(&serial_flash_stats, 0, sizeof(serial_flash_stats));
+	memset(&sflashsim_stats, 0, sizeof(sflashsim_stats));
+	if (erase_counts) {
+		memset(erase_counts, 0, (flash_size / SF_SECTOR_SIZE + 1) * sizeof(uint32_t));
+	}
+	state_since = diskimg_clock();
+}
+
+void serial_flash_spi_config(void){
+}
+
+void serial_flash_init(void){
+	serial_flash_sleep();
+}
+
+void serial_flash_set_yield(serial_flash_yield_hook hook){
+	yield_hook = hook;
+}
+
+uint16_t serial_flash_readid(void){
+	uint16_t capacity = 0;
+
+	while (capacity < 31 && (1UL << capacity) < flash_size) {
+		capacity++;
+	}
+	wake();
+	wait();
+	transfer(4);
+	return flash ? (0x20 << 8) | capacity : 0;
+}
+
+uint32_t serial_flash_size(void){
+	return flash_size;
+}
+
+uint8_t serial_flash_read_status(void){
+	wake();
+	transfer(2);
+	return diskimg_clock() < busy_end ? SF_WRITE_IN_PROGRESS : 0;
+}
+
+uint8_t serial_flash_busy(void){
+	return (asleep == 0 && diskimg_clock() < busy_end) ? 1 : 0;
+}
+
+void serial_flash_wait_write(void){
+	wake();
+	wait();
+}
+
+void serial_write_enable(void){
+}
+
+void serial_write_disable(void){
+}
+
+void serial_flash_read(uint32_t address, uint8_t *buf, uint16_t len){
+	uint32_t n = 0;
+
+	wake();
+	wait();
+	if (flash && address < flash_size) {
+		n = flash_size - address < len ? flash_size - address : len;
+		memcpy(buf, flash + address, n);
+	}
+	memset(buf + n, 0xFF, len - n);
+	transfer(5 + len);
+	serial_flash_stats.reads++;
+	serial_flash_stats.read_bytes += len;
+}
+
+uint8_t serial_flash_program(uint32_t address, const uint8_t *buf, uint16_t len){
+	uint32_t page, i;
+	uint16_t chunk;
+
+	if (flash == NULL) {
+		return SF_NO_CHIP;
+	}
+	while (len) {
+		chunk = SF_PAGE_SIZE - (address & (SF_PAGE_SIZE - 1));
+		if (chunk > len) {
+			chunk = len;
+		}
+		wake();
+		wait();
+		transfer(1 + 4 + chunk);
+		page = address % flash_size;	/* the address wraps on a real chip */
+		for (i = 0; i < chunk; i++) {
+			if (buf[i] & ~flash[page + i]) {
+				sflashsim_stats.overwrites++;
+			}
+			flash[page + i] &= buf[i];
+		}
+		start(model.page_us);
+		serial_flash_stats.pages++;
+		address += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+	return SF_OK;
+}
+
+uint8_t serial_flash_sector_erase(uint32_t address){
+	if (flash == NULL) {
+		return SF_NO_CHIP;
+	}
+	wake();
+	wait();
+	transfer(1 + 4);
+	address = (address % flash_size) & SF_SECTOR_MASK;
+	memset(flash + address, 0xFF, SF_SECTOR_SIZE);
+	erase_counts[address / SF_SECTOR_SIZE]++;
+	start(model.erase_us);
+	serial_flash_stats.erases++;
+	return SF_OK;
+}
+
+uint8_t serial_flash_erase(void){
+	uint32_t i;
+
+	if (flash == NULL) {
+		return SF_NO_CHIP;
+	}
+	wake();
+	wait();
+	transfer(1 + 1);
+	memset(flash, 0xFF, flash_size);
+	for (i = 0; i < flash_size / SF_SECTOR_SIZE; i++) {
+		erase_counts[i]++;
+	}
+	start(model.bulk_us);
+	return SF_OK;
+}
+
+void serial_flash_sleep(void){
+	if (asleep) {
+		return;
+	}
+	wait();
+	transfer(1);
+	account();
+	asleep = 1;
+}
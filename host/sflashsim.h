@@ -0,0 +1,44 @@
+#ifndef __SFLASHSIM_H__
+#define __SFLASHSIM_H__
+
+/*
+ * serial_flash.h on the host: a NOR flash in memory. Programming only
+ * clears bits, an erase sets a whole sector back to 0xFF. Program and
+ * erase end on the disk image model clock (diskimg.c), the next access
+ * waits for them as the driver does. The time spent in deep power-down
+ * and awake is counted for the power budget.
+ */
+
+#include <stdint.h>
+
+/* Chip timing, us except the SPI clock */
+struct sflashsim_model_s{
+	uint32_t spi_hz;		/* SPI clock, 0 for no transfer time */
+	uint32_t page_us;		/* page program */
+	uint32_t erase_us;		/* sector erase */
+	uint32_t bulk_us;		/* chip erase */
+	uint32_t wake_us;		/* deep power-down exit */
+};
+
+/* Zero cost and an M25P type chip at 36MHz, typical times */
+extern const struct sflashsim_model_s sflashsim_model_none;
+extern const struct sflashsim_model_s sflashsim_model_m25p;
+
+struct sflashsim_stats_s{
+	uint32_t overwrites;	/* programs of a 1 over a 0, lost on a real chip */
+	uint64_t sleep_us;		/* time in deep power-down */
+	uint64_t awake_us;		/* time in standby or busy */
+	uint32_t max_erases;	/* erases of the most erased sector */
+};
+
+extern struct sflashsim_stats_s sflashsim_stats;
+
+int sflashsim_init(uint32_t size);
+void sflashsim_free(void);
+void sflashsim_set_model(const struct sflashsim_model_s *model);
+uint8_t *sflashsim_data(void);
+uint32_t sflashsim_sector_erases(uint32_t address);
+void sflashsim_update_stats(void);
+void sflashsim_reset_stats(void);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * Host decoder of the track files, fixed or packed, for checking what
+ * the logger wrote. Prints one CSV line per record and the totals.
+ *
+ *	trackdec [-q] YYYYMMDD.TRK
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "track.h"
+#include "trackpack.h"
+#include "ff.h"
+
+static int quiet = 0;
+static unsigned long records = 0;
+static unsigned long errors = 0;
+
+static void print_point(const struct track_point_s *p){
+	records++;
+	if (quiet) {
+		return;
+	}
+	printf("%u,%lu,%ld,%ld,%ld,%u,%u,%u,%u,%d,%u,%u,0x%02x\n",
+			p->seq, (unsigned long)p->time,
+			(long)p->latitude, (long)p->longitude, (long)p->altitude,
+			p->speed, p->course, p->sat_number, p->hdop,
+			p->temperature, p->humidity, p->battery, p->flags);
+}
+
+static void decode_fixed(const uint8_t *sector, size_t len, uint16_t seed){
+	struct track_point_s point;
+	size_t i;
+
+	for (i = 0; i + TRACK_RECORD_SIZE <= len; i += TRACK_RECORD_SIZE) {
+		if (track_decode(sector + i, &point, seed)) {
+			errors++;
+			continue;
+		}
+		print_point(&point);
+	}
+}
+
+static void decode_packed(const uint8_t *sector, unsigned long n, uint16_t seed){
+	struct trackpack_s pack;
+	struct track_point_s point;
+	int res;
+
+	memset(&pack, 0, sizeof(pack));
+	while ((res = trackpack_decode(&pack, sector, &point, seed)) == 0) {
+		print_point(&point);
+	}
+	if (res < 0) {
+		fprintf(stderr, "sector %lu: bad item at %u\n", n, pack.used);
+		errors++;
+	}
+}
+
+int main(int argc, char *argv[]){
+	uint8_t sector[TRACK_SECTOR_SIZE];
+	unsigned long n = 0, bytes = 0;
+	uint16_t seed, encoding;
+	size_t len;
+	FILE *file;
+
+	if (argc > 1 && strcmp(argv[1], "-q") == 0) {
+		quiet = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 2) {
+		fprintf(stderr, "usage: trackdec [-q] file\n");
+		return 2;
+	}
+	file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		perror(argv[1]);
+		return 2;
+	}
+
+	if (fread(sector, 1, TRACK_HEADER_SIZE, file) != TRACK_HEADER_SIZE
+			|| track_header_check(sector)) {
+		fprintf(stderr, "%s: not a track file\n", argv[1]);
+		return 1;
+	}
+	seed = LD_WORD(sector + TRACK_HDR_CRC);
+	encoding = LD_WORD(sector + TRACK_HDR_ENCODING);
+
+	if (!quiet) {
+		printf("seq,time,latitude,longitude,altitude,speed,course,"
+				"sat_number,hdop,temperature,humidity,battery,flags\n");
+	}
+	while ((len = fread(sector, 1, TRACK_SECTOR_SIZE, file)) > 0) {
+		bytes += len;
+		if (encoding == TRACK_ENCODING_PACKED) {
+			memset(sector + len, 0, TRACK_SECTOR_SIZE - len);
+			decode_packed(sector, n, seed);
+		} else {
+			decode_fixed(sector, len, seed);
+		}
+		n++;
+	}
+	fclose(file);
+
+	fprintf(stderr, "%s: %s, %lu records, %lu errors, %lu data bytes",
+			argv[1], encoding == TRACK_ENCODING_PACKED ? "packed" : "fixed",
+			records, errors, bytes);
+	if (records) {
+		fprintf(stderr, ", %.1f bytes a record", (double)bytes / records);
+	}
+	fprintf(stderr, "\n");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "hw_config.h"
+#include "download.h"
+#include "diskimg.h"
+#include "uartsim.h"
+
+/* Bytes on the line each way, more than a window of frames */
+#define UARTSIM_QUEUE		65536
+/* Clock step of the device main loop when nothing is due before */
+#define UARTSIM_LOOP_US		50
+
+struct uartsim_queue_s{
+	uint8_t data[UARTSIM_QUEUE];
+	double at[UARTSIM_QUEUE];		/* model clock at the end of the stop bit */
+	uint32_t head;
+	uint32_t tail;
+	double end;						/* last byte queued */
+	uint32_t baud;					/* of the sending end */
+};
+
+struct uartsim_stats_s uartsim_stats;
+
+int32_t sys_clock_freq_stepping = 48000000;
+
+static struct uartsim_queue_s to_host;
+static struct uartsim_queue_s to_device;
+static double error_rate;
+
+static void queue_put(struct uartsim_queue_s *q, const uint8_t *buf, uint16_t len){
+	double t = (double)diskimg_clock();
+
+	if (q->end > t) {
+		t = q->end;
+	}
+	while (len--) {
+		if ((q->head + 1) % UARTSIM_QUEUE == q->tail) {
+			fprintf(stderr, "uartsim: line queue overflow\n");
+			exit(1);
+		}
+		t += 10e6 / q->baud;
+		q->data[q->head] = *buf++;
+		q->at[q->head] = t;
+		q->head = (q->head + 1) % UARTSIM_QUEUE;
+	}
+	q->end = t;
+}
+
+static int queue_get(struct uartsim_queue_s *q, uint8_t *c){
+	if (q->tail == q->head || q->at[q->tail] > (double)diskimg_clock()) {
+		return 0;
+	}
+	*c = q->data[q->tail];
+	q->tail = (q->tail + 1) % UARTSIM_QUEUE;
+	return 1;
+}
+
+static int chance(void){
+	return error_rate > 0 && rand() < error_rate * ((double)RAND_MAX + 1);
+}
+
+void uartsim_init(uint32_t baud, double rate, unsigned int seed){
+	memset(&to_host, 0, sizeof(to_host));
+	memset(&to_device, 0, sizeof(to_device));
+	memset(&uartsim_stats, 0, sizeof(uartsim_stats));
+	to_host.baud = to_device.baud = baud;
+	error_rate = rate;
+	srand(seed);
+}
+
+/* Rate of the device end, as set by download.c */
+uint32_t uartsim_baud(void){
+	return to_host.baud;
+}
+
+/* The host end */
+void uartsim_set_baud(uint32_t baud){
+	to_device.baud = baud;
+}
+
+void uartsim_write(const uint8_t *buf, uint16_t len){
+	if (chance()) {
+		uartsim_stats.dropped++;
+		return;
+	}
+	queue_put(&to_device, buf, len);
+	uartsim_stats.host_bytes += len;
+}
+
+/*
+ * Run the device main loop until a byte reaches the host, 0 after the
+ * timeout. The card accesses of download_Mgmt() move the clock as well.
+ */
+int uartsim_read(uint8_t *c, uint32_t timeout_ms){
+	uint64_t deadline = diskimg_clock() + (uint64_t)timeout_ms * 1000;
+	uint64_t now;
+	double next;
+
+	for (;;) {
+		if (queue_get(&to_host, c)) {
+			return 1;
+		}
+		now = diskimg_clock();
+		if (now >= deadline) {
+			return 0;
+		}
+		download_Mgmt();
+		if (diskimg_clock() != now) {
+			continue;
+		}
+		next = now + UARTSIM_LOOP_US;
+		if (to_host.tail != to_host.head && to_host.at[to_host.tail] < next) {
+			next = to_host.at[to_host.tail];
+		}
+		if (to_device.tail != to_device.head && to_device.at[to_device.tail] < next) {
+			next = to_device.at[to_device.tail];
+		}
+		diskimg_advance(next > now + 1 ? (uint64_t)(next - now) : 1);
+	}
+}
+
+/* Nothing else shares the line here */
+void USART1_Set_Binary(bool on){
+}
+
+/* The rate the divider gives */
+void USART1_Set_Baud(uint32_t baud){
+	to_host.baud = sys_clock_freq_stepping / ((sys_clock_freq_stepping + baud / 2) / baud);
+}
+
+bool USART1_Read_Char(uint8_t *c){
+	return queue_get(&to_device, c) ? TRUE : FALSE;
+}
+
+void USART1_Send_Frame(const uint8_t *buf, uint16_t len){
+	uint8_t frame[DL_FRAME_MAX];
+
+	memcpy(frame, buf, len);
+	if (chance()) {
+		frame[rand() % len] ^= 1 << (rand() % 8);
+		uartsim_stats.corrupted++;
+	}
+	queue_put(&to_host, frame, len);
+	uartsim_stats.device_bytes += len;
+}
+
+bool USART1_Frame_Busy(void){
+	return to_host.end > (double)diskimg_clock() ? TRUE : FALSE;
+}
@@ -0,0 +1,29 @@
+#ifndef __UARTSIM_H__
+#define __UARTSIM_H__
+
+/*
+ * The USART1 functions of hw_config.c on the host: a full duplex line
+ * between download.c and a host program, on the disk image model clock
+ * (diskimg.c). Every byte takes its 10 bits at the line rate, a frame
+ * keeps the line busy until its last byte is out. Errors are injected
+ * at random, a byte of a device frame flipped or a host frame lost.
+ */
+
+#include <stdint.h>
+
+struct uartsim_stats_s{
+	uint32_t device_bytes;		/* sent by download.c */
+	uint32_t host_bytes;		/* sent by the host program */
+	uint32_t corrupted;			/* device frames damaged */
+	uint32_t dropped;			/* host writes lost */
+};
+
+extern struct uartsim_stats_s uartsim_stats;
+
+void uartsim_init(uint32_t baud, double error_rate, unsigned int seed);
+uint32_t uartsim_baud(void);
+void uartsim_set_baud(uint32_t baud);
+void uartsim_write(const uint8_t *buf, uint16_t len);
+int uartsim_read(uint8_t *c, uint32_t timeout_ms);
+
+#endif
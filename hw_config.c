@@ -4,6 +4,7 @@
 #include "stm32f10x_it.h"
 #include "stm32f10x_adc.h"
 #include "stm32f10x_i2c.h"
+#include "stm32f10x_pwr.h"
 
 #include "hw_config.h"
 #include "clock_calendar.h"
@@ -34,6 +35,16 @@ volatile uint8_t uart2_fifo[USART_FIFO_SIZE];
 volatile uint16_t uart2_tail;
 volatile uint16_t uart2_head;
 
+/* USART1 reception, the download requests */
+volatile uint8_t uart1_rx_fifo[USART_FIFO_SIZE];
+volatile uint16_t uart1_rx_tail;
+volatile uint16_t uart1_rx_head;
+
+/* Binary mode: the console is dropped, a frame goes out from its buffer */
+static volatile bool uart1_binary = FALSE;
+static const uint8_t * volatile uart1_frame;
+static volatile uint16_t uart1_frame_len;
+
 
 void Set_System(void)
 {
@@ -97,6 +108,9 @@ void Set_System(void)
 	/* Setup Interrupt table */
 	Interrupts_Configuration();
 
+	/* Supply monitor, early warning before brown-out */
+	PVD_Configuration();
+
 	/* Setup SHT1x	*/
 	SHT1x_Config();
 
@@ -192,6 +206,13 @@ void Interrupts_Configuration(void)
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
 
+	/* Enable the PVD Interrupt (supply falling below PVD_LEVEL) */
+	NVIC_InitStructure.NVIC_IRQChannel = PVD_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
 	/*--------------------------------------------------
 	* / * Enable the DMA1 Channel6 Interrupt * /
 	* NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel6_IRQn;
@@ -253,10 +274,12 @@ void USART_Configuration(void)
 	USART_InitStructure.USART_StopBits = USART_StopBits_1;
 	USART_InitStructure.USART_Parity = USART_Parity_No;
 	USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
-	USART_InitStructure.USART_Mode = USART_Mode_Tx;
+	USART_InitStructure.USART_Mode = USART_Mode_Tx | USART_Mode_Rx;
 	/* Configure the USART1 */
 	USART_Init(USART1, &USART_InitStructure);
 	FIFO_INIT(uart1_tail, uart1_head);
+	FIFO_INIT(uart1_rx_tail, uart1_rx_head);
+	USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);
 	USART_Cmd(USART1, ENABLE);
 
 	// Release reset and enable clock
@@ -281,6 +304,10 @@ void USART1_Wait_Empty()
 
 void USART1_Send_Char(uint8_t data)
 {
+	if (uart1_binary == TRUE) {
+		return;
+	} /* if (uart1_binary == TRUE) */
+
 	while(FIFO_FULL(uart1_tail, uart1_head, USART_FIFO_SIZE) == TRUE);
 
 	uart1_fifo[uart1_head] = data;
@@ -322,12 +349,110 @@ uint8_t USART1_Send_Buffer(uint8_t* data_buffer, uint8_t Nb_bytes)
 	return Nb_bytes;
 }
 
+/* Room left in the USART1 FIFO */
+uint16_t USART1_Fifo_Free(void)
+{
+	uint16_t used;
+
+	used = (uart1_head >= uart1_tail) ? (uart1_head - uart1_tail)
+		: (USART_FIFO_SIZE + uart1_head - uart1_tail);
+
+	return USART_FIFO_SIZE - 1 - used;
+}
+
+/*
+ * Queue a buffer as is, only if it fits entirely, so the caller never
+ * waits for the line and its data is never split by other output.
+ */
+uint8_t USART1_Send_Buffer_NoWait(const uint8_t* data_buffer, uint8_t Nb_bytes)
+{
+	uint32_t i;
+
+	if (uart1_binary == TRUE || USART1_Fifo_Free() < Nb_bytes) {
+		return 0;
+	} /* if (USART1_Fifo_Free() < Nb_bytes) */
+
+	for (i = 0; i < Nb_bytes; i++) {
+		uart1_fifo[uart1_head] = *(data_buffer + i);
+		FIFO_NEXT(uart1_head, USART_FIFO_SIZE);
+	} /* for (i = 0; i < Nb_bytes; i++) */
+	USART_ITConfig(USART1, USART_IT_TXE, ENABLE);
+
+	return Nb_bytes;
+}
+
+/*
+ * Binary mode for the download protocol: the console output queued is
+ * sent first, then dropped until the mode ends.
+ */
+void USART1_Set_Binary(bool on)
+{
+	if (on == TRUE) {
+		USART1_Wait_Empty();
+	} else { /* if (on == TRUE) */
+		uart1_frame_len = 0;
+	} /* if (on == TRUE) */
+	uart1_binary = on;
+}
+
+/* Call with the line idle, USART1_Frame_Busy() FALSE */
+void USART1_Set_Baud(uint32_t baud)
+{
+	USART1->BRR = (uint16_t)((sys_clock_freq_stepping + baud / 2) / baud);
+}
+
+bool USART1_Read_Char(uint8_t *c)
+{
+	if (FIFO_EMPTY(uart1_rx_tail, uart1_rx_head, USART_FIFO_SIZE) == TRUE) {
+		return FALSE;
+	} /* if (FIFO_EMPTY(uart1_rx_tail, uart1_rx_head, USART_FIFO_SIZE) == TRUE) */
+
+	*c = uart1_rx_fifo[uart1_rx_tail];
+	FIFO_NEXT(uart1_rx_tail, USART_FIFO_SIZE);
+
+	return TRUE;
+}
+
+/*
+ * Send a frame in binary mode, straight from the buffer which must stay
+ * untouched until USART1_Frame_Busy() returns FALSE. DMA1 channel 4, the
+ * USART1 TX request, is the SD card SPI channel: the interrupt sends it.
+ */
+void USART1_Send_Frame(const uint8_t *buf, uint16_t len)
+{
+	uart1_frame = buf;
+	uart1_frame_len = len;
+	USART_ITConfig(USART1, USART_IT_TXE, ENABLE);
+}
+
+/* A frame is being sent or its last byte is still on the line */
+bool USART1_Frame_Busy(void)
+{
+	return (uart1_frame_len != 0
+			|| USART_GetFlagStatus(USART1, USART_FLAG_TC) == RESET);
+}
+
 void USART1_Istr()
 {
 	uint8_t c;
 
+	if (USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) {
+		c = (uint8_t)USART_ReceiveData(USART1);
+		if (FIFO_FULL(uart1_rx_tail, uart1_rx_head, USART_FIFO_SIZE) == FALSE) {
+			uart1_rx_fifo[uart1_rx_head] = c;
+			FIFO_NEXT(uart1_rx_head, USART_FIFO_SIZE);
+		} /* if (FIFO_FULL(uart1_rx_tail, uart1_rx_head, USART_FIFO_SIZE) == FALSE) */
+	} /* if (USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) */
+
 	if (USART_GetITStatus(USART1, USART_IT_TXE) != RESET) {
-		if (USART1_GetFifo(&c) == TRUE) {
+		if (uart1_binary == TRUE) {
+			if (uart1_frame_len) {
+				USART_SendData(USART1, *uart1_frame++);
+				uart1_frame_len--;
+			} else { /* if (uart1_frame_len) */
+				USART_ITConfig(USART1, USART_IT_TXE, DISABLE);
+			} /* if (uart1_frame_len) */
+		} else if (USART1_GetFifo(&c) == TRUE) {
 			USART_SendData(USART1, c);
 		} else { /* if (USART1_GetFifo(&c) == TRUE) */
 			USART_ITConfig(USART1, USART_IT_TXE, DISABLE);
@@ -344,7 +469,7 @@ void USART2_Send_Char(uint8_t data)
 {
 	while(FIFO_FULL(uart2_tail, uart2_head, USART_FIFO_SIZE) == TRUE);
 
-	uart1_fifo[uart2_head] = data;
+	uart2_fifo[uart2_head] = data;
 	FIFO_NEXT(uart2_head, USART_FIFO_SIZE);
 	USART_ITConfig(USART2, USART_IT_TXE, ENABLE);
 }
@@ -355,7 +480,7 @@ bool USART2_GetFifo(uint8_t *c)
 		return FALSE;
 	} /* if (FIFO_EMPTY(uart1_tail, uart1_head, USART1_FIFO_SIZE) == TRUE) */
 
-	*c = uart2_fifo[uart1_tail];
+	*c = uart2_fifo[uart2_tail];
 
 	FIFO_NEXT(uart2_tail, USART_FIFO_SIZE);
 
@@ -375,7 +500,7 @@ void USART2_Istr()
 	} 
 
 	if (USART_GetITStatus(USART2, USART_IT_RXNE) != RESET) {
-		sim18_read_data((uint8_t)USART1->DR);
+		sim18_read_data((uint8_t)USART2->DR);
 	} 
 }
 
@@ -420,6 +545,25 @@ uint8_t USART2_Send_Buffer(uint8_t* data_buffer, uint8_t Nb_bytes)
  * }
  *--------------------------------------------------*/
 
+/*
+ * The PVD is on EXTI line 16, its output goes high when VDD falls
+ * below the threshold so the rising edge is the power loss warning.
+ */
+void PVD_Configuration(void)
+{
+	EXTI_InitTypeDef EXTI_InitStructure;
+
+	EXTI_ClearITPendingBit(EXTI_Line16);
+	EXTI_InitStructure.EXTI_Line = EXTI_Line16;
+	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&EXTI_InitStructure);
+
+	PWR_PVDLevelConfig(PVD_LEVEL);
+	PWR_PVDCmd(ENABLE);
+}
+
 void SPI2_Configuration(void)
 {
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_SPI2 , ENABLE);
@@ -578,7 +722,7 @@ void GPIO_Configuration(void)
 
 	/*	GPS	*/
 	GPIO_InitStructure.GPIO_Pin =  SIM18_ON_OFF;
-	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
 	GPIO_Init(SIM18_Port, &GPIO_InitStructure);
 
 	GPIO_InitStructure.GPIO_Pin =  SIM18_NRESET;
@@ -586,7 +730,7 @@ void GPIO_Configuration(void)
 	GPIO_Init(SIM18_Port_AUX, &GPIO_InitStructure);
 
 	GPIO_InitStructure.GPIO_Pin =  SIM18_V_ANT;
-	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
 	GPIO_Init(SIM18_Port, &GPIO_InitStructure);
 
 	GPIO_InitStructure.GPIO_Pin =  SIM18_WAKEUP;
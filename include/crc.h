@@ -7,7 +7,13 @@
 
 #define CRC_FEED 0xffff
 
+/* 1 for a 16 entry table instead of 256: 480 bytes less flash, slower */
+#ifndef CRC16_NIBBLE
+#define CRC16_NIBBLE 0
+#endif
+
 uint16_t crc16_update(uint16_t crc, uint8_t a);
+uint16_t crc16_block(uint16_t crc, const uint8_t *data, uint32_t len);
 uint16_t ntohs(uint16_t s);
 uint32_t ntohl(uint32_t l);
 uint16_t htons(uint16_t s);
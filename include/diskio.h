@@ -28,6 +28,10 @@ DSTATUS disk_status (BYTE);
 DRESULT disk_read (BYTE, BYTE*, DWORD, BYTE);
 #if _READONLY == 0
 DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
+/* One multiple block write fed a block at a time, nothing else in between */
+DRESULT disk_write_begin (BYTE, DWORD, BYTE);
+DRESULT disk_write_block (BYTE, const BYTE*);
+DRESULT disk_write_end (BYTE);
 #endif
 DRESULT disk_ioctl (BYTE, BYTE, void*);
 
@@ -56,6 +60,9 @@ DRESULT disk_ioctl (BYTE, BYTE, void*);
 #define MMC_GET_CID         12
 #define MMC_GET_OCR         13
 #define MMC_GET_SDSTAT      14
+#define MMC_READ_AHEAD      15
+#define MMC_GET_ERRORS      16
+#define MMC_GET_BUSY        17
 /* ATA/CF command */
 #define ATA_GET_REV         20
 #define ATA_GET_MODEL       21
@@ -71,11 +78,47 @@ DRESULT disk_ioctl (BYTE, BYTE, void*);
 #define CT_SDC              (CT_SD1|CT_SD2)
 #define CT_BLOCK            0x08
 
+/* SPI transfer errors (MMC_GET_ERRORS) */
+typedef struct {
+	DWORD crc_read;     /* read blocks with a bad CRC16 */
+	DWORD crc_write;    /* written blocks rejected for their CRC16 */
+	DWORD crc_cmd;      /* commands rejected for their CRC7 */
+	DWORD retries;      /* commands and transfers tried again */
+	DWORD failures;     /* transfers given up */
+	BYTE prescaler;     /* fast clock, SPI_BaudRatePrescaler_2 << 3*n */
+} DISK_ERRORS;
+
+/* Card busy times (MMC_GET_BUSY), us */
+typedef struct {
+	DWORD count;        /* waits */
+	DWORD total;        /* wraps after 71 minutes of waiting */
+	DWORD max;
+} DISK_BUSY_STAT;
+
+typedef struct {
+	DISK_BUSY_STAT ready;   /* card busy before a command or block, programming */
+	DISK_BUSY_STAT token;   /* read access time, up to the data token */
+	DISK_BUSY_STAT init;    /* disk_initialize(), leaving the idle state */
+} DISK_BUSY;
+
+/* Called by the driver while the card is busy, with the card selected: it
+   must not use the card, the SPI bus or FatFs. It may sleep (WFI). */
+typedef void (*disk_yield_hook)(void);
+void disk_set_yield (disk_yield_hook);
+
 #ifndef RAMFUNC
 #define RAMFUNC
 #endif
 RAMFUNC void disk_timerproc (void);
 
+/* Asynchronous transfers (DMA build only), completion through the callback */
+typedef void (*disk_async_callback)(DRESULT);
+DRESULT disk_read_async (BYTE, BYTE*, DWORD, BYTE, disk_async_callback);
+DRESULT disk_write_async (BYTE, const BYTE*, DWORD, BYTE, disk_async_callback);
+BOOL disk_async_poll (void);
+DRESULT disk_async_result (void);
+void disk_dma_irq (void);
+
 /* Martin Thomas end */
 
 #define _DISKIO
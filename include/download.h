@@ -0,0 +1,80 @@
+#ifndef __DOWNLOAD_H__
+#define __DOWNLOAD_H__
+
+/*
+ * Binary log download over USART1, the console port. A host opens a
+ * session with a HELLO frame at 115200 baud, asking for a faster rate;
+ * the console output is dropped until BYE or DL_IDLE_TIMEOUT without a
+ * valid frame.
+ *
+ * Frame, little endian, the CRC16 of crc.c over type to payload:
+ *	0xA5 0x5A | type | flags | seq(2) | len(2) | payload | crc(2)
+ *
+ * Requests carry a host sequence number echoed by the reply. A READ
+ * reply is followed by DATA frames numbered from 0, each one sector of
+ * the file read by FatFs straight into the frame buffer. Up to
+ * DL_WINDOW frames are sent ahead of the host ACKs, which carry the
+ * next sequence expected and a bitmap of the frames received after it:
+ * with DL_ACK_RESEND the frames missing before the last one received
+ * are sent again. Without progress for DL_RETRY the oldest one is.
+ *
+ * host/dlclient.c is the host side.
+ */
+
+#define DL_SYNC0				0xA5
+#define DL_SYNC1				0x5A
+
+#define DL_HDR_TYPE				2
+#define DL_HDR_FLAGS			3
+#define DL_HDR_SEQ				4
+#define DL_HDR_LEN				6
+#define DL_HDR_SIZE				8
+#define DL_CRC_SIZE				2
+
+#define DL_DATA_SIZE			512			/* payload of a DATA frame */
+#define DL_FRAME_MAX			(DL_HDR_SIZE + DL_DATA_SIZE + DL_CRC_SIZE)
+#define DL_REQUEST_MAX			64			/* payload of a host frame */
+#define DL_WINDOW				16			/* DATA frames ahead of the ACKs, <= 32 */
+
+#define DL_VERSION				1
+#define DL_BAUD					115200		/* out of a session */
+#define DL_RETRY				(250 * TICK_1MS)
+#define DL_IDLE_TIMEOUT			(10 * TICK_1S)
+
+/* Frame types, the replies have the type of the request */
+#define DL_HELLO				0x01		/* baud(4) -> version(1) window(1) data_size(2) baud(4) */
+#define DL_LIST					0x02		/* index(2) path -> entries from index */
+#define DL_STAT					0x03		/* path -> result(1) size(4) date(2) time(2) attrib(1) */
+#define DL_READ					0x04		/* offset(4) length(4) path -> result(1) length(4) frames(2) */
+#define DL_ACK					0x05		/* next(2) received(4) flags(1), no reply */
+#define DL_BYE					0x06		/* -> empty, then the session ends */
+#define DL_DATA					0x80		/* seq is the frame number */
+#define DL_ERROR				0x7F		/* result(1), to a bad request */
+
+/* LIST entry: size(4) date(2) time(2) attrib(1) name(13), end of list with less */
+#define DL_LIST_ENTRY_SIZE		22
+#define DL_LIST_ENTRIES			(DL_DATA_SIZE / DL_LIST_ENTRY_SIZE)
+
+/* ACK flags */
+#define DL_ACK_RESEND			0x01
+
+/* Results beyond FRESULT */
+#define DL_E_REQUEST			0x40		/* malformed or unknown request */
+#define DL_E_RANGE				0x41		/* offset past the end or range too long */
+
+struct download_stats_s{
+	uint32_t sessions;
+	uint32_t requests;
+	uint32_t frames;		/* DATA frames sent */
+	uint32_t resent;		/* DATA frames sent again */
+	uint32_t timeouts;		/* resends without an ACK */
+	uint32_t bad_frames;	/* CRC errors and garbage on the line */
+};
+
+extern struct download_stats_s download_stats;
+
+void download_Init(void);
+void download_Mgmt(void);
+bool download_active(void);
+
+#endif
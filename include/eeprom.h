@@ -41,8 +41,12 @@
 /* Page full define */
 #define PAGE_FULL               ((uint8_t)0x80)
 
+/* GPS statistics of gpsstat.c: a layout version then the counters */
+#define GPSSTAT_EE_BASE           0x0200
+#define GPSSTAT_EE_SIZE           24
+
 /* Variables' number */
-#define NumbOfVar               ((uint8_t) 3)
+#define NumbOfVar               ((uint8_t) (3 + GPSSTAT_EE_SIZE))
 
 uint16_t EE_Init(void);
 bool EE_ReadUShort(uint16_t VirtAddress, uint16_t* Data);
@@ -295,6 +295,19 @@ typedef char XCHAR;		/* SBCS, DBCS */
 
 
 
+/* Directory entry cache item (_FS_DIRCACHE) */
+
+typedef struct _DIRCACHE_ {
+	DWORD	hash;		/* Path hash (0:Empty) */
+	DWORD	sect;		/* Sector of the directory entry */
+	DWORD	sclust;		/* File start cluster */
+	DWORD	fsize;		/* File size */
+	BYTE	ofs;		/* Entry index in the sector */
+	BYTE	attr;		/* File attribute */
+} DIRCACHE;
+
+
+
 /* File system object structure */
 
 typedef struct _FATFS_ {
@@ -316,6 +329,10 @@ typedef struct _FATFS_ {
 	DWORD	last_clust;	/* Last allocated cluster */
 	DWORD	free_clust;	/* Number of free clusters */
 	DWORD	fsi_sector;	/* fsinfo sector */
+#if _FS_FREEMAP
+	DWORD	freemap_span;	/* Clusters per freemap[] bit */
+	BYTE	freemap[_FS_FREEMAP];	/* Free cluster hint, bit cleared: group full */
+#endif
 #endif
 #if _FS_RPATH
 	DWORD	cdir;		/* Current directory (0:root)*/
@@ -327,6 +344,20 @@ typedef struct _FATFS_ {
 	DWORD	database;	/* Data start sector */
 	DWORD	winsect;	/* Current sector appearing in the win[] */
 	BYTE	win[_MAX_SS];/* Disk access window for Directory/FAT */
+#if _FS_CACHE
+	DWORD	cache_sect[_FS_CACHE];	/* Sector held by each cache slot (0:Empty) */
+	DWORD	cache_use[_FS_CACHE];	/* Last use stamp of each slot */
+	BYTE	cache_dirty[_FS_CACHE];	/* Slot dirty flags (1:must be written back) */
+	DWORD	cache_clock;	/* Use stamp counter */
+	DWORD	cache_hit;		/* Window moves served from the cache */
+	DWORD	cache_miss;		/* Window moves read from the disk */
+	DWORD	cache_write;	/* Sectors written back (FAT copies excluded) */
+	BYTE	cache[_FS_CACHE][_MAX_SS];	/* Cached sectors */
+#endif
+#if _FS_DIRCACHE
+	DIRCACHE	dcache[_FS_DIRCACHE];	/* Directory entries of recently opened files, most recent first */
+	DWORD	dcache_hit;		/* f_open() calls served from dcache[] */
+#endif
 } FATFS;
 
 
@@ -362,6 +393,14 @@ typedef struct _FIL_ {
 	DWORD	org_clust;	/* File start cluster */
 	DWORD	curr_clust;	/* Current cluster */
 	DWORD	dsect;		/* Current data sector */
+#if _USE_EXPAND
+	DWORD	cont_clust;	/* Last cluster of the contiguous block (0:None) */
+	DWORD	cont_org;	/* First cluster of the contiguous block */
+	DWORD	cont_ofs;	/* File offset of the contiguous block */
+#endif
+#if _USE_FASTSEEK
+	DWORD*	cltbl;		/* Pointer to the cluster link map table (0 on file open) */
+#endif
 #if !_FS_READONLY
 	DWORD	dir_sect;	/* Sector containing the directory entry */
 	BYTE*	dir_ptr;	/* Pointer to the directory entry in the window */
@@ -407,7 +446,8 @@ typedef enum {
 	FR_NOT_ENABLED,		/* 12 */
 	FR_NO_FILESYSTEM,	/* 13 */
 	FR_MKFS_ABORTED,	/* 14 */
-	FR_TIMEOUT			/* 15 */
+	FR_TIMEOUT,			/* 15 */
+	FR_NOT_ENOUGH_CORE	/* 16 */
 } FRESULT;
 
 
@@ -436,6 +476,9 @@ FRESULT f_forward (FIL*, UINT(*)(const BYTE*,UINT), UINT, UINT*);	/* Forward dat
 FRESULT f_mkfs (BYTE, BYTE, WORD);					/* Create a file system on the drive */
 FRESULT f_chdir (const XCHAR*);						/* Change current directory */
 FRESULT f_chdrive (BYTE);							/* Change current drive */
+FRESULT f_expand (FIL*, DWORD);						/* Append a contiguous block to the cluster chain */
+DWORD f_contig_sect (FIL*, UINT);					/* Sector at the file pointer inside the contiguous block */
+DWORD f_map_sect (FIL*, DWORD);						/* Sector of a file offset from the cluster link map */
 
 #if _USE_STRFUNC
 int f_putc (int, FIL*);								/* Put a character to the file */
@@ -495,6 +538,11 @@ void ff_rel_grant(_SYNC_t);
 #define FA__ERROR			0x80
 
 
+/* f_lseek() offset to build the cluster link map table (FIL.cltbl) */
+
+#define CREATE_LINKMAP		0xFFFFFFFF
+
+
 /* FAT sub type (FATFS.fs_type) */
 
 #define FS_FAT12	1
@@ -581,13 +629,13 @@ void ff_rel_grant(_SYNC_t);
 /* Multi-byte word access macros  */
 
 #if _WORD_ACCESS == 1	/* Enable word access to the FAT structure */
-#define	LD_WORD(ptr)		(WORD)(*(WORD*)(BYTE*)(ptr))
-#define	LD_DWORD(ptr)		(DWORD)(*(DWORD*)(BYTE*)(ptr))
+#define	LD_WORD(ptr)		(WORD)(*(const WORD*)(const BYTE*)(ptr))
+#define	LD_DWORD(ptr)		(DWORD)(*(const DWORD*)(const BYTE*)(ptr))
 #define	ST_WORD(ptr,val)	*(WORD*)(BYTE*)(ptr)=(WORD)(val)
 #define	ST_DWORD(ptr,val)	*(DWORD*)(BYTE*)(ptr)=(DWORD)(val)
 #else					/* Use byte-by-byte access to the FAT structure */
-#define	LD_WORD(ptr)		(WORD)(((WORD)*(BYTE*)((ptr)+1)<<8)|(WORD)*(BYTE*)(ptr))
-#define	LD_DWORD(ptr)		(DWORD)(((DWORD)*(BYTE*)((ptr)+3)<<24)|((DWORD)*(BYTE*)((ptr)+2)<<16)|((WORD)*(BYTE*)((ptr)+1)<<8)|*(BYTE*)(ptr))
+#define	LD_WORD(ptr)		(WORD)(((WORD)*(const BYTE*)((ptr)+1)<<8)|(WORD)*(const BYTE*)(ptr))
+#define	LD_DWORD(ptr)		(DWORD)(((DWORD)*(const BYTE*)((ptr)+3)<<24)|((DWORD)*(const BYTE*)((ptr)+2)<<16)|((WORD)*(const BYTE*)((ptr)+1)<<8)|*(const BYTE*)(ptr))
 #define	ST_WORD(ptr,val)	*(BYTE*)(ptr)=(BYTE)(val); *(BYTE*)((ptr)+1)=(BYTE)((WORD)(val)>>8)
 #define	ST_DWORD(ptr,val)	*(BYTE*)(ptr)=(BYTE)(val); *(BYTE*)((ptr)+1)=(BYTE)((WORD)(val)>>8); *(BYTE*)((ptr)+2)=(BYTE)((DWORD)(val)>>16); *(BYTE*)((ptr)+3)=(BYTE)((DWORD)(val)>>24)
 #endif
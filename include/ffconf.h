@@ -20,6 +20,31 @@
 /  data transfer. This reduces memory consumption 512 bytes each file object. */
 
 
+#ifndef _FS_CACHE
+#define	_FS_CACHE	2		/* 0 to 8 */
+#endif
+/* Number of sectors kept in an LRU cache under the FAT/directory window
+/  (FATFS.win[]). Each one takes _MAX_SS bytes in the file system object, 0
+/  disables the cache. FATFS.cache_hit/cache_miss count the window moves served
+/  from the cache and from the disk. Requires _FS_TINY 0. The host checks
+/  build it with other sizes. */
+
+
+#define	_FS_FREEMAP	64		/* 0 or number of bytes */
+/* Free cluster hint: one bit per group of clusters, cleared once the whole
+/  group is seen allocated, set again when a cluster of it is freed. Cluster
+/  allocation and f_getfree skip the full groups without reading their FAT
+/  sectors. Groups span whole FAT sectors. 0 disables the map. */
+
+
+#define	_FS_DIRCACHE	4		/* 0 or number of entries */
+/* Directory entries of the files opened last, keyed by a hash of the path
+/  string. f_open() of a cached path reads no directory sector. The entries
+/  follow f_sync() and f_chmod() and are dropped by f_unlink(), f_rename(),
+/  f_mkfs(), f_chdir() and a remount. Each one takes 20 bytes in the file
+/  system object. 0 disables the cache. */
+
+
 #define _FS_READONLY	0	/* 0 or 1 */
 /* Setting _FS_READONLY to 1 defines read only configuration. This removes
 /  writing functions, f_write, f_sync, f_unlink, f_mkdir, f_chmod, f_rename,
@@ -48,6 +73,15 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
+#define	_USE_EXPAND	1		/* 0 or 1 */
+/* To enable f_expand function, set _USE_EXPAND to 1 and set _FS_READONLY to 0. */
+
+
+#define	_USE_FASTSEEK	1	/* 0 or 1 */
+/* To enable fast seek feature with a cluster link map table (FIL.cltbl), set
+/  _USE_FASTSEEK to 1. */
+
+
 
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
@@ -105,7 +139,9 @@
 */
 
 
+#ifndef _FS_RPATH
 #define _FS_RPATH	0		/* 0 or 1 */
+#endif
 /* When _FS_RPATH is set to 1, relative path feature is enabled and f_chdir,
 /  f_chdrive function are available.
 /  Note that output of the f_readdir function is affected by this option. */
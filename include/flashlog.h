@@ -0,0 +1,57 @@
+#ifndef __FLASHLOG_H__
+#define __FLASHLOG_H__
+
+/*
+ * Log-structured store of card sectors on the serial flash. Every entry
+ * is a whole sector image with a header naming its file and place in it,
+ * appended in a slot of an erased flash sector: appending costs a page
+ * program and no card access at all. The slots are used as a ring over
+ * the whole chip, the sector after the head is erased ahead of it.
+ *
+ * The entries are drained to the card in order, then a marker entry
+ * records the last drained sequence number. After a power loss the
+ * entries past the last marker are copied back into their file when it
+ * is opened, the track recovery finds the records there.
+ */
+
+#define FLASHLOG_MAGIC			0x4C46		/* "FL" */
+#define FLASHLOG_DATA_SIZE		512
+
+/* Entry header, little endian */
+#define FLASHLOG_HDR_MAGIC		0
+#define FLASHLOG_HDR_FILL		2			/* bytes of data, 0 for a marker */
+#define FLASHLOG_HDR_SEQ		4
+#define FLASHLOG_HDR_FILE		8			/* start cluster, drained sequence of a marker */
+#define FLASHLOG_HDR_OFS		12			/* sector in the file */
+#define FLASHLOG_HDR_CRC		16			/* of the bytes before */
+#define FLASHLOG_HDR_DCRC		18			/* of the data */
+#define FLASHLOG_HDR_SIZE		20
+
+#define FLASHLOG_SLOT_SIZE		(FLASHLOG_HDR_SIZE + FLASHLOG_DATA_SIZE)
+#define FLASHLOG_SLOTS			(SF_SECTOR_SIZE / FLASHLOG_SLOT_SIZE)	/* per flash sector */
+
+struct flashlog_stats_s{
+	uint32_t appends;		/* full sectors */
+	uint32_t partials;		/* partial sector copies */
+	uint32_t drained;		/* sectors read back for the card */
+	uint32_t restored;		/* entries copied back after a power loss */
+	uint32_t lost;			/* entries of a file not opened after a power loss */
+	uint32_t crc_errors;
+	uint32_t errors;		/* program or erase failures, the store is then off */
+};
+
+extern struct flashlog_stats_s flashlog_stats;
+
+int flashlog_Init(void);
+int flashlog_restore(FIL *file);
+int flashlog_start(void);
+bool flashlog_ready(void);
+int flashlog_append(const uint8_t *sector, uint16_t fill, FIL *file, DWORD ofs);
+int flashlog_read(uint8_t *sector);
+void flashlog_release(void);
+void flashlog_rewind(void);
+int flashlog_drained(void);
+uint8_t flashlog_fill(void);
+void flashlog_idle(void);
+
+#endif
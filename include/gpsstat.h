@@ -0,0 +1,40 @@
+#ifndef __GPSSTAT_H__
+#define __GPSSTAT_H__
+
+/*
+ * GPS availability telemetry of the device. The counters are kept in the
+ * flash EEPROM emulation, saved when the receiver stops and before a
+ * standby, the hour of the last fix in a backup register.
+ */
+
+enum gpsstat_start_n{
+	GPSSTAT_START_HOT,
+	GPSSTAT_START_WARM,
+	GPSSTAT_START_COLD,
+	GPSSTAT_START_NUMBER
+};
+
+/* TTFF histogram upper bounds, in seconds, the last bucket is open */
+#define GPSSTAT_TTFF_BUCKET_1		5
+#define GPSSTAT_TTFF_BUCKET_2		30
+#define GPSSTAT_TTFF_BUCKET_3		60
+#define GPSSTAT_TTFF_BUCKETS		4
+
+/* Navigation type, bits 0-2 of the message 41 NAV TYPE field */
+#define GPSSTAT_NAV_MODES			8
+#define GPSSTAT_NAV_MODE_MASK		0x07
+
+/* Ephemeris older than this means a warm start */
+#define GPSSTAT_HOT_START_AGE		(4 * 3600)
+/* Almanac older than this means a cold start */
+#define GPSSTAT_WARM_START_AGE		(180 * 24 * 3600)
+
+void gpsstat_Init(void);
+void gpsstat_start(void);
+void gpsstat_stop(void);
+void gpsstat_Mgmt(void);
+void gpsstat_clear(void);
+void gpsstat_save(void);
+void gpsstat_print(void);
+
+#endif
@@ -39,6 +39,14 @@
 #define ADC_AIN_REF_VALUE                   ADC_Channel_17
 #define PSU_VOLTAGE           5000
 #define PSU_NO_VOLTAGE           0
+
+/* Power loss warning threshold, well above the 2.7V the SD card needs */
+#define PVD_LEVEL             PWR_PVDLevel_2V9
+
+/* 96-bit unique device ID, word n of 3 (overridden by the host build) */
+#ifndef DEVICE_ID
+#define DEVICE_ID(n)          (*(__IO uint32_t*)(0x1FFFF7E8 + 4 * (n)))
+#endif
 enum clock_speed_n{
 	SLOW = 0, 
 	FAST 
@@ -51,7 +59,15 @@ void Set_System(void);
 void USART_Configuration(void);
 void USART_Send_Char(uint8_t data);
 uint8_t USART1_Send_Buffer(uint8_t* data_buffer, uint8_t Nb_bytes);
+uint8_t USART1_Send_Buffer_NoWait(const uint8_t* data_buffer, uint8_t Nb_bytes);
+uint16_t USART1_Fifo_Free(void);
+void USART1_Set_Binary(bool on);
+void USART1_Set_Baud(uint32_t baud);
+bool USART1_Read_Char(uint8_t *c);
+void USART1_Send_Frame(const uint8_t *buf, uint16_t len);
+bool USART1_Frame_Busy(void);
 uint8_t USART2_Send_Buffer(uint8_t* data_buffer, uint8_t Nb_bytes);
+void USART2_Wait_Empty(void);
 void USART1_Istr(void);
 void USART2_Istr(void);
 void GPIO_Configuration(void);
@@ -60,6 +76,7 @@ void TIM_Configuration(void);
 void ADC_Configuration(void);
 void I2C_Configuration(void);
 void SPI2_Configuration(void);
+void PVD_Configuration(void);
 /*
 void SPI2_Unconfiguration(void);
 void EXTI_Configuration(void);
@@ -0,0 +1,50 @@
+#ifndef __LOGBUF_H__
+#define __LOGBUF_H__
+
+/*
+ * Write-behind ring of whole sectors in front of a log file. Full
+ * sectors go to the card in one multi-sector f_write(), which FatFs
+ * passes straight to disk_write() without the window buffer. Inside a
+ * block allocated by f_expand() they, and the flush period writes of
+ * the partial sector, go with disk_write_async() while the main loop
+ * goes on.
+ *
+ * Data reaches the card every flush period, the directory entry only
+ * every sync period: the records in between are recovered on open.
+ *
+ * When the flash store of flashlog.c is up, full sectors and the flush
+ * period copies of the partial one go to the serial flash instead, the
+ * card is written in a few runs per drain period.
+ */
+
+#define LOGBUF_SECTOR_SIZE			512
+#define LOGBUF_SECTORS				4
+
+/* Default flush policy */
+#define LOGBUF_FLUSH_SECTORS		(LOGBUF_SECTORS - 1)
+#define LOGBUF_FLUSH_PERIOD			(60 * TICK_1S)
+#define LOGBUF_SYNC_PERIOD			(5 * 60 * TICK_1S)
+#define LOGBUF_DRAIN_PERIOD			(60 * 60 * TICK_1S)
+#define LOGBUF_DRAIN_FILL			80			/* percent of the flash store */
+
+struct logbuf_stats_s{
+	uint32_t sectors;		/* sectors written */
+	uint32_t writes;		/* f_write() calls */
+	uint32_t flushes;		/* f_sync() calls */
+	uint32_t power_fail;	/* power loss warnings */
+	uint32_t staged;		/* sectors written to the flash store */
+	uint32_t drains;		/* flash store drains */
+	uint32_t errors;
+};
+
+extern struct logbuf_stats_s logbuf_stats;
+
+int logbuf_Init(FIL *file);
+void logbuf_policy(uint8_t flush_sectors, uint32_t flush_period, uint32_t sync_period);
+int logbuf_write(const uint8_t *data, uint16_t length);
+int logbuf_pad(void);
+int logbuf_flush(void);
+void logbuf_Mgmt(void);
+void logbuf_power_fail(void);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __LOGSCHED_H__
+#define __LOGSCHED_H__
+
+#define LOGSCHED_CONFIG_FILE		"TRACK.CFG"
+
+/* Default rules, overridden by the configuration file */
+#define LOGSCHED_MIN_DISTANCE		50		/* m */
+#define LOGSCHED_MAX_TIME			60		/* s */
+#define LOGSCHED_HEADING_DELTA		15		/* deg */
+#define LOGSCHED_SPEED_DELTA		500		/* cm/s */
+
+/* Bounds of the message 41 period requested from the receiver */
+#define LOGSCHED_FIX_PERIOD_MIN		1		/* s */
+#define LOGSCHED_FIX_PERIOD_MAX		10		/* s */
+/* A longer period is applied only beyond this above the current one */
+#define LOGSCHED_FIX_PERIOD_HYST	1		/* s */
+/* Between two period changes, except to the minimum period */
+#define LOGSCHED_RECONFIG_MIN		10		/* s */
+
+enum logsched_reason_n{
+	LOGSCHED_NONE = 0,
+	LOGSCHED_FIRST,
+	LOGSCHED_DISTANCE,
+	LOGSCHED_TIME,
+	LOGSCHED_HEADING,
+	LOGSCHED_SPEED
+};
+
+struct logsched_config_s{
+	uint16_t min_distance;
+	uint16_t max_time;
+	uint16_t heading_delta;
+	uint16_t speed_delta;
+};
+
+extern struct logsched_config_s logsched_config;
+
+void logsched_Init(void);
+int logsched_load_config(const char *path);
+enum logsched_reason_n logsched_update(void);
+void logsched_reset(void);
+uint8_t logsched_fix_period(void);
+uint32_t logsched_distance(int32_t lat, int32_t lon, int32_t lat0, int32_t lon0);
+
+#endif
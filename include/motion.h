@@ -0,0 +1,40 @@
+#ifndef __MOTION_H__
+#define __MOTION_H__
+
+/* Accelerometer window (samples, power of two) */
+#define MOTION_ACC_WINDOW			16
+/* Sum of the 3 axis variances [mg^2] above which the vehicle moves */
+#define MOTION_ACC_VARIANCE_MAX		400
+/* GPS horizontal speed [cm/s] above which the vehicle moves */
+#define MOTION_SPEED_MAX			80
+/* GPS position scatter [1e-7 deg] around the parking point */
+#define MOTION_SCATTER_MAX			2000
+/* Time the vehicle must stay quiet before being declared parked */
+#define MOTION_STATIONARY_DELAY		(120 * TICK_1S)
+/* Period of the heartbeat record while parked, doubled after each one */
+#define MOTION_HEARTBEAT_PERIOD		(600 * TICK_1S)
+#define MOTION_HEARTBEAT_PERIOD_MAX	(6 * 3600 * TICK_1S)
+
+enum motion_state_n{
+	MOTION_MOVING,
+	MOTION_STATIONARY
+};
+
+enum motion_event_n{
+	MOTION_EVENT_NONE,
+	MOTION_EVENT_STOPPED,
+	MOTION_EVENT_STARTED
+};
+
+extern enum motion_state_n motion_state;
+
+void motion_Init(void);
+void motion_Mgmt(void);
+enum motion_event_n motion_get_event(void);
+bool motion_logging_enabled(void);
+bool motion_heartbeat_due(void);
+uint32_t motion_time_in_state(enum motion_state_n state);
+uint32_t motion_transitions(void);
+void motion_print(void);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __NMEA_OUT_H__
+#define __NMEA_OUT_H__
+
+/* Sentences synthesized from the fix, for external equipment on USART1 */
+#define NMEA_OUT_RMC				0x01
+#define NMEA_OUT_GGA				0x02
+#define NMEA_OUT_VTG				0x04
+#define NMEA_OUT_ALL				(NMEA_OUT_RMC | NMEA_OUT_GGA | NMEA_OUT_VTG)
+
+#define NMEA_OUT_DEFAULT_PERIOD		(1 * TICK_1S)
+
+/* NMEA 0183 limit, '$' to '\n' included */
+#define NMEA_OUT_SENTENCE_MAX		82
+
+struct sim18_data_s;
+
+void nmea_out_Init(uint8_t selection, uint32_t period);
+void nmea_out_Mgmt(void);
+uint32_t nmea_out_dropped(void);
+uint8_t nmea_out_format(uint8_t sentence, const struct sim18_data_s *fix, char *buf);
+
+#endif
@@ -1,6 +1,16 @@
 #ifndef __SERIAL_FLASH_H
 #define __SERIAL_FLASH_H
 
+/*
+ * SPI NOR flash (M25P type) on SPI1, chip select PA4. Program and erase
+ * return as soon as the command is sent: the next access waits for the
+ * end of it, polling the status register and calling the yield hook in
+ * between. The chip is put in deep power-down by serial_flash_sleep() and
+ * woken up by the first access after it.
+ *
+ * host/sflashsim.c implements the same functions on the host.
+ */
+
 #define SF_WRITE_ENABLE          0x06
 #define SF_WRITE_DISABLE         0x04
 #define SF_READ_ID               0x9f
@@ -23,6 +33,14 @@
 
 #define SF_WRITE_IN_PROGRESS     0x01
 
+#define SF_PAGE_SIZE             256
+#define SF_SECTOR_SIZE           (~SF_SECTOR_MASK + 1)
+
+/* Return values of program and erase */
+#define SF_OK                    0
+#define SF_TIMEOUT               1		/* the previous program or erase did not end */
+#define SF_NO_CHIP               2
+
 #define SF_DONGLE_CODE           0xdd
 #define SF_DONGLE_DELTADORE_CODE 0xde
 #define SF_EMETTOR_CODE          0xee
@@ -51,21 +69,41 @@ typedef struct emettor_code_info_t emettor_code_info;
 
 struct flash_code_info_t {
   uint8_t type;
-  union {
+  union code_info_u {
     dongle_code_info bci;
     emettor_code_info eci;
-  };
+  } code;
   uint16_t hd_crc;
 } __attribute__((__packed__));
 
 typedef struct flash_code_info_t flash_code_info;
  
+struct serial_flash_stats_s{
+	uint32_t reads;
+	uint32_t read_bytes;
+	uint32_t pages;			/* page program commands */
+	uint32_t erases;		/* sector erases */
+	uint32_t wakeups;		/* deep power-down exits */
+	uint32_t busy_us;		/* waiting for program and erase ends */
+	uint32_t busy_max_us;
+	uint32_t timeouts;
+};
+
+extern struct serial_flash_stats_s serial_flash_stats;
+
+/* Called while the flash is busy programming or erasing, the bus is free */
+typedef void (*serial_flash_yield_hook)(void);
+
 void serial_flash_init(void);
 void serial_flash_read(uint32_t address, uint8_t *buf, uint16_t len);
 uint16_t serial_flash_readid(void);
+uint32_t serial_flash_size(void);
 uint8_t serial_flash_sector_erase(uint32_t address);
 uint8_t serial_flash_erase(void);
-uint8_t serial_flash_program(uint32_t address, uint8_t *buf, uint8_t len);
+uint8_t serial_flash_program(uint32_t address, const uint8_t *buf, uint16_t len);
+uint8_t serial_flash_busy(void);
+void serial_flash_sleep(void);
+void serial_flash_set_yield(serial_flash_yield_hook hook);
 uint8_t serial_flash_read_status(void);
 void serial_write_enable(void);
 void serial_write_disable(void);
@@ -75,6 +113,5 @@ uint8_t serial_flash_page_request(uint16_t page);
 uint8_t serial_flash_page(uint8_t *buf, uint16_t len);
 void serial_flash_wait_write(void);
 void serial_flash_spi_config(void);
-void cpu_reset(void);
 
 #endif
@@ -219,6 +219,7 @@ void SHT1x_Config(void);
 void SHT1x_Init(void);
 void SHT1x_acquire_data(void);
 void SHT1x_GetData(enum sht1x_data_n);
+int16_t SHT1x_get_data(enum sht1x_data_n data);
 
 //--------------------------------------------------
 // extern void SHT1x_StartMeasure();
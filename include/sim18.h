@@ -43,10 +43,10 @@ enum GPS_DATA{
 };
 
 struct coordonate_s{
-	char cardinal;
+	char cardinal;			/* '+' or '-' */
 	uint16_t degree;
 	uint16_t minute;
-	uint32_t dec_minute;
+	uint32_t dec_minute;	/* 1e-5 minute */
 };
 
 struct date_time_s{
@@ -55,7 +55,7 @@ struct date_time_s{
 	uint16_t year;
 	uint8_t hour;
 	uint8_t minute;
-	uint8_t seconde;
+	uint16_t seconde;		/* ms */
 	char date_str[20];
 	char time_str[20];
 };
@@ -64,7 +64,7 @@ struct sim18_data_s{
 	uint32_t lock;
 	struct coordonate_s latitude;
 	struct coordonate_s longitude;
-	uint16_t altitude;
+	int32_t altitude;		/* cm above MSL */
 	uint16_t azimuth;
 	uint16_t speed_horizontal;
 	uint16_t speed_vertical;
@@ -72,8 +72,10 @@ struct sim18_data_s{
 	uint16_t error_vertical;
 	struct date_time_s date_time;
 	uint32_t sat_number;
+	uint8_t hdop;			/* 0.2 unit */
 	char gps_mode;
 	uint8_t data_valide;
+	uint32_t fix_seq;		/* message 41 with a valid fix, counted */
 	uint32_t clk_drift;
 	uint32_t time_of_week;
 	uint32_t week_no;
@@ -99,11 +101,16 @@ struct sim18_serial_settings_s{
 
 
 /********** Low level functions	************/
-int sim18_init(void);
+void sim18_Init(void);
+bool sim18_awake(void);
 void sim18_Stop(void);
 void sim18_Configuration(void);
 void sim18_read_data(uint8_t read_value);
 void sim18_write_data(uint32_t length);
+void sim18_start_measure(void);
+void sim18_sleep(void);
+void sim18_get_fix(struct sim18_data_s *fix);
+int32_t sim18_coordonate(const struct coordonate_s *point);
 //--------------------------------------------------
 // void sim18_timer_istr(void);
 //-------------------------------------------------- 
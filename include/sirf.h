@@ -25,35 +25,56 @@
 #define SIRF_MSG_41_LON_INDEX									31
 #define SIRF_MSG_41_ALT_ELIPS_INDEX							35
 #define SIRF_MSG_41_ALT_MSL_INDEX							39
-#define SIRF_MSG_41_MAP_DATUM_INDEX							40
-#define SIRF_MSG_41_SPEED_OVER_GOURND_INDEX				41
-#define SIRF_MSG_41_COURSE_OVER_GROUND_INDEX				43
-#define SIRF_MSG_41_MAGNETIC_VARIATION_INDEX				45
-#define SIRF_MSG_41_CLIMB_RATE_INDEX						47
-#define SIRF_MSG_41_HEADING_RATE_INDEX						49
-#define SIRF_MSG_41_EST_HORIZONTAL_ERROR_INDEX			51
-#define SIRF_MSG_41_EST_VERTICAL_ERROR_INDEX				55
-#define SIRF_MSG_41_EST_TIME_ERROR_INDEX					59
-#define SIRF_MSG_41_EST_VELOCITY_ERROR_INDEX				63
-#define SIRF_MSG_41_CLOCK_BIAS_INDEX						65
-#define SIRF_MSG_41_CLOCK_BIAS_ERROR_INDEX				69
-#define SIRF_MSG_41_CLOCK_DRIFT_INDEX						73
-#define SIRF_MSG_41_CLOCK_DRIFT_ERROR_INDEX				77
-#define SIRF_MSG_41_DISTANCE_INDEX							81
-#define SIRF_MSG_41_DISTANCE_ERROR_INDEX					85
-#define SIRF_MSG_41_HEADING_ERROR_INDEX					87
-#define SIRF_MSG_41_NB_SV_IN_FIX_INDEX						89
-#define SIRF_MSG_41_HODP_INDEX								90
-#define SIRF_MSG_41_ADD_MODE_INFO_INDEX					91
+#define SIRF_MSG_41_MAP_DATUM_INDEX							43
+#define SIRF_MSG_41_SPEED_OVER_GOURND_INDEX				44
+#define SIRF_MSG_41_COURSE_OVER_GROUND_INDEX				46
+#define SIRF_MSG_41_MAGNETIC_VARIATION_INDEX				48
+#define SIRF_MSG_41_CLIMB_RATE_INDEX						50
+#define SIRF_MSG_41_HEADING_RATE_INDEX						52
+#define SIRF_MSG_41_EST_HORIZONTAL_ERROR_INDEX			54
+#define SIRF_MSG_41_EST_VERTICAL_ERROR_INDEX				58
+#define SIRF_MSG_41_EST_TIME_ERROR_INDEX					62
+#define SIRF_MSG_41_EST_VELOCITY_ERROR_INDEX				66
+#define SIRF_MSG_41_CLOCK_BIAS_INDEX						68
+#define SIRF_MSG_41_CLOCK_BIAS_ERROR_INDEX				72
+#define SIRF_MSG_41_CLOCK_DRIFT_INDEX						76
+#define SIRF_MSG_41_CLOCK_DRIFT_ERROR_INDEX				80
+#define SIRF_MSG_41_DISTANCE_INDEX							84
+#define SIRF_MSG_41_DISTANCE_ERROR_INDEX					88
+#define SIRF_MSG_41_HEADING_ERROR_INDEX					90
+#define SIRF_MSG_41_NB_SV_IN_FIX_INDEX						92
+#define SIRF_MSG_41_HODP_INDEX								93
+#define SIRF_MSG_41_ADD_MODE_INFO_INDEX					94
 
 
 
 
 
+/* Received frame queue, filled by the ISR and drained by the main loop */
+#define SIRF_QUEUE_SIZE				4
+#define SIRF_FRAME_MAX				128
+#define SIRF_DRAIN_FRAMES			1
+#define SIRF_DRAIN_BUDGET_US		500
+#define SIRF_DRAIN_BUDGET_US_MAX	4000
+
+struct sirf_queue_stats_s{
+	uint32_t processed;
+	uint32_t invalid;
+	uint32_t overflow;
+	uint8_t max_depth;
+	uint8_t budget_frames;
+	uint32_t budget_us;
+};
+
+extern struct sirf_queue_stats_s sirf_queue_stats;
+
 int sirf_add_crc(uint8_t * data, uint32_t length);
+int sirf_process_frames(void);
 int sirf_validate_sentence(void);
 void sirf_init( void );
 void sirf_stop(void);
+int sirf_set_msg_41_rate(uint8_t period);
+int sirf_set_msg_41_2s(void);
 void sirf_to_nmea(enum sim18_BAUDRATE baudrate);
 void sirf_get_frame(uint8_t data);
 int sirf_parse_data(void);
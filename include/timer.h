@@ -11,6 +11,7 @@ enum {
 char expire_timer(uint32_t last, uint32_t expire);
 uint32_t tick_1khz(void);
 void tick_increment(void);
+uint32_t tick_us(void);
 
 typedef uint32_t                        tick_t;
 
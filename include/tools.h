@@ -3,8 +3,8 @@
 
 void push_int32(unsigned char *buf, unsigned char *indice, unsigned int data);
 void push_int16(unsigned char *buf, unsigned char *indice, unsigned short data);
-void pop_int32(unsigned char *buf, unsigned char *indice, unsigned int *data);
-void pop_int16(unsigned char *buf, unsigned char *indice, unsigned short *data);
+void pop_int32(unsigned char *buf, int *indice, uint32_t *data);
+void pop_int16(unsigned char *buf, int *indice, unsigned short *data);
 void print_buf(unsigned char *buf, int len);
 void print_date(void);
 //--------------------------------------------------
@@ -0,0 +1,117 @@
+#ifndef __TRACK_H__
+#define __TRACK_H__
+
+/*
+ * Binary track log: one header sector followed by fixed size records,
+ * all little-endian. An integer number of records fits in a sector so a
+ * record never straddles two sectors.
+ *
+ * The record CRC starts from the header CRC and the record carries the
+ * low byte of its index, so after a power loss the records written past
+ * the last synced file size can be told from stale data left in the
+ * preallocated block and recovered.
+ *
+ * With TRACK_ENCODING_PACKED the data sectors hold packed items instead
+ * of fixed size records, see trackpack.h.
+ */
+
+#define TRACK_MAGIC					"TRAK"
+#define TRACK_VERSION				2
+#define TRACK_SECTOR_SIZE			512
+#define TRACK_HEADER_SIZE			TRACK_SECTOR_SIZE
+#define TRACK_RECORD_SIZE			32
+#define TRACK_RECORDS_PER_SECTOR	(TRACK_SECTOR_SIZE / TRACK_RECORD_SIZE)
+
+/* Data sector encodings */
+#define TRACK_ENCODING_FIXED		0
+#define TRACK_ENCODING_PACKED		1
+
+/* Encoding of new files, TRACK.CFG "encoding" overrides it */
+#define TRACK_ENCODING_DEFAULT		TRACK_ENCODING_FIXED
+
+/* Cluster link map of the open track file, two items per fragment */
+#define TRACK_LINKMAP_SIZE			32
+
+/* Contiguous block allocated to a new file: a day at one record per second */
+#define TRACK_PREALLOC_SIZE			(TRACK_HEADER_SIZE + 86400UL * TRACK_RECORD_SIZE)
+
+/* Header offsets */
+#define TRACK_HDR_MAGIC				0
+#define TRACK_HDR_VERSION			4
+#define TRACK_HDR_RECORD_SIZE		6
+#define TRACK_HDR_RECORDS_PER_SECTOR	8
+#define TRACK_HDR_HEADER_SIZE		10
+#define TRACK_HDR_CREATED			12
+#define TRACK_HDR_SERIAL			16
+#define TRACK_HDR_ENCODING			28
+#define TRACK_HDR_CRC				30
+
+/* Record offsets */
+#define TRACK_REC_TIME				0
+#define TRACK_REC_LATITUDE			4
+#define TRACK_REC_LONGITUDE			8
+#define TRACK_REC_ALTITUDE			12
+#define TRACK_REC_SPEED				16
+#define TRACK_REC_COURSE			18
+#define TRACK_REC_SAT_NUMBER		20
+#define TRACK_REC_HDOP				21
+#define TRACK_REC_TEMPERATURE		22
+#define TRACK_REC_HUMIDITY			24
+#define TRACK_REC_BATTERY			26
+#define TRACK_REC_FLAGS				28
+#define TRACK_REC_SEQ				29
+#define TRACK_REC_CRC				30
+
+/* Record flags, the log scheduler reason is in the high nibble */
+#define TRACK_FLAG_FIX				0x01
+#define TRACK_FLAG_HEARTBEAT		0x02
+#define TRACK_FLAG_STATIONARY		0x04
+#define TRACK_FLAG_REASON(r)		(((r) & 0x0F) << 4)
+
+struct track_point_s{
+	uint32_t time;			/* s since 2000-01-01 (RTC) */
+	int32_t latitude;		/* 1e-7 deg */
+	int32_t longitude;		/* 1e-7 deg */
+	int32_t altitude;		/* cm above MSL */
+	uint16_t speed;			/* cm/s */
+	uint16_t course;		/* 1e-2 deg */
+	uint8_t sat_number;
+	uint8_t hdop;			/* 0.2 unit */
+	int16_t temperature;	/* 1e-2 deg C */
+	uint16_t humidity;		/* 1e-2 %RH */
+	uint16_t battery;		/* mV */
+	uint8_t flags;
+	uint8_t seq;			/* record index, low byte */
+};
+
+/* Running summary of the open file, for the index */
+struct track_summary_s{
+	uint32_t start;			/* time of the first record */
+	uint32_t end;			/* time of the last record */
+	uint32_t records;
+	uint32_t fixes;			/* records with a fix, the box is empty without */
+	int32_t lat_min;		/* bounding box of the fixes, 1e-7 deg */
+	int32_t lat_max;
+	int32_t lon_min;
+	int32_t lon_max;
+	uint32_t distance;		/* m, between consecutive fixes */
+	int32_t latitude;		/* last fix */
+	int32_t longitude;
+};
+
+struct sim18_data_s;
+
+uint16_t track_crc(const uint8_t *data, uint16_t length);
+void track_header_encode(uint8_t *sector, uint16_t encoding);
+int track_header_check(const uint8_t *sector);
+void track_encode(const struct track_point_s *point, uint8_t *record, uint16_t seed);
+int track_decode(const uint8_t *record, struct track_point_s *point, uint16_t seed);
+void track_fill(struct track_point_s *point, const struct sim18_data_s *fix, uint8_t flags);
+
+void track_set_encoding(uint16_t encoding);
+int track_open(const char *path);
+int track_write(struct track_point_s *point);
+int track_close(void);
+const struct track_summary_s *track_summary(void);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __TRACKIDX_H__
+#define __TRACKIDX_H__
+
+/*
+ * Daily track files and their index. A file per local day, named
+ * YYYYMMDD.TRK, and an index file with one fixed size entry per closed
+ * track file, appended on rotation, all little-endian. When the free
+ * space falls under TRACKIDX_MIN_FREE the oldest files are deleted and
+ * their entries marked, the entries themselves are kept.
+ */
+
+#define TRACKIDX_FILE_NAME			"TRACK.IDX"
+#define TRACKIDX_TRACK_EXT			".TRK"
+#define TRACKIDX_NAME_SIZE			13		/* YYYYMMDD.TRK + '\0' */
+
+#define TRACKIDX_ENTRY_SIZE			64
+
+/* Free space kept on the card: the blocks of the next two days */
+#define TRACKIDX_MIN_FREE			(2 * TRACK_PREALLOC_SIZE)
+
+/* Entry offsets */
+#define TRACKIDX_ENT_NAME			0
+#define TRACKIDX_ENT_START			16
+#define TRACKIDX_ENT_END			20
+#define TRACKIDX_ENT_RECORDS		24
+#define TRACKIDX_ENT_FIXES			28
+#define TRACKIDX_ENT_LAT_MIN		32
+#define TRACKIDX_ENT_LAT_MAX		36
+#define TRACKIDX_ENT_LON_MIN		40
+#define TRACKIDX_ENT_LON_MAX		44
+#define TRACKIDX_ENT_DISTANCE		48
+#define TRACKIDX_ENT_FLAGS			52
+#define TRACKIDX_ENT_CRC			62
+
+/* Entry flags */
+#define TRACKIDX_FLAG_DELETED		0x0001
+
+struct trackidx_entry_s{
+	char name[TRACKIDX_NAME_SIZE];
+	uint16_t flags;
+	struct track_summary_s summary;		/* last fix fields unused */
+};
+
+int trackidx_Init(void);
+void trackidx_Mgmt(void);
+int trackidx_rotate(void);
+int trackidx_find(uint32_t from, uint32_t to, uint16_t *next, struct trackidx_entry_s *entry);
+
+#endif
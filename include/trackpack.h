@@ -0,0 +1,49 @@
+#ifndef __TRACKPACK_H__
+#define __TRACKPACK_H__
+
+/*
+ * Packed track encoding (TRACK_ENCODING_PACKED). Data sectors hold whole
+ * items, zero padded, and start with a key so each sector decodes on its
+ * own and the recovery can test it like a record.
+ *
+ * Key:   TRACKPACK_TAG_KEY, then a fixed size record.
+ * Delta: TRACKPACK_TAG_DELTA | mask, zigzag varint deltas to the previous
+ *        point of time, latitude, longitude, altitude, speed and course,
+ *        then the fields flagged in the mask, in mask bit order: sat
+ *        number, hdop and flags as raw bytes, the others as deltas.
+ * End:   TRACKPACK_TAG_END, nothing follows in the sector.
+ *
+ * A fix a second at walking speed packs to about 9 bytes instead of 32.
+ */
+
+#define TRACKPACK_TAG_END			0x00
+#define TRACKPACK_TAG_KEY			0x01
+#define TRACKPACK_TAG_DELTA			0x80
+
+/* Delta mask */
+#define TRACKPACK_SAT_NUMBER		0x01
+#define TRACKPACK_HDOP				0x02
+#define TRACKPACK_TEMPERATURE		0x04
+#define TRACKPACK_HUMIDITY			0x08
+#define TRACKPACK_BATTERY			0x10
+#define TRACKPACK_FLAGS				0x20
+#define TRACKPACK_MASK				0x3F
+
+/* Records between keys inside a sector */
+#define TRACKPACK_KEY_PERIOD		64
+
+/* Largest item: a tag, four 32 bit and five 16 bit varints, three bytes */
+#define TRACKPACK_ITEM_MAX			(1 + 4 * 5 + 5 * 3 + 3)
+
+struct trackpack_s{
+	struct track_point_s last;	/* reference of the next delta */
+	uint16_t used;				/* bytes of the current sector */
+	uint8_t since_key;			/* deltas since the last key */
+};
+
+uint8_t trackpack_encode(struct trackpack_s *pack, const struct track_point_s *point,
+		uint8_t *item, uint16_t seed);
+int trackpack_decode(struct trackpack_s *pack, const uint8_t *sector,
+		struct track_point_s *point, uint16_t seed);
+
+#endif
@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "timer.h"
+#include "ff.h"
+#include "diskio.h"
+#include "logbuf.h"
+#include "flashlog.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+struct logbuf_stats_s logbuf_stats;
+
+static uint8_t ring[LOGBUF_SECTORS][LOGBUF_SECTOR_SIZE];
+static FIL *log_file = NULL;
+
+/*
+ * Full sectors are flush_sector .. flush_sector + full - 1, the sector
+ * being filled follows them. The file pointer always sits at the start
+ * of the first sector not yet written.
+ *
+ * With the flash store, full sectors are staged there instead and the
+ * ring keeps the sector being filled only. The staged sectors come first
+ * in the file, before the sector being filled.
+ */
+static uint8_t flush_sector;
+static uint8_t fill_sector;
+static uint8_t full;
+static uint16_t fill_len;
+/* Bytes of the sector being filled already written by a partial flush */
+static uint16_t on_disk;
+/* Full sectors in the flash store, and on_disk is in the store only */
+static uint16_t staged;
+static bool fill_staged;
+static tick_t drained_at;
+/* Full sectors handed to disk_write_async(), the first ones of the run */
+static uint8_t inflight;
+/* Or bytes of the sector being filled, it must not change meanwhile */
+static uint16_t inflight_fill;
+static volatile bool async_done;
+static volatile DRESULT async_res;
+
+static tick_t dirty_since;
+static volatile bool power_warning = FALSE;
+/* Data on the card the directory entry does not cover yet */
+static bool unsynced;
+static tick_t synced_at;
+
+static uint8_t flush_sectors = LOGBUF_FLUSH_SECTORS;
+static uint32_t flush_period = LOGBUF_FLUSH_PERIOD;
+static uint32_t sync_period = LOGBUF_SYNC_PERIOD;
+
+static bool logbuf_dirty(void){
+	return (full != 0 || fill_len > on_disk);
+}
+
+/*
+ * Hand the file to the ring. A partial last sector is read back so the
+ * file pointer can stay sector aligned.
+ */
+int logbuf_Init(FIL *file){
+	DWORD start;
+	UINT br;
+
+	log_file = NULL;
+	flush_sector = fill_sector = full = 0;
+	on_disk = 0;
+	staged = 0;
+	fill_staged = FALSE;
+	inflight = 0;
+	inflight_fill = 0;
+	async_done = FALSE;
+	unsynced = FALSE;
+	synced_at = drained_at = tick_1khz();
+	memset(ring[0], 0, LOGBUF_SECTOR_SIZE);
+
+	fill_len = file->fptr % LOGBUF_SECTOR_SIZE;
+	if (fill_len) {
+		start = file->fptr - fill_len;
+		if (f_lseek(file, start) != FR_OK
+				|| f_read(file, ring[0], fill_len, &br) != FR_OK || br != fill_len
+				|| f_lseek(file, start) != FR_OK) {
+			return -1;
+		}
+		on_disk = fill_len;
+	}
+
+	log_file = file;
+	return 0;
+}
+
+/*
+ * Flush when flush_sectors sectors are full or the oldest data is
+ * flush_period old, update the directory entry every sync_period.
+ */
+void logbuf_policy(uint8_t sectors, uint32_t period, uint32_t sync){
+	if (sectors < 1) {
+		sectors = 1;
+	}
+	if (sectors > LOGBUF_SECTORS) {
+		sectors = LOGBUF_SECTORS;
+	}
+	flush_sectors = sectors;
+	flush_period = period;
+	sync_period = sync;
+}
+
+/* Full sectors at flush_sector that are contiguous in the ring */
+static uint8_t logbuf_run(void){
+	uint8_t n;
+
+	n = LOGBUF_SECTORS - flush_sector;
+	if (n > full) {
+		n = full;
+	}
+	return n;
+}
+
+static void logbuf_written(uint8_t n){
+	logbuf_stats.writes++;
+	logbuf_stats.sectors += n;
+	flush_sector = (flush_sector + n) % LOGBUF_SECTORS;
+	full -= n;
+	unsynced = TRUE;
+}
+
+/* Called from disk_async_poll(), possibly inside a FatFs call: flags only */
+static void logbuf_async_done(DRESULT res){
+	async_res = res;
+	async_done = TRUE;
+}
+
+/*
+ * Start writing the run straight to its sectors when the file has a
+ * contiguous block, return -1 when the run has to go through f_write().
+ */
+static int logbuf_async_start(void){
+	uint8_t n = logbuf_run();
+	DWORD sect;
+
+	sect = f_contig_sect(log_file, n);
+	if (sect == 0
+			|| disk_write_async(log_file->fs->drive, ring[flush_sector], sect, n,
+				logbuf_async_done) != RES_OK) {
+		return -1;
+	}
+	inflight = n;
+	return 0;
+}
+
+/*
+ * Start writing the sector being filled to its place in the file, past
+ * the file size, return -1 when there is no contiguous block.
+ */
+static int logbuf_async_fill(void){
+	DWORD sect;
+
+	sect = f_contig_sect(log_file, 1);
+	if (sect == 0
+			|| disk_write_async(log_file->fs->drive, ring[fill_sector], sect, 1,
+				logbuf_async_done) != RES_OK) {
+		return -1;
+	}
+	inflight_fill = fill_len;
+	return 0;
+}
+
+/*
+ * Account for a finished asynchronous write: 1 while it still runs, -1
+ * on error, the sectors then stay queued for f_write().
+ */
+static int logbuf_async_end(bool wait){
+	uint8_t n = inflight;
+	uint16_t fill = inflight_fill;
+
+	if (n == 0 && fill == 0) {
+		return 0;
+	}
+	if (wait) {
+		while (disk_async_poll()) {
+		}
+	}
+	if (async_done == FALSE) {
+		return 1;
+	}
+	async_done = FALSE;
+	inflight = 0;
+	inflight_fill = 0;
+
+	if (n == 0) {
+		/* The file pointer stays at the start of the sector being filled */
+		if (async_res != RES_OK) {
+			logbuf_stats.errors++;
+			return -1;
+		}
+		logbuf_stats.writes++;
+		on_disk = fill;
+		fill_staged = FALSE;
+		unsynced = TRUE;
+		return 0;
+	}
+	if (async_res != RES_OK
+			|| f_lseek(log_file, log_file->fptr + n * LOGBUF_SECTOR_SIZE) != FR_OK) {
+		logbuf_stats.errors++;
+		return -1;
+	}
+	logbuf_written(n);
+	return 0;
+}
+
+/* Copy the sector being filled to the flash store, fill bytes of it are data */
+static int logbuf_stage(uint16_t fill){
+	return flashlog_append(ring[fill_sector], fill, log_file,
+			log_file->fptr / LOGBUF_SECTOR_SIZE + staged);
+}
+
+/*
+ * Stream n staged sectors straight to their card sectors, a flash read
+ * per block through the ring slot after the sector being filled.
+ */
+static int logbuf_drain_stream(DWORD sect, uint8_t n){
+	uint8_t *buf = ring[(fill_sector + 1) % LOGBUF_SECTORS];
+	BYTE drv = log_file->fs->drive;
+	uint8_t i;
+
+	if (disk_write_begin(drv, sect, n) != RES_OK) {
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		/* A damaged entry still takes its place in the file */
+		if (flashlog_read(buf)) {
+			memset(buf, 0, LOGBUF_SECTOR_SIZE);
+			logbuf_stats.errors++;
+		}
+		if (disk_write_block(drv, buf) != RES_OK) {
+			disk_write_end(drv);
+			return -1;
+		}
+	}
+	if (disk_write_end(drv) != RES_OK
+			|| f_lseek(log_file, log_file->fptr + n * LOGBUF_SECTOR_SIZE) != FR_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Without a contiguous block: f_write() the free ring slots, n of them */
+static int logbuf_drain_ring(uint8_t n){
+	uint8_t i;
+	UINT bw;
+
+	if (fill_sector) {
+		memcpy(ring[0], ring[fill_sector], LOGBUF_SECTOR_SIZE);
+		fill_sector = flush_sector = 0;
+	}
+	for (i = 1; i <= n; i++) {
+		if (flashlog_read(ring[i])) {
+			memset(ring[i], 0, LOGBUF_SECTOR_SIZE);
+			logbuf_stats.errors++;
+		}
+	}
+	if (f_write(log_file, ring[1], n * LOGBUF_SECTOR_SIZE, &bw) != FR_OK
+			|| bw != n * LOGBUF_SECTOR_SIZE) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Move the staged sectors to the card, in one multiple block write per
+ * 255 sectors inside the block of f_expand(). The directory entry is
+ * left to the caller.
+ */
+static int logbuf_drain(void){
+	uint8_t n;
+	DWORD sect;
+	int res;
+
+	if (staged == 0) {
+		return 0;
+	}
+	/* Sectors queued in the ring come after the staged ones */
+	if (full) {
+		return -1;
+	}
+
+	while (staged) {
+		n = (staged < 255) ? staged : 255;
+		sect = f_contig_sect(log_file, n);
+		if (sect) {
+			res = logbuf_drain_stream(sect, n);
+		} else {
+			n = (staged < LOGBUF_SECTORS - 1) ? staged : LOGBUF_SECTORS - 1;
+			res = logbuf_drain_ring(n);
+		}
+		if (res) {
+			flashlog_rewind();
+			logbuf_stats.errors++;
+			return -2;
+		}
+		flashlog_release();
+		logbuf_stats.writes++;
+		logbuf_stats.sectors += n;
+		staged -= n;
+		unsynced = TRUE;
+	}
+	flashlog_drained();
+	logbuf_stats.drains++;
+	drained_at = tick_1khz();
+	return 0;
+}
+
+/* Write the full sectors, one f_write() per contiguous run of the ring */
+static int logbuf_write_sectors(void){
+	uint8_t n;
+	UINT bw;
+
+	logbuf_async_end(TRUE);
+	if (logbuf_drain()) {
+		return -1;
+	}
+
+	while (full) {
+		n = logbuf_run();
+		if (f_write(log_file, ring[flush_sector], n * LOGBUF_SECTOR_SIZE, &bw) != FR_OK
+				|| bw != n * LOGBUF_SECTOR_SIZE) {
+			logbuf_stats.errors++;
+			return -1;
+		}
+		logbuf_written(n);
+	}
+	return 0;
+}
+
+/* The sector being filled is full: to the flash store, or to the next one */
+static int logbuf_next_sector(void){
+	int res;
+
+	if (flashlog_ready()) {
+		res = logbuf_stage(LOGBUF_SECTOR_SIZE);
+		if (res == -1 && logbuf_drain() == 0) {
+			res = logbuf_stage(LOGBUF_SECTOR_SIZE);
+		}
+		if (res == 0) {
+			logbuf_stats.staged++;
+			staged++;
+			fill_len = 0;
+			on_disk = 0;
+			fill_staged = FALSE;
+			return 0;
+		}
+	}
+	/* The flash failed, what it holds goes first */
+	if (logbuf_drain()) {
+		return -1;
+	}
+
+	full++;
+	fill_len = 0;
+	on_disk = 0;
+	fill_staged = FALSE;
+	fill_sector = (fill_sector + 1) % LOGBUF_SECTORS;
+	/* Ring full, no choice but to write now */
+	if (full == LOGBUF_SECTORS && logbuf_write_sectors()) {
+		return -1;
+	}
+	return 0;
+}
+
+int logbuf_write(const uint8_t *data, uint16_t length){
+	uint16_t n;
+
+	if (log_file == NULL) {
+		return -1;
+	}
+	if (inflight_fill) {
+		logbuf_async_end(TRUE);
+	}
+
+	while (length) {
+		if (logbuf_dirty() == FALSE) {
+			dirty_since = tick_1khz();
+		}
+		/* No stale records behind the data of a partial sector write */
+		if (fill_len == 0) {
+			memset(ring[fill_sector], 0, LOGBUF_SECTOR_SIZE);
+		}
+
+		n = LOGBUF_SECTOR_SIZE - fill_len;
+		if (n > length) {
+			n = length;
+		}
+		memcpy(&ring[fill_sector][fill_len], data, n);
+		fill_len += n;
+		data += n;
+		length -= n;
+
+		if (fill_len == LOGBUF_SECTOR_SIZE && logbuf_next_sector()) {
+			return -2;
+		}
+	}
+	return 0;
+}
+
+/* Close the sector being filled, the rest of it stays zero */
+int logbuf_pad(void){
+	if (log_file == NULL) {
+		return -1;
+	}
+	if (inflight_fill) {
+		logbuf_async_end(TRUE);
+	}
+	if (fill_len == 0) {
+		return 0;
+	}
+	fill_len = LOGBUF_SECTOR_SIZE;
+	return logbuf_next_sector() ? -2 : 0;
+}
+
+/*
+ * Write everything, the partial sector included, and update the
+ * directory entry. The partial sector is rewritten whole once full.
+ */
+int logbuf_flush(void){
+	UINT bw;
+
+	if (log_file == NULL) {
+		return -1;
+	}
+	if (logbuf_write_sectors()) {
+		return -2;
+	}
+
+	if (fill_len > on_disk || fill_staged) {
+		if (f_write(log_file, ring[fill_sector], fill_len, &bw) != FR_OK
+				|| bw != fill_len
+				|| f_lseek(log_file, log_file->fptr - fill_len) != FR_OK) {
+			logbuf_stats.errors++;
+			return -3;
+		}
+		logbuf_stats.writes++;
+		on_disk = fill_len;
+		fill_staged = FALSE;
+	}
+
+	if (f_sync(log_file) != FR_OK) {
+		logbuf_stats.errors++;
+		return -4;
+	}
+	logbuf_stats.flushes++;
+	unsynced = FALSE;
+	synced_at = tick_1khz();
+	return 0;
+}
+
+/*
+ * Write everything but leave the directory entry alone: the partial
+ * sector goes whole to its place in the file, past the file size, and
+ * is found again on open after a power loss. Without a sector for it yet
+ * this is a full logbuf_flush(). With the flash store it is copied there.
+ *
+ * With async, the writes inside the contiguous block are only started:
+ * the full sectors first, the partial one on the next call.
+ */
+static int logbuf_flush_data(bool async){
+	DWORD sect;
+
+	logbuf_async_end(TRUE);
+	if (fill_len > on_disk && full == 0 && flashlog_ready() && logbuf_stage(fill_len) == 0) {
+		on_disk = fill_len;
+		fill_staged = TRUE;
+		return 0;
+	}
+	if (async && full && logbuf_async_start() == 0) {
+		return 0;
+	}
+	if (logbuf_write_sectors()) {
+		return -2;
+	}
+	if (fill_len == on_disk) {
+		return 0;
+	}
+	if (async && logbuf_async_fill() == 0) {
+		return 0;
+	}
+
+	sect = f_contig_sect(log_file, 1);
+	if (sect == 0) {
+		return logbuf_flush();
+	}
+	if (disk_write(log_file->fs->drive, ring[fill_sector], sect, 1) != RES_OK) {
+		logbuf_stats.errors++;
+		return -3;
+	}
+	logbuf_stats.writes++;
+	on_disk = fill_len;
+	fill_staged = FALSE;
+	unsynced = TRUE;
+	return 0;
+}
+
+/*
+ * Apply the flush policy, called from the main loop. The flash store is
+ * drained every drain period or once LOGBUF_DRAIN_FILL percent full.
+ */
+void logbuf_Mgmt(void){
+	if (log_file == NULL) {
+		return;
+	}
+	flashlog_idle();
+
+	if (logbuf_async_end(FALSE) > 0 && power_warning == FALSE) {
+		return;
+	}
+
+	/* Data only: a directory sector torn by the power loss costs more */
+	if (power_warning) {
+		power_warning = FALSE;
+		logbuf_stats.power_fail++;
+		logbuf_flush_data(FALSE);
+	} else if ((staged || fill_staged) && (flashlog_fill() >= LOGBUF_DRAIN_FILL
+			|| expire_timer(drained_at, LOGBUF_DRAIN_PERIOD))) {
+		logbuf_flush();
+	} else if (full >= flush_sectors) {
+		if (logbuf_async_start()) {
+			logbuf_write_sectors();
+		}
+	} else if (logbuf_dirty() && expire_timer(dirty_since, flush_period)) {
+		logbuf_flush_data(TRUE);
+	} else if (unsynced && expire_timer(synced_at, sync_period)) {
+		logbuf_flush();
+	}
+}
+
+/* Called from the PVD interrupt, the flush itself runs in the main loop */
+void logbuf_power_fail(void){
+	power_warning = TRUE;
+}
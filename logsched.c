@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "stm32f10x.h"
+
+#include "logsched.h"
+#include "sim18.h"
+#include "sirf.h"
+#include "track.h"
+#include "timer.h"
+#include "ff.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+#define DEG_TO_RAD		(3.14159265f / 180.0f)
+
+struct logsched_config_s logsched_config = {
+	LOGSCHED_MIN_DISTANCE,
+	LOGSCHED_MAX_TIME,
+	LOGSCHED_HEADING_DELTA,
+	LOGSCHED_SPEED_DELTA
+};
+
+/* Snapshot of the last logged fix */
+static struct {
+	bool valid;
+	tick_t tick;
+	int32_t latitude;		/* 1e-7 deg */
+	int32_t longitude;		/* 1e-7 deg */
+	uint16_t azimuth;		/* 1e-2 deg */
+	uint16_t speed;			/* cm/s */
+} last;
+
+static uint8_t fix_period = LOGSCHED_FIX_PERIOD_MIN;
+static tick_t fix_period_tick;		/* last change of fix_period */
+static uint32_t fix_seq;			/* gps_mydata.fix_seq of the last fix looked at */
+
+static int32_t logsched_abs(int32_t v){
+	return (v < 0) ? -v : v;
+}
+
+/*
+ * Distance in metres between two points, coordinates in 1e-7 deg.
+ * Equirectangular projection and octagonal norm, good to a few percent
+ * over the distances between two logged fixes.
+ * One 1e-7 degree of latitude is 1.11 cm, hence the / 90.
+ */
+uint32_t logsched_distance(int32_t lat, int32_t lon, int32_t lat0, int32_t lon0){
+	uint32_t dy, dx;
+
+	dy = logsched_abs(lat - lat0) / 90;
+	dx = (uint32_t)(logsched_abs(lon - lon0)
+			* cosf((float)lat * 1e-7f * DEG_TO_RAD)) / 90;
+
+	return (dx > dy) ? (dx + dy / 2) : (dy + dx / 2);
+}
+
+/* Smallest angle between two courses, both in 1e-2 deg */
+static uint16_t logsched_heading_delta(uint16_t a, uint16_t b){
+	uint16_t delta = (a > b) ? (a - b) : (b - a);
+
+	if (delta > 18000) {
+		delta = 36000 - delta;
+	}
+	return delta;
+}
+
+/*
+ * Message 41 period: fast enough to see the next distance trigger
+ * twice, 1 s while turning, never longer than half the max time.
+ * Each change is a message to the receiver: a longer period must be
+ * more than LOGSCHED_FIX_PERIOD_HYST above the current one, so a speed
+ * around a step does not flip it at every fix, and changes are at least
+ * LOGSCHED_RECONFIG_MIN apart, except going to the minimum period.
+ */
+static void logsched_adapt_fix_period(uint16_t speed, uint16_t heading_delta){
+	uint32_t period = LOGSCHED_FIX_PERIOD_MAX;
+
+	if (speed > 0) {
+		period = (uint32_t)logsched_config.min_distance * 100 / speed / 2;
+	}
+	if (period > logsched_config.max_time / 2) {
+		period = logsched_config.max_time / 2;
+	}
+	if (heading_delta * 2 > logsched_config.heading_delta * 100) {
+		period = LOGSCHED_FIX_PERIOD_MIN;
+	}
+	if (period < LOGSCHED_FIX_PERIOD_MIN) {
+		period = LOGSCHED_FIX_PERIOD_MIN;
+	}
+	if (period > LOGSCHED_FIX_PERIOD_MAX) {
+		period = LOGSCHED_FIX_PERIOD_MAX;
+	}
+
+	if (period == fix_period) {
+		return;
+	}
+	if (period > fix_period && period <= fix_period + LOGSCHED_FIX_PERIOD_HYST) {
+		return;
+	}
+	if (period != LOGSCHED_FIX_PERIOD_MIN
+			&& !expire_timer(fix_period_tick, LOGSCHED_RECONFIG_MIN * TICK_1S)) {
+		return;
+	}
+
+	fix_period = period;
+	fix_period_tick = tick_1khz();
+	DEBUGF("Logsched: fix period %ds.\n", fix_period);
+	sirf_set_msg_41_2s();
+}
+
+void logsched_Init(void){
+	logsched_reset();
+	fix_period = LOGSCHED_FIX_PERIOD_MIN;
+	fix_period_tick = tick_1khz();
+}
+
+/* Forget the last snapshot, the next fix is logged */
+void logsched_reset(void){
+	last.valid = FALSE;
+}
+
+uint8_t logsched_fix_period(void){
+	return fix_period;
+}
+
+/*
+ * Read "key=value" lines from the configuration file.
+ * Unknown keys and comments ('#') are ignored.
+ */
+int logsched_load_config(const char *path){
+	FIL file;
+	char line[48];
+	char *value;
+	uint32_t n;
+
+	if (f_open(&file, path, FA_READ) != FR_OK) {
+		DEBUGF("Logsched: no %s, using defaults.\n", path);
+		return -1;
+	}
+
+	while (f_gets(line, sizeof(line), &file)) {
+		if (line[0] == '#') {
+			continue;
+		}
+		for (value = line; *value && *value != '='; value++);
+		if (*value == '\0') {
+			continue;
+		}
+		*value++ = '\0';
+		for (n = 0; *value >= '0' && *value <= '9'; value++) {
+			n = n * 10 + (*value - '0');
+		}
+
+		if (strcmp(line, "min_distance") == 0) {
+			logsched_config.min_distance = n;
+		} else if (strcmp(line, "max_time") == 0 && n > 0) {
+			logsched_config.max_time = n;
+		} else if (strcmp(line, "heading_delta") == 0) {
+			logsched_config.heading_delta = n;
+		} else if (strcmp(line, "speed_delta") == 0) {
+			logsched_config.speed_delta = n;
+		} else if (strcmp(line, "encoding") == 0) {
+			track_set_encoding(n);
+		}
+	}
+	f_close(&file);
+
+	DEBUGF("Logsched: %dm, %ds, %ddeg, %dcm/s.\n",
+			logsched_config.min_distance, logsched_config.max_time,
+			logsched_config.heading_delta, logsched_config.speed_delta);
+	return 0;
+}
+
+/*
+ * Take a snapshot of the current fix and tell whether it must be logged.
+ * On a positive answer the fix becomes the reference for the next call.
+ * Each fix is looked at once: the main loop runs faster than message 41
+ * comes, and after a fix loss the last one would be logged again.
+ */
+enum logsched_reason_n logsched_update(void){
+	enum logsched_reason_n reason = LOGSCHED_NONE;
+	int32_t lat, lon;
+	uint16_t heading_delta, speed_delta;
+
+	if (gps_mydata.data_valide != 0 || gps_mydata.lock
+			|| gps_mydata.fix_seq == fix_seq) {
+		return LOGSCHED_NONE;
+	}
+	fix_seq = gps_mydata.fix_seq;
+
+	lat = sim18_coordonate(&gps_mydata.latitude);
+	lon = sim18_coordonate(&gps_mydata.longitude);
+
+	if (last.valid == FALSE) {
+		reason = LOGSCHED_FIRST;
+		heading_delta = 0;
+	} else {
+		heading_delta = logsched_heading_delta(gps_mydata.azimuth, last.azimuth);
+		speed_delta = (gps_mydata.speed_horizontal > last.speed)
+			? gps_mydata.speed_horizontal - last.speed
+			: last.speed - gps_mydata.speed_horizontal;
+
+		if (expire_timer(last.tick, logsched_config.max_time * TICK_1S)) {
+			reason = LOGSCHED_TIME;
+		} else if (logsched_distance(lat, lon, last.latitude, last.longitude)
+				>= logsched_config.min_distance) {
+			reason = LOGSCHED_DISTANCE;
+		} else if (heading_delta >= logsched_config.heading_delta * 100) {
+			reason = LOGSCHED_HEADING;
+		} else if (speed_delta >= logsched_config.speed_delta) {
+			reason = LOGSCHED_SPEED;
+		}
+	}
+
+	logsched_adapt_fix_period(gps_mydata.speed_horizontal, heading_delta);
+
+	if (reason != LOGSCHED_NONE) {
+		last.valid = TRUE;
+		last.tick = tick_1khz();
+		last.latitude = lat;
+		last.longitude = lon;
+		last.azimuth = gps_mydata.azimuth;
+		last.speed = gps_mydata.speed_horizontal;
+	}
+	return reason;
+}
@@ -14,6 +14,21 @@
 #include "clock_calendar.h"
 #include "button.h"
 #include "sht1x.h"
+#include "motion.h"
+#include "logsched.h"
+#include "gpsstat.h"
+#include "nmea_out.h"
+#include "sim18.h"
+#include "sirf.h"
+#include "track.h"
+#include "trackidx.h"
+#include "ff.h"
+#include "diskio.h"
+#include "logbuf.h"
+#include "flashlog.h"
+#include "serial_flash.h"
+#include "download.h"
+#include "eeprom.h"
 
 #include "version.h"
 
@@ -24,10 +39,14 @@
 #define DEBUGF(x, args...)
 #endif
 
+#define MAIN_LOOP_PERIOD		1250
+
 // Remote request reset
 static bool request_reset = 0;
 static bool request_sleep = 0;
 
+static FATFS fatfs;
+
 void reset_request()
 {
   request_reset = 1;
@@ -38,11 +57,23 @@ void sleep_request()
  request_sleep = 1;
 }
 
+/* SD card or serial flash busy: keep the GPS queue drained, the storage
+ * drivers and FatFs are in use */
+static void main_io_yield(void)
+{
+	if (sirf_process_frames() == 0) {
+		__WFI();
+	}
+}
+
 
 int main(void)
 {
 	uint32_t len = 1;
 	tick_t timer = 0;
+	tick_t loop_start;
+	struct sim18_data_s fix;
+	struct track_point_s point;
 	/*--------------------------------------------------
 	* bool clock_speed = FAST;
 	*--------------------------------------------------*/
@@ -53,26 +84,102 @@ int main(void)
 
 	SHT1x_Init();
 
+	/* Before the receiver starts, the start type guess needs the last fix */
+	EE_Init();
+	gpsstat_Init();
+	motion_Init();
+
+	serial_flash_init();
+	serial_flash_set_yield(main_io_yield);
+	disk_set_yield(main_io_yield);
+	f_mount(0, &fatfs);
+	flashlog_Init();
+	logsched_Init();
+	logsched_load_config(LOGSCHED_CONFIG_FILE);
+	trackidx_Init();
+	flashlog_start();
+	download_Init();
+
 	printf("STM32 NROSSERO (C) 2011\n");
 	printf("Boussole Version %d.%d / %s @ %s\n", 
 			VERSION_MAJOR, VERSION_MINOR, __DATE__, __TIME__);
 	printf("Serial Number: %08x-%08x-%08x\n", 
-			(unsigned int) *(__IO uint32_t*)(0x1FFFF7E8), 
-			(unsigned int) *(__IO uint32_t*)(0x1FFFF7EC),
-			(unsigned int) *(__IO uint32_t*)(0x1FFFF7F0));
+			(unsigned int) DEVICE_ID(0), 
+			(unsigned int) DEVICE_ID(1),
+			(unsigned int) DEVICE_ID(2));
+
+
+	gpsstat_print();
 
+	nmea_out_Init(NMEA_OUT_ALL, NMEA_OUT_DEFAULT_PERIOD);
 
 	len = TICK_1S * 4;
 
 	while (len) {
 
-		mdelay(1250);
+		/* Drain the GPS frames, the track log and the NMEA output while waiting for the next pass */
+		loop_start = tick_1khz();
+		while (expire_timer(loop_start, MAIN_LOOP_PERIOD) == FALSE) {
+			logbuf_Mgmt();
+			download_Mgmt();
+			nmea_out_Mgmt();
+			disk_async_poll();
+			if (sirf_process_frames() == 0) {
+				__WFI();
+			}
+		}
 
 		rtc_print();
 		alarm_Mgmt();
+		trackidx_Mgmt();
 
 		Button_Mgmt();
 
+		motion_Mgmt();
+		if (motion_get_event() != MOTION_EVENT_NONE) {
+			motion_print();
+			gpsstat_print();
+			DEBUGF("SiRF frames: %d processed, %d invalid, %d lost, max backlog %d.\n",
+					(int)sirf_queue_stats.processed, (int)sirf_queue_stats.invalid,
+					(int)sirf_queue_stats.overflow, sirf_queue_stats.max_depth);
+#if _FS_CACHE
+			DEBUGF("FAT cache: %d hits, %d misses, %d sectors written.\n",
+					(int)fatfs.cache_hit, (int)fatfs.cache_miss, (int)fatfs.cache_write);
+#endif
+#ifdef DEBUG
+			{
+				DISK_BUSY busy;
+
+				if (disk_ioctl(0, MMC_GET_BUSY, &busy) == RES_OK) {
+					DEBUGF("SD busy: ready %d waits %d ms max %d us, token %d waits max %d us, init %d ms.\n",
+							(int)busy.ready.count, (int)(busy.ready.total / 1000), (int)busy.ready.max,
+							(int)busy.token.count, (int)busy.token.max, (int)(busy.init.max / 1000));
+				}
+			}
+			DEBUGF("Flash log: %d sectors staged, %d drains, %d%% full, %d errors.\n",
+					(int)logbuf_stats.staged, (int)logbuf_stats.drains, flashlog_fill(),
+					(int)(flashlog_stats.errors + flashlog_stats.crc_errors));
+			DEBUGF("Download: %d sessions, %d frames, %d resent, %d bad frames.\n",
+					(int)download_stats.sessions, (int)download_stats.frames,
+					(int)download_stats.resent, (int)download_stats.bad_frames);
+#endif
+			logsched_reset();
+		}
+		gpsstat_Mgmt();
+
+		if (motion_logging_enabled()) {
+			enum logsched_reason_n reason = logsched_update();
+			if (reason != LOGSCHED_NONE) {
+				sim18_get_fix(&fix);
+				track_fill(&point, &fix, TRACK_FLAG_REASON(reason));
+				track_write(&point);
+			}
+		} else if (motion_heartbeat_due()) {
+			sim18_get_fix(&fix);
+			track_fill(&point, &fix, TRACK_FLAG_HEARTBEAT | TRACK_FLAG_STATIONARY);
+			track_write(&point);
+		}
+
 		SHT1x_acquire_data();
 /*--------------------------------------------------
 * #ifdef DEW_POINT
@@ -98,6 +205,10 @@ int main(void)
 		*--------------------------------------------------*/
 
 		if (request_sleep == 1) {
+			/* Standby ends in a reset: write the ring out and give the
+			 * unused part of the preallocated block back */
+			track_close();
+			gpsstat_save();
 			PWR_WakeUpPinCmd(ENABLE);
 			PWR_EnterSTANDBYMode();
 		}
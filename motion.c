@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "motion.h"
+#include "LSM303.h"
+#include "sim18.h"
+#include "timer.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+enum motion_state_n motion_state = MOTION_MOVING;
+
+static int16_t acc_window[MOTION_ACC_WINDOW][3];
+static uint8_t acc_index = 0;
+static uint8_t acc_count = 0;
+
+/* Parking point used to measure the GPS position scatter */
+static int32_t anchor_lat;
+static int32_t anchor_lon;
+static bool anchor_valid = FALSE;
+
+static tick_t quiet_since = 0;
+static tick_t state_since = 0;
+static tick_t last_heartbeat = 0;
+static uint32_t heartbeat_period = MOTION_HEARTBEAT_PERIOD;
+static bool heartbeat_pending = FALSE;
+
+static enum motion_event_n pending_event = MOTION_EVENT_NONE;
+static uint32_t transitions = 0;
+/* Time spent in each state, in ms, excluding the current period */
+static uint32_t state_time[2] = {0, 0};
+
+/*
+ * Sum of the per axis variances over the window, in mg^2.
+ * Computed as E[x^2] - E[x]^2, the window holds 12 bit samples
+ * so the sums fit in 32 bits.
+ */
+static uint32_t motion_acc_variance(void){
+	int32_t sum, var;
+	uint32_t total = 0;
+	uint8_t i, axis;
+
+	for(axis = 0; axis < 3; axis++){
+		sum = 0;
+		var = 0;
+		for(i = 0; i < acc_count; i++){
+			sum += acc_window[i][axis];
+			var += (int32_t)acc_window[i][axis] * acc_window[i][axis];
+		}
+		sum /= acc_count;
+		var = var / acc_count - sum * sum;
+		if (var > 0) {
+			total += var;
+		}
+	}
+	return total;
+}
+
+static bool motion_gps_quiet(void){
+	int32_t lat, lon;
+
+	/* No fix: let the accelerometer decide */
+	if (gps_mydata.data_valide != 0 || gps_mydata.lock) {
+		return TRUE;
+	}
+	if (gps_mydata.speed_horizontal > MOTION_SPEED_MAX) {
+		anchor_valid = FALSE;
+		return FALSE;
+	}
+
+	lat = sim18_coordonate(&gps_mydata.latitude);
+	lon = sim18_coordonate(&gps_mydata.longitude);
+	if (anchor_valid == FALSE) {
+		anchor_lat = lat;
+		anchor_lon = lon;
+		anchor_valid = TRUE;
+		return TRUE;
+	}
+	if ((lat - anchor_lat > MOTION_SCATTER_MAX) || (anchor_lat - lat > MOTION_SCATTER_MAX)
+			|| (lon - anchor_lon > MOTION_SCATTER_MAX) || (anchor_lon - lon > MOTION_SCATTER_MAX)) {
+		anchor_valid = FALSE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void motion_set_state(enum motion_state_n state){
+	tick_t now = tick_1khz();
+
+	state_time[motion_state] += now - state_since;
+	state_since = now;
+	motion_state = state;
+	transitions++;
+
+	if (state == MOTION_STATIONARY) {
+		pending_event = MOTION_EVENT_STOPPED;
+		heartbeat_pending = TRUE;
+		last_heartbeat = now;
+		heartbeat_period = MOTION_HEARTBEAT_PERIOD;
+		sim18_sleep();
+		DEBUGF("Motion: stationary, GPS suspended.\n");
+	} else {
+		pending_event = MOTION_EVENT_STARTED;
+		heartbeat_pending = FALSE;
+		anchor_valid = FALSE;
+		sim18_start_measure();
+		DEBUGF("Motion: moving, GPS resumed.\n");
+	}
+}
+
+void motion_Init(void){
+	LSM303_Configuration();
+
+	memset(acc_window, 0, sizeof(acc_window));
+	acc_index = 0;
+	acc_count = 0;
+	anchor_valid = FALSE;
+	motion_state = MOTION_MOVING;
+	pending_event = MOTION_EVENT_NONE;
+	state_since = tick_1khz();
+	quiet_since = state_since;
+
+	/* Moving until proven parked: the receiver runs from boot, in SiRF */
+	sim18_Init();
+	sim18_start_measure();
+}
+
+/*
+ * Called from the main loop. The accelerometer is sampled on every call,
+ * the GPS is only taken into account while it runs (moving state).
+ * Leaving the stationary state is immediate, entering it needs
+ * MOTION_STATIONARY_DELAY of quiet sensors.
+ */
+void motion_Mgmt(void){
+	uint32_t variance;
+	bool quiet;
+
+	LSM303_Acc_Read_Acc(acc_window[acc_index]);
+	acc_index = (acc_index + 1) & (MOTION_ACC_WINDOW - 1);
+	if (acc_count < MOTION_ACC_WINDOW) {
+		acc_count++;
+	}
+
+	variance = motion_acc_variance();
+	quiet = (variance <= MOTION_ACC_VARIANCE_MAX);
+
+	if (motion_state == MOTION_STATIONARY) {
+		if (quiet == FALSE) {
+			motion_set_state(MOTION_MOVING);
+			quiet_since = tick_1khz();
+		} else if (expire_timer(last_heartbeat, heartbeat_period)) {
+			heartbeat_pending = TRUE;
+			last_heartbeat = tick_1khz();
+			if (heartbeat_period < MOTION_HEARTBEAT_PERIOD_MAX / 2) {
+				heartbeat_period *= 2;
+			} else {
+				heartbeat_period = MOTION_HEARTBEAT_PERIOD_MAX;
+			}
+		}
+		return;
+	}
+
+	if (quiet == TRUE) {
+		quiet = motion_gps_quiet();
+	}
+
+	if (quiet == FALSE || acc_count < MOTION_ACC_WINDOW) {
+		quiet_since = tick_1khz();
+	} else if (expire_timer(quiet_since, MOTION_STATIONARY_DELAY)) {
+		motion_set_state(MOTION_STATIONARY);
+	}
+}
+
+/* Return and clear the last transition event */
+enum motion_event_n motion_get_event(void){
+	enum motion_event_n event = pending_event;
+
+	pending_event = MOTION_EVENT_NONE;
+	return event;
+}
+
+bool motion_logging_enabled(void){
+	return (motion_state == MOTION_MOVING);
+}
+
+/* TRUE once per heartbeat period while parked, the logger appends a
+ * heartbeat record instead of track points. The period doubles after
+ * each one up to MOTION_HEARTBEAT_PERIOD_MAX, a few records a day on a
+ * long parking. */
+bool motion_heartbeat_due(void){
+	bool due = heartbeat_pending;
+
+	heartbeat_pending = FALSE;
+	return due;
+}
+
+/* Time spent in a state since boot, in seconds */
+uint32_t motion_time_in_state(enum motion_state_n state){
+	uint32_t ms = state_time[state];
+
+	if (state == motion_state) {
+		ms += tick_1khz() - state_since;
+	}
+	return ms / TICK_1S;
+}
+
+uint32_t motion_transitions(void){
+	return transitions;
+}
+
+void motion_print(void){
+	printf("Motion: %s, moving %ds, stationary %ds, %d transitions.\n",
+			(motion_state == MOTION_MOVING) ? "moving" : "stationary",
+			(int)motion_time_in_state(MOTION_MOVING),
+			(int)motion_time_in_state(MOTION_STATIONARY),
+			(int)transitions);
+}
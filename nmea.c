@@ -55,11 +55,15 @@ uint8_t * nmea_out_buf;
 
 
 void nmea_coordonate_to_string(struct coordonate_s *point, char * string, uint32_t length){
-	sprintf(string, "%c%d.%02d%05d"
-			, (point->cardinal == 'E'||point->cardinal == 'N'?'+':'-')
-			, point->degree
-			, point->minute
-			, point->dec_minute);
+	int32_t value = sim18_coordonate(point);
+
+	if (value < 0) {
+		value = -value;
+	}
+	sprintf(string, "%c%d.%07d"
+			, point->cardinal
+			, (int)(value / 10000000)
+			, (int)(value % 10000000));
 }
 
 
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "sim18.h"
+#include "nmea_out.h"
+#include "timer.h"
+#include "hw_config.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+/*
+ * RMC/GGA/VTG encoder. Each sentence is a table of fields, every field
+ * type has one integer formatter and the checksum is updated as the
+ * characters are written, so no sprintf and a single pass per sentence.
+ */
+
+enum nmea_out_field_n{
+	NMEA_F_TIME,		/* hhmmss.ss */
+	NMEA_F_STATUS,		/* A / V */
+	NMEA_F_LAT,			/* ddmm.mmmm */
+	NMEA_F_NS,
+	NMEA_F_LON,			/* dddmm.mmmm */
+	NMEA_F_EW,
+	NMEA_F_KNOTS,		/* x.x */
+	NMEA_F_COURSE,		/* x.x */
+	NMEA_F_DATE,		/* ddmmyy */
+	NMEA_F_MODE,		/* A / N */
+	NMEA_F_QUALITY,		/* 0 / 1 */
+	NMEA_F_SATS,		/* nn */
+	NMEA_F_HDOP,		/* x.x */
+	NMEA_F_ALT,			/* x.x */
+	NMEA_F_KMH,			/* x.x */
+	NMEA_F_EMPTY,
+	NMEA_F_TEXT
+};
+
+struct nmea_out_field_s{
+	uint8_t type;
+	const char *text;
+};
+
+struct nmea_out_sentence_s{
+	uint8_t id;
+	const char *name;
+	const struct nmea_out_field_s *fields;
+	uint8_t count;
+};
+
+struct nmea_out_writer_s{
+	char *buf;
+	uint8_t len;
+	uint8_t checksum;
+};
+
+static const struct nmea_out_field_s rmc_fields[] = {
+	{NMEA_F_TIME, 0}, {NMEA_F_STATUS, 0},
+	{NMEA_F_LAT, 0}, {NMEA_F_NS, 0}, {NMEA_F_LON, 0}, {NMEA_F_EW, 0},
+	{NMEA_F_KNOTS, 0}, {NMEA_F_COURSE, 0}, {NMEA_F_DATE, 0},
+	{NMEA_F_EMPTY, 0}, {NMEA_F_EMPTY, 0}, {NMEA_F_MODE, 0}
+};
+
+static const struct nmea_out_field_s gga_fields[] = {
+	{NMEA_F_TIME, 0},
+	{NMEA_F_LAT, 0}, {NMEA_F_NS, 0}, {NMEA_F_LON, 0}, {NMEA_F_EW, 0},
+	{NMEA_F_QUALITY, 0}, {NMEA_F_SATS, 0}, {NMEA_F_HDOP, 0},
+	{NMEA_F_ALT, 0}, {NMEA_F_TEXT, "M"}, {NMEA_F_EMPTY, 0}, {NMEA_F_TEXT, "M"},
+	{NMEA_F_EMPTY, 0}, {NMEA_F_EMPTY, 0}
+};
+
+static const struct nmea_out_field_s vtg_fields[] = {
+	{NMEA_F_COURSE, 0}, {NMEA_F_TEXT, "T"}, {NMEA_F_EMPTY, 0}, {NMEA_F_TEXT, "M"},
+	{NMEA_F_KNOTS, 0}, {NMEA_F_TEXT, "N"}, {NMEA_F_KMH, 0}, {NMEA_F_TEXT, "K"},
+	{NMEA_F_MODE, 0}
+};
+
+#define NB_FIELDS(t)		(sizeof(t) / sizeof(t[0]))
+
+static const struct nmea_out_sentence_s sentences[] = {
+	{NMEA_OUT_RMC, "GPRMC", rmc_fields, NB_FIELDS(rmc_fields)},
+	{NMEA_OUT_GGA, "GPGGA", gga_fields, NB_FIELDS(gga_fields)},
+	{NMEA_OUT_VTG, "GPVTG", vtg_fields, NB_FIELDS(vtg_fields)}
+};
+
+#define NB_SENTENCES		NB_FIELDS(sentences)
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static const uint32_t decimal_scale[] = {1, 10, 100, 1000, 10000, 100000};
+
+static uint8_t enabled_sentences = 0;
+static uint32_t out_period = NMEA_OUT_DEFAULT_PERIOD;
+static tick_t last_output = 0;
+static uint32_t dropped = 0;
+
+/* Sentences of the current period not yet accepted by the USART1 FIFO */
+static char pending[NB_SENTENCES][NMEA_OUT_SENTENCE_MAX + 1];
+static uint8_t pending_len[NB_SENTENCES];
+
+static void nmea_out_char(struct nmea_out_writer_s *w, char c){
+	w->buf[w->len++] = c;
+	w->checksum ^= (uint8_t)c;
+}
+
+static void nmea_out_text(struct nmea_out_writer_s *w, const char *text){
+	while (*text) {
+		nmea_out_char(w, *text++);
+	}
+}
+
+/* Unsigned integer, left padded with zeros to digits */
+static void nmea_out_uint(struct nmea_out_writer_s *w, uint32_t value, uint8_t digits){
+	char tmp[10];
+	uint8_t n = 0;
+
+	do {
+		tmp[n++] = '0' + (value % 10);
+		value /= 10;
+	} while (value || n < digits);
+
+	while (n) {
+		nmea_out_char(w, tmp[--n]);
+	}
+}
+
+/* Fixed point value with decimals digits after the dot */
+static void nmea_out_fixed(struct nmea_out_writer_s *w, int32_t value, uint8_t decimals){
+	if (value < 0) {
+		nmea_out_char(w, '-');
+		value = -value;
+	}
+	nmea_out_uint(w, (uint32_t)value / decimal_scale[decimals], 1);
+	nmea_out_char(w, '.');
+	nmea_out_uint(w, (uint32_t)value % decimal_scale[decimals], decimals);
+}
+
+static void nmea_out_coordonate(struct nmea_out_writer_s *w,
+		const struct coordonate_s *point, uint8_t degree_digits){
+	nmea_out_uint(w, point->degree, degree_digits);
+	nmea_out_uint(w, point->minute, 2);
+	nmea_out_char(w, '.');
+	nmea_out_uint(w, point->dec_minute / 10, 4);
+}
+
+static void nmea_out_field(struct nmea_out_writer_s *w,
+		const struct nmea_out_field_s *field, const struct sim18_data_s *fix){
+	bool valid = (fix->data_valide == 0);
+
+	switch (field->type) {
+		case NMEA_F_TIME:
+			nmea_out_uint(w, fix->date_time.hour, 2);
+			nmea_out_uint(w, fix->date_time.minute, 2);
+			nmea_out_uint(w, fix->date_time.seconde / 1000, 2);
+			nmea_out_char(w, '.');
+			nmea_out_uint(w, (fix->date_time.seconde % 1000) / 10, 2);
+			break;
+		case NMEA_F_STATUS:
+			nmea_out_char(w, valid ? 'A' : 'V');
+			break;
+		case NMEA_F_LAT:
+			if (valid) {
+				nmea_out_coordonate(w, &fix->latitude, 2);
+			}
+			break;
+		case NMEA_F_NS:
+			if (valid) {
+				nmea_out_char(w, (fix->latitude.cardinal == '-') ? 'S' : 'N');
+			}
+			break;
+		case NMEA_F_LON:
+			if (valid) {
+				nmea_out_coordonate(w, &fix->longitude, 3);
+			}
+			break;
+		case NMEA_F_EW:
+			if (valid) {
+				nmea_out_char(w, (fix->longitude.cardinal == '-') ? 'W' : 'E');
+			}
+			break;
+		case NMEA_F_KNOTS:
+			/* cm/s to 0.1 knot */
+			nmea_out_fixed(w, (uint32_t)fix->speed_horizontal * 360 / 1852, 1);
+			break;
+		case NMEA_F_COURSE:
+			nmea_out_fixed(w, fix->azimuth / 10, 1);
+			break;
+		case NMEA_F_DATE:
+			nmea_out_uint(w, fix->date_time.day, 2);
+			nmea_out_uint(w, fix->date_time.month, 2);
+			nmea_out_uint(w, fix->date_time.year % 100, 2);
+			break;
+		case NMEA_F_MODE:
+			nmea_out_char(w, valid ? 'A' : 'N');
+			break;
+		case NMEA_F_QUALITY:
+			nmea_out_char(w, valid ? '1' : '0');
+			break;
+		case NMEA_F_SATS:
+			nmea_out_uint(w, fix->sat_number, 2);
+			break;
+		case NMEA_F_HDOP:
+			/* 0.2 unit of message 41 to 0.1 */
+			if (valid) {
+				nmea_out_fixed(w, (uint32_t)fix->hdop * 2, 1);
+			}
+			break;
+		case NMEA_F_ALT:
+			if (valid) {
+				nmea_out_fixed(w, fix->altitude / 10, 1);
+			}
+			break;
+		case NMEA_F_KMH:
+			/* cm/s to 0.1 km/h */
+			nmea_out_fixed(w, (uint32_t)fix->speed_horizontal * 36 / 100, 1);
+			break;
+		case NMEA_F_TEXT:
+			nmea_out_text(w, field->text);
+			break;
+		case NMEA_F_EMPTY:
+		default:
+			break;
+	}
+}
+
+/*
+ * Format one sentence into buf (NMEA_OUT_SENTENCE_MAX + 1 bytes),
+ * return its length, '\r\n' included, or 0 for an unknown sentence.
+ */
+uint8_t nmea_out_format(uint8_t sentence, const struct sim18_data_s *fix, char *buf){
+	const struct nmea_out_sentence_s *s = NULL;
+	struct nmea_out_writer_s w;
+	uint8_t i;
+
+	for (i = 0; i < NB_SENTENCES; i++) {
+		if (sentences[i].id == sentence) {
+			s = &sentences[i];
+		}
+	}
+	if (s == NULL) {
+		return 0;
+	}
+
+	buf[0] = '$';
+	w.buf = buf;
+	w.len = 1;
+	w.checksum = 0;
+
+	nmea_out_text(&w, s->name);
+	for (i = 0; i < s->count; i++) {
+		nmea_out_char(&w, ',');
+		nmea_out_field(&w, &s->fields[i], fix);
+	}
+
+	buf[w.len++] = '*';
+	buf[w.len++] = hex_digits[w.checksum >> 4];
+	buf[w.len++] = hex_digits[w.checksum & 0x0F];
+	buf[w.len++] = '\r';
+	buf[w.len++] = '\n';
+	buf[w.len] = '\0';
+
+	return w.len;
+}
+
+void nmea_out_Init(uint8_t selection, uint32_t period){
+	enabled_sentences = selection;
+	out_period = period;
+	last_output = tick_1khz();
+	memset(pending_len, 0, sizeof(pending_len));
+}
+
+/* Sentences dropped because the line was still busy with the previous ones */
+uint32_t nmea_out_dropped(void){
+	return dropped;
+}
+
+/* Hand whole pending sentences to the USART1 FIFO, in order, never wait */
+static void nmea_out_flush(void){
+	uint8_t i;
+
+	for (i = 0; i < NB_SENTENCES; i++) {
+		if (pending_len[i] == 0) {
+			continue;
+		}
+		if (USART1_Send_Buffer_NoWait((uint8_t *)pending[i], pending_len[i]) == 0) {
+			return;
+		}
+		pending_len[i] = 0;
+	}
+}
+
+void nmea_out_Mgmt(void){
+	struct sim18_data_s fix;
+	uint8_t i;
+
+	if (enabled_sentences == 0) {
+		return;
+	}
+
+	nmea_out_flush();
+
+	if (expire_timer(last_output, out_period) == FALSE) {
+		return;
+	}
+	/* On the period grid, unless a whole period was missed */
+	last_output += out_period;
+	if (expire_timer(last_output, out_period)) {
+		last_output = tick_1khz();
+	}
+
+	sim18_get_fix(&fix);
+	for (i = 0; i < NB_SENTENCES; i++) {
+		if (pending_len[i]) {
+			dropped++;
+		}
+		pending_len[i] = 0;
+		if (enabled_sentences & sentences[i].id) {
+			pending_len[i] = nmea_out_format(sentences[i].id, &fix, pending[i]);
+		}
+	}
+
+	nmea_out_flush();
+}
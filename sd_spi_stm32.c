@@ -35,6 +35,7 @@
 #include "stm32f10x.h"
 #include "ffconf.h"
 #include "diskio.h"
+#include "timer.h"
 
 
 #ifdef STM32_SD_USE_DMA
@@ -45,6 +46,10 @@
 /* set to 1 to provide a disk_ioctrl function even if not needed by the FatFs */
 #define STM32_SD_DISK_IOCTRL_FORCE      0
 
+/* set to 1 to switch the card to CRC mode (CMD59): commands carry their CRC7,
+   data blocks their CRC16, computed by the SPI CRC unit in the DMA build */
+#define STM32_SD_USE_CRC                1
+
  // Olimex STM32-P103 not tested!
  #define CARD_SUPPLY_SWITCHABLE   0
  #define SOCKET_WP_CONNECTED      0 /* write-protect socket-switch */
@@ -65,6 +70,9 @@
  #define DMA_Channel_SPI_SD_TX    DMA1_Channel5
  #define DMA_FLAG_SPI_SD_TC_RX    DMA1_FLAG_TC4
  #define DMA_FLAG_SPI_SD_TC_TX    DMA1_FLAG_TC5
+ #define DMA_IT_SPI_SD_TC_RX      DMA1_IT_TC4
+ #define DMA_IT_SPI_SD_GL_RX      DMA1_IT_GL4
+ #define DMA_IRQn_SPI_SD_RX       DMA1_Channel4_IRQn
  #define GPIO_SPI_SD              GPIOB
  #define GPIO_Pin_SPI_SD_SCK      GPIO_Pin_13
  #define GPIO_Pin_SPI_SD_MISO     GPIO_Pin_14
@@ -72,10 +80,14 @@
  #define RCC_APBPeriphClockCmd_SPI_SD  RCC_APB1PeriphClockCmd
  #define RCC_APBPeriph_SPI_SD     RCC_APB1Periph_SPI2
 
- /* for SPI2 and full-speed APB1: 36MHz/2 */
- /* !! PRESCALE 4 used here - 2 does not work, maybe because
-       of the poor wiring on the HELI_V1 prototype hardware */
- #define SPI_BaudRatePrescaler_SPI_SD  SPI_BaudRatePrescaler_4
+ #define SPI_SD_PCLK(clocks)      ((clocks).PCLK1_Frequency)
+
+ /* Fast clock range as prescaler index, SPI_BaudRatePrescaler_2 << 3*n:
+    the fastest the CSD allows from 36MHz/2 on, stepped down on CRC
+    errors to 36MHz/32 at most (prescaler 2 did not work on the
+    poorly wired HELI_V1 prototype, the CRC check now catches that) */
+ #define SPI_SD_FASTEST           0
+ #define SPI_SD_SLOWEST           4
 
 
 
@@ -97,6 +109,13 @@
 #define CMD25	(0x40+25)	/* WRITE_MULTIPLE_BLOCK */
 #define CMD55	(0x40+55)	/* APP_CMD */
 #define CMD58	(0x40+58)	/* READ_OCR */
+#define CMD59	(0x40+59)	/* CRC_ON_OFF */
+
+/* Attempts of a command or a transfer failing on a CRC error */
+#define SD_RETRIES	3
+
+/* SPI bytes polled between two calls of the yield hook while the card is busy */
+#define YIELD_POLL_BYTES	16
 
 /* Card-Select Controls  (Platform dependent) */
 #define SELECT()        GPIO_ResetBits(GPIO_CS, GPIO_Pin_CS)    /* MMC CS = L */
@@ -133,6 +152,103 @@ BYTE CardType;			/* Card type flags */
 
 enum speed_setting { INTERFACE_SLOW, INTERFACE_FAST };
 
+static
+BYTE SpiFast = SPI_SD_SLOWEST;	/* Prescaler index of the fast clock */
+
+static
+BOOL CrcFailed;			/* Set by a data block CRC mismatch */
+
+static
+DISK_ERRORS Errors;		/* Error counters, MMC_GET_ERRORS */
+
+static
+DISK_BUSY Busy;			/* Card busy times, MMC_GET_BUSY */
+
+static
+disk_yield_hook YieldHook;	/* Called while the card is busy, may be 0 */
+
+/* Read-ahead: CMD18 kept open, card selected, while disk_read() is sequential */
+#define READ_NONE	0xFFFFFFFF
+
+static
+BOOL ReadAhead;			/* Read-ahead mode, MMC_READ_AHEAD */
+
+static
+DWORD ReadNext = READ_NONE;	/* Next sector of the open CMD18 */
+
+static void read_stop(void);
+
+/* CRC16-CCITT (x^16 + x^12 + x^5 + 1) of the data blocks */
+static const WORD Crc16Tbl[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+#ifdef STM32_SD_USE_DMA
+/* Asynchronous transfer state, advanced by disk_async_poll() and the DMA interrupt */
+enum async_state {
+	ASYNC_IDLE,
+	ASYNC_WAIT_TOKEN,	/* read: waiting for the data token */
+	ASYNC_WAIT_READY,	/* write: card busy programming */
+	ASYNC_DMA,			/* block moving, DMA interrupt pending */
+	ASYNC_DMA_DONE		/* block moved, CRC and response to handle */
+};
+
+/* SPI bytes polled per disk_async_poll() call while waiting on the card */
+#define ASYNC_POLL_BYTES	16
+
+static volatile
+BYTE AsyncState = ASYNC_IDLE;
+
+static volatile
+BOOL DmaDone;
+
+static BOOL async_write;		/* TRUE for a write */
+static BOOL async_multi;		/* CMD18/CMD25 transfer, needs a stop */
+static BOOL async_stop;			/* write: stop token sent or single block done */
+static BOOL async_hw;			/* block CRC from the SPI CRC unit */
+static DWORD async_since;		/* start of the wait for the card, tick_us() */
+static BYTE *async_rbuff;		/* read: next block */
+static const BYTE *async_wbuff;	/* write: next block */
+static BYTE async_count;		/* blocks left to move */
+static DRESULT async_result = RES_OK;
+static disk_async_callback async_done;
+
+static void async_wait(void);
+#else
+#define async_wait()
+#endif
+
 static void interface_speed( enum speed_setting speed )
 {
 	DWORD tmp;
@@ -143,11 +259,37 @@ static void interface_speed( enum speed_setting speed )
 		tmp = ( tmp | SPI_BaudRatePrescaler_256 );
 	} else {
 		/* Set fast clock (depends on the CSD) */
-		tmp = ( tmp & ~SPI_BaudRatePrescaler_256 ) | SPI_BaudRatePrescaler_SPI_SD;
+		tmp = ( tmp & ~SPI_BaudRatePrescaler_256 ) | ( (WORD)SpiFast << 3 );
 	}
 	SPI_SD->CR1 = tmp;
 }
 
+/* Fastest prescaler index within the CSD TRAN_SPEED of the card */
+static BYTE fast_prescaler( BYTE tran_speed )
+{
+	static const BYTE mult[16] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+	RCC_ClocksTypeDef clocks;
+	DWORD khz, unit = 100;
+	BYTE n;
+
+	for (n = tran_speed & 7; n && unit < 100000; n--) unit *= 10;
+	khz = unit * mult[(tran_speed >> 3) & 15] / 10;
+	if (!khz) khz = 25000;	/* Reserved code, default speed */
+
+	RCC_GetClocksFreq(&clocks);
+	for (n = SPI_SD_FASTEST; n < SPI_SD_SLOWEST && SPI_SD_PCLK(clocks) / 1000 > (khz << (n + 1)); n++) ;
+	return n;
+}
+
+/* Step the fast clock down after a CRC error, FALSE when already slowest */
+static BOOL interface_slower( void )
+{
+	if (SpiFast >= SPI_SD_SLOWEST) return FALSE;
+	SpiFast++;
+	interface_speed(INTERFACE_FAST);
+	return TRUE;
+}
+
 #if SOCKET_WP_CONNECTED
 /* Socket's Write-Protection Pin: high = write-protected, low = writable */
 
@@ -309,6 +451,36 @@ BYTE rcvr_spi (void)
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Busy time accounting and yield to the application                     */
+/*-----------------------------------------------------------------------*/
+
+static
+void busy_add (
+	DISK_BUSY_STAT *st,
+	DWORD us			/* Time the card was busy */
+)
+{
+	st->count++;
+	st->total += us;
+	if (us > st->max) st->max = us;
+}
+
+static
+void yield (void)
+{
+	if (YieldHook) YieldHook();
+}
+
+void disk_set_yield (
+	disk_yield_hook hook	/* 0 to spin */
+)
+{
+	YieldHook = hook;
+}
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Wait for card ready                                                   */
 /*-----------------------------------------------------------------------*/
@@ -316,14 +488,22 @@ BYTE rcvr_spi (void)
 static
 BYTE wait_ready (void)
 {
-	BYTE res;
+	BYTE res, n;
+	DWORD start;
 
 
 	Timer2 = 50;	/* Wait for ready in timeout of 500ms */
 	rcvr_spi();
-	do
-		res = rcvr_spi();
-	while ((res != 0xFF) && Timer2);
+	start = tick_us();
+	for (;;) {
+		n = YIELD_POLL_BYTES;
+		do
+			res = rcvr_spi();
+		while ((res != 0xFF) && --n);
+		if (res == 0xFF || !Timer2) break;
+		yield();					/* Card busy programming */
+	}
+	busy_add(&Busy.ready, tick_us() - start);
 
 	return res;
 }
@@ -346,21 +526,29 @@ void release_spi (void)
 /* Transmit/Receive Block using DMA (Platform dependent. STM32 here)     */
 /*-----------------------------------------------------------------------*/
 static
-void stm32_dma_transfer(
+void stm32_dma_start(
 	BOOL receive,		/* FALSE for buff->SPI, TRUE for SPI->buff               */
 	const BYTE *buff,	/* receive TRUE  : 512 byte data block to be transmitted
 						   receive FALSE : Data buffer to store received data    */
-	UINT btr 			/* receive TRUE  : Byte count (must be multiple of 2)
+	UINT btr, 			/* receive TRUE  : Byte count (must be multiple of 2)
 						   receive FALSE : Byte count (must be 512)              */
+	BOOL wide			/* 16-bit frames, buff halfword aligned                  */
 )
 {
 	DMA_InitTypeDef DMA_InitStructure;
-	WORD rw_workbyte[] = { 0xffff };
+	/* static, the transfer outlives this function */
+	static WORD rw_workbyte[] = { 0xffff };
 
 	/* shared DMA configuration values */
 	DMA_InitStructure.DMA_PeripheralBaseAddr = (DWORD)(&(SPI_SD->DR));
-	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
-	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	if (wide) {
+		DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+		DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+		btr /= 2;
+	} else {
+		DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+		DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	}
 	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
 	DMA_InitStructure.DMA_BufferSize = btr;
 	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
@@ -406,6 +594,11 @@ void stm32_dma_transfer(
 
 	}
 
+	DmaDone = FALSE;
+
+	/* RX completes last, its transfer complete interrupt ends the block */
+	DMA_ITConfig(DMA_Channel_SPI_SD_RX, DMA_IT_TC, ENABLE);
+
 	/* Enable DMA RX Channel */
 	DMA_Cmd(DMA_Channel_SPI_SD_RX, ENABLE);
 	/* Enable DMA TX Channel */
@@ -413,14 +606,11 @@ void stm32_dma_transfer(
 
 	/* Enable SPI TX/RX request */
 	SPI_I2S_DMACmd(SPI_SD, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE);
+}
 
-	/* Wait until DMA1_Channel 3 Transfer Complete */
-	/// not needed: while (DMA_GetFlagStatus(DMA_FLAG_SPI_SD_TC_TX) == RESET) { ; }
-	/* Wait until DMA1_Channel 2 Receive Complete */
-	while (DMA_GetFlagStatus(DMA_FLAG_SPI_SD_TC_RX) == RESET) { ; }
-	// same w/o function-call:
-	// while ( ( ( DMA1->ISR ) & DMA_FLAG_SPI_SD_TC_RX ) == RESET ) { ; }
-
+static
+void stm32_dma_stop(void)
+{
 	/* Disable DMA RX Channel */
 	DMA_Cmd(DMA_Channel_SPI_SD_RX, DISABLE);
 	/* Disable DMA TX Channel */
@@ -429,6 +619,35 @@ void stm32_dma_transfer(
 	/* Disable SPI RX/TX request */
 	SPI_I2S_DMACmd(SPI_SD, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE);
 }
+
+/*-----------------------------------------------------------------------*/
+/* DMA RX transfer complete interrupt, called from DMA1_Channel4_IRQHandler */
+/*-----------------------------------------------------------------------*/
+
+void disk_dma_irq (void)
+{
+	if (DMA_GetITStatus(DMA_IT_SPI_SD_TC_RX) == RESET) return;
+	DMA_ClearITPendingBit(DMA_IT_SPI_SD_GL_RX);
+
+	stm32_dma_stop();
+	DmaDone = TRUE;
+	if (AsyncState == ASYNC_DMA) AsyncState = ASYNC_DMA_DONE;
+}
+
+/* Sleep until the DMA interrupt instead of polling the flag. The flag is
+   tested with the interrupts masked: one that comes before WFI stays
+   pending and wakes the core at once, it cannot be lost before the sleep */
+static
+void dma_wait (void)
+{
+	__disable_irq();
+	while (!DmaDone) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+}
 #endif /* STM32_SD_USE_DMA */
 
 
@@ -441,7 +660,9 @@ void power_on (void)
 {
 	SPI_InitTypeDef  SPI_InitStructure;
 	GPIO_InitTypeDef GPIO_InitStructure;
-	volatile BYTE dummyread;
+#ifdef STM32_SD_USE_DMA
+	NVIC_InitTypeDef NVIC_InitStructure;
+#endif
 
 	/* Enable GPIO clock for CS */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIO_CS, ENABLE);
@@ -452,7 +673,7 @@ void power_on (void)
 	socket_cp_init();
 	socket_wp_init();
 
-	for (Timer1 = 25; Timer1; );	/* Wait for 250ms */
+	for (Timer1 = 25; Timer1; ) yield();	/* Wait for 250ms */
 
 	/* Configure I/O for Flash Chip select */
 	GPIO_InitStructure.GPIO_Pin   = GPIO_Pin_CS;
@@ -482,7 +703,7 @@ void power_on (void)
 	SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
 	SPI_InitStructure.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_256; // 72000kHz/256=281kHz < 400kHz
 	SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
-	SPI_InitStructure.SPI_CRCPolynomial = 7;
+	SPI_InitStructure.SPI_CRCPolynomial = 0x1021;	/* CRC16-CCITT of the data blocks */
 
 	SPI_Init(SPI_SD, &SPI_InitStructure);
 	SPI_CalculateCRC(SPI_SD, DISABLE);
@@ -490,11 +711,18 @@ void power_on (void)
 
 	/* drain SPI */
 	while (SPI_I2S_GetFlagStatus(SPI_SD, SPI_I2S_FLAG_TXE) == RESET) { ; }
-	dummyread = SPI_I2S_ReceiveData(SPI_SD);
+	SPI_I2S_ReceiveData(SPI_SD);
 
 #ifdef STM32_SD_USE_DMA
 	/* enable DMA clock */
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+	/* enable the RX transfer complete interrupt */
+	NVIC_InitStructure.NVIC_IRQChannel = DMA_IRQn_SPI_SD_RX;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
 #endif
 }
 
@@ -520,10 +748,194 @@ void power_off (void)
 
 	card_power(0);
 
+	ReadNext = READ_NONE;
 	Stat |= STA_NOINIT;		/* Set STA_NOINIT */
 }
 
 
+/*-----------------------------------------------------------------------*/
+/* Data block CRC16                                                      */
+/*-----------------------------------------------------------------------*/
+/* The card sends a valid CRC16 with read data even when its own CRC     */
+/* checking (CMD59) is off. In the DMA build halfword aligned blocks go  */
+/* in 16-bit frames through the SPI CRC unit, which has no CRC16 with    */
+/* 8-bit frames; the DMA stores the frames little-endian, so the bytes   */
+/* of a received block are swapped back in place after the transfer. A  */
+/* block to transmit is swapped into TxBlock and sent from there, the    */
+/* caller's data is never touched. Other received blocks get the CRC in  */
+/* software.                                                             */
+
+static
+WORD crc16 (
+	const BYTE *buff,	/* Data block */
+	UINT btr			/* Byte count */
+)
+{
+	WORD crc = 0;
+
+	do
+		crc = (crc << 8) ^ Crc16Tbl[(BYTE)(crc >> 8) ^ *buff++];
+	while (--btr);
+
+	return crc;
+}
+
+#if defined(STM32_SD_USE_DMA) && STM32_SD_USE_CRC
+static
+void spi_crc16 (
+	BOOL on			/* TRUE: 16-bit frames and CRC unit cleared and on */
+)
+{
+	while (SPI_I2S_GetFlagStatus(SPI_SD, SPI_I2S_FLAG_BSY) == SET) { ; }
+	SPI_SD->CR1 &= ~SPI_CR1_SPE;		/* DFF and CRCEN change with the SPI off */
+	if (on)
+		SPI_SD->CR1 |= SPI_CR1_DFF | SPI_CR1_CRCEN;
+	else
+		SPI_SD->CR1 &= ~(SPI_CR1_DFF | SPI_CR1_CRCEN);
+	SPI_SD->CR1 |= SPI_CR1_SPE;
+}
+
+#if _FS_READONLY == 0
+static DWORD TxBlock[512 / 4];	/* Block being transmitted, byte swapped */
+
+/* Copy a block to TxBlock with the bytes of each halfword swapped */
+static
+void swap16_tx (
+	const BYTE *buff,
+	UINT btr
+)
+{
+	DWORD *d = TxBlock;
+
+	for (btr /= 4; btr; btr--, buff += 4)
+		*d++ = (DWORD)buff[1] | (DWORD)buff[0] << 8 | (DWORD)buff[3] << 16 | (DWORD)buff[2] << 24;
+}
+#endif
+
+static
+void swap16 (
+	BYTE *buff,
+	UINT btr
+)
+{
+	WORD *p = (WORD*)buff;
+
+	for (btr /= 2; btr; btr--, p++)
+		*p = (WORD)__REV16(*p);
+}
+#endif
+
+#ifdef STM32_SD_USE_DMA
+/* Start moving a block, TRUE when the SPI CRC unit computes its CRC */
+static
+BOOL block_start (
+	BOOL receive,
+	const BYTE *buff,	/* Receive: written by the DMA */
+	UINT btr			/* Transmit: at most 512 */
+)
+{
+#if STM32_SD_USE_CRC
+#if _FS_READONLY == 0
+	if (!receive) {
+		swap16_tx(buff, btr);
+		spi_crc16(TRUE);
+		stm32_dma_start(FALSE, (const BYTE*)TxBlock, btr, TRUE);
+		return TRUE;
+	}
+#endif
+	if (!((DWORD)buff & 1)) {
+		spi_crc16(TRUE);
+		stm32_dma_start(TRUE, buff, btr, TRUE);
+		return TRUE;
+	}
+#endif
+	stm32_dma_start(receive, buff, btr, FALSE);
+	return FALSE;
+}
+
+/* Finish a block moved by the DMA, return its CRC16 */
+static
+WORD block_end (
+	BOOL receive,
+	BYTE *buff,			/* Received block, unused for transmit */
+	UINT btr,
+	BOOL hw				/* block_start() result */
+)
+{
+#if STM32_SD_USE_CRC
+	WORD crc;
+
+	if (hw) {
+		crc = receive ? SPI_SD->RXCRCR : SPI_SD->TXCRCR;
+		spi_crc16(FALSE);
+		if (receive) swap16(buff, btr);
+		return crc;
+	}
+#else
+	if (!receive) return 0xFFFF;	/* Dummy CRC, not checked by the card */
+#endif
+	return crc16(buff, btr);
+}
+#endif
+
+/* Receive a block, return its CRC16 */
+static
+WORD rcvr_block (
+	BYTE *buff,
+	UINT btr			/* Byte count (must be multiple of 4) */
+)
+{
+#ifdef STM32_SD_USE_DMA
+	BOOL hw = block_start(TRUE, buff, btr);
+
+	dma_wait();
+	return block_end(TRUE, buff, btr, hw);
+#else
+	BYTE *p = buff;
+	UINT n = btr;
+
+	do {							/* Receive the data block into buffer */
+		rcvr_spi_m(p++);
+		rcvr_spi_m(p++);
+		rcvr_spi_m(p++);
+		rcvr_spi_m(p++);
+	} while (n -= 4);
+	return crc16(buff, btr);
+#endif /* STM32_SD_USE_DMA */
+}
+
+#if _FS_READONLY == 0
+/* Transmit a block, return its CRC16 */
+static
+WORD xmit_block (
+	const BYTE *buff,
+	UINT btr			/* Byte count (must be multiple of 2) */
+)
+{
+#ifdef STM32_SD_USE_DMA
+	BOOL hw = block_start(FALSE, buff, btr);
+
+	dma_wait();
+	return block_end(FALSE, 0, btr, hw);
+#else
+	const BYTE *p = buff;
+	UINT n = btr;
+
+	do {							/* transmit the data block to MMC */
+		xmit_spi(*p++);
+		xmit_spi(*p++);
+	} while (n -= 2);
+#if STM32_SD_USE_CRC
+	return crc16(buff, btr);
+#else
+	return 0xFFFF;					/* Dummy CRC, not checked by the card */
+#endif
+#endif /* STM32_SD_USE_DMA */
+}
+#endif /* _READONLY */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Receive a data packet from MMC                                        */
 /*-----------------------------------------------------------------------*/
@@ -534,30 +946,33 @@ BOOL rcvr_datablock (
 	UINT btr			/* Byte count (must be multiple of 4) */
 )
 {
-	BYTE token;
+	BYTE token, n;
+	WORD crc, rx;
+	DWORD start;
 
 
 	Timer1 = 10;
-	do {							/* Wait for data packet in timeout of 100ms */
-		token = rcvr_spi();
-	} while ((token == 0xFF) && Timer1);
+	start = tick_us();
+	for (;;) {						/* Wait for data packet in timeout of 100ms */
+		n = YIELD_POLL_BYTES;
+		do
+			token = rcvr_spi();
+		while ((token == 0xFF) && --n);
+		if (token != 0xFF || !Timer1) break;
+		yield();
+	}
+	busy_add(&Busy.token, tick_us() - start);
 	if(token != 0xFE) return FALSE;	/* If not valid data token, return with error */
 
-#ifdef STM32_SD_USE_DMA
-	stm32_dma_transfer( TRUE, buff, btr );
-#else
-	do {							/* Receive the data block into buffer */
-		rcvr_spi_m(buff++);
-		rcvr_spi_m(buff++);
-		rcvr_spi_m(buff++);
-		rcvr_spi_m(buff++);
-	} while (btr -= 4);
-#endif /* STM32_SD_USE_DMA */
+	crc = rcvr_block(buff, btr);
 
-	rcvr_spi();						/* Discard CRC */
-	rcvr_spi();
+	rx = (WORD)rcvr_spi() << 8;		/* Check CRC */
+	rx |= rcvr_spi();
+	if (rx == crc) return TRUE;
 
-	return TRUE;					/* Return with success */
+	Errors.crc_read++;
+	CrcFailed = TRUE;
+	return FALSE;
 }
 
 
@@ -574,30 +989,23 @@ BOOL xmit_datablock (
 )
 {
 	BYTE resp;
-#ifndef STM32_SD_USE_DMA
-	BYTE wc;
-#endif
+	WORD crc;
 
 	if (wait_ready() != 0xFF) return FALSE;
 
 	xmit_spi(token);					/* transmit data token */
 	if (token != 0xFD) {	/* Is data token */
-
-#ifdef STM32_SD_USE_DMA
-		stm32_dma_transfer( FALSE, buff, 512 );
-#else
-		wc = 0;
-		do {							/* transmit the 512 byte data block to MMC */
-			xmit_spi(*buff++);
-			xmit_spi(*buff++);
-		} while (--wc);
-#endif /* STM32_SD_USE_DMA */
-
-		xmit_spi(0xFF);					/* CRC (Dummy) */
-		xmit_spi(0xFF);
+		crc = xmit_block(buff, 512);
+		xmit_spi((BYTE)(crc >> 8));		/* CRC */
+		xmit_spi((BYTE)crc);
 		resp = rcvr_spi();				/* Receive data response */
-		if ((resp & 0x1F) != 0x05)		/* If not accepted, return with error */
+		if ((resp & 0x1F) != 0x05) {	/* If not accepted, return with error */
+			if ((resp & 0x1F) == 0x0B) {	/* Rejected for its CRC */
+				Errors.crc_write++;
+				CrcFailed = TRUE;
+			}
 			return FALSE;
+		}
 	}
 
 	return TRUE;
@@ -610,13 +1018,33 @@ BOOL xmit_datablock (
 /* Send a command packet to MMC                                          */
 /*-----------------------------------------------------------------------*/
 
+static
+BYTE crc7 (
+	const BYTE *buff,	/* Command index and argument */
+	BYTE n
+)
+{
+	BYTE crc = 0, d, i;
+
+	do {
+		d = *buff++;
+		for (i = 8; i; i--) {
+			crc <<= 1;
+			if ((d ^ crc) & 0x80) crc ^= 0x09;
+			d <<= 1;
+		}
+	} while (--n);
+
+	return (crc << 1) | 0x01;	/* CRC7 + Stop */
+}
+
 static
 BYTE send_cmd (
 	BYTE cmd,		/* Command byte */
 	DWORD arg		/* Argument */
 )
 {
-	BYTE n, res;
+	BYTE n, res, pkt[6], retry;
 
 
 	if (cmd & 0x80) {	/* ACMD<n> is the command sequence of CMD55-CMD<n> */
@@ -625,31 +1053,37 @@ BYTE send_cmd (
 		if (res > 1) return res;
 	}
 
-	/* Select the card and wait for ready */
-	DESELECT();
-	SELECT();
-	if (wait_ready() != 0xFF) {
-		return 0xFF;
-	}
-
-	/* Send command packet */
-	xmit_spi(cmd);						/* Start + Command index */
-	xmit_spi((BYTE)(arg >> 24));		/* Argument[31..24] */
-	xmit_spi((BYTE)(arg >> 16));		/* Argument[23..16] */
-	xmit_spi((BYTE)(arg >> 8));			/* Argument[15..8] */
-	xmit_spi((BYTE)arg);				/* Argument[7..0] */
-	n = 0x01;							/* Dummy CRC + Stop */
-	if (cmd == CMD0) n = 0x95;			/* Valid CRC for CMD0(0) */
-	if (cmd == CMD8) n = 0x87;			/* Valid CRC for CMD8(0x1AA) */
-	xmit_spi(n);
-
-	/* Receive command response */
-	if (cmd == CMD12) rcvr_spi();		/* Skip a stuff byte when stop reading */
-
-	n = 10;								/* Wait for a valid response in timeout of 10 attempts */
-	do
-		res = rcvr_spi();
-	while ((res & 0x80) && --n);
+	pkt[0] = cmd;						/* Start + Command index */
+	pkt[1] = (BYTE)(arg >> 24);			/* Argument[31..24] */
+	pkt[2] = (BYTE)(arg >> 16);			/* Argument[23..16] */
+	pkt[3] = (BYTE)(arg >> 8);			/* Argument[15..8] */
+	pkt[4] = (BYTE)arg;					/* Argument[7..0] */
+	pkt[5] = crc7(pkt, 5);				/* Valid CRC for all, needed in CRC mode */
+
+	for (retry = SD_RETRIES; ; ) {
+		/* Select the card and wait for ready */
+		DESELECT();
+		SELECT();
+		if (wait_ready() != 0xFF) {
+			return 0xFF;
+		}
+
+		/* Send command packet */
+		for (n = 0; n < 6; n++) xmit_spi(pkt[n]);
+
+		/* Receive command response */
+		if (cmd == CMD12) rcvr_spi();		/* Skip a stuff byte when stop reading */
+
+		n = 10;								/* Wait for a valid response in timeout of 10 attempts */
+		do
+			res = rcvr_spi();
+		while ((res & 0x80) && --n);
+
+		if ((res & 0x88) != 0x08) break;	/* Not a command CRC error */
+		Errors.crc_cmd++;
+		if (!--retry) break;
+		Errors.retries++;
+	}
 
 	return res;			/* Return with the response value */
 }
@@ -671,22 +1105,25 @@ DSTATUS disk_initialize (
 	BYTE drv		/* Physical drive number (0) */
 )
 {
-	BYTE n, cmd, ty, ocr[4];
+	BYTE n, cmd, ty, ocr[4], csd[16];
+	DWORD start;
 
 	if (drv) return STA_NOINIT;			/* Supports only single drive */
 	if (Stat & STA_NODISK) return Stat;	/* No card in the socket */
 
 	power_on();							/* Force socket power on and initialize interface */
+	ReadNext = READ_NONE;
 	interface_speed(INTERFACE_SLOW);
 	for (n = 10; n; n--) rcvr_spi();	/* 80 dummy clocks */
 
 	ty = 0;
+	start = tick_us();
 	if (send_cmd(CMD0, 0) == 1) {			/* Enter Idle state */
 		Timer1 = 100;						/* Initialization timeout of 1000 milliseconds */
 		if (send_cmd(CMD8, 0x1AA) == 1) {	/* SDHC */
 			for (n = 0; n < 4; n++) ocr[n] = rcvr_spi();		/* Get trailing return value of R7 response */
 			if (ocr[2] == 0x01 && ocr[3] == 0xAA) {				/* The card can work at VDD range of 2.7-3.6V */
-				while (Timer1 && send_cmd(ACMD41, 1UL << 30));	/* Wait for leaving idle state (ACMD41 with HCS bit) */
+				while (Timer1 && send_cmd(ACMD41, 1UL << 30)) yield();	/* Wait for leaving idle state (ACMD41 with HCS bit) */
 				if (Timer1 && send_cmd(CMD58, 0) == 0) {		/* Check CCS bit in the OCR */
 					for (n = 0; n < 4; n++) ocr[n] = rcvr_spi();
 					ty = (ocr[0] & 0x40) ? CT_SD2 | CT_BLOCK : CT_SD2;
@@ -698,12 +1135,20 @@ DSTATUS disk_initialize (
 			} else {
 				ty = CT_MMC; cmd = CMD1;	/* MMC */
 			}
-			while (Timer1 && send_cmd(cmd, 0));			/* Wait for leaving idle state */
+			while (Timer1 && send_cmd(cmd, 0)) yield();	/* Wait for leaving idle state */
 			if (!Timer1 || send_cmd(CMD16, 512) != 0)	/* Set R/W block length to 512 */
 				ty = 0;
 		}
 	}
+	busy_add(&Busy.init, tick_us() - start);
 	CardType = ty;
+#if STM32_SD_USE_CRC
+	if (ty) send_cmd(CMD59, 1);			/* CRC on, a card without stays in CRC off mode */
+#endif
+	if (ty) {							/* Fast clock from TRAN_SPEED, 25MHz if the CSD is unreadable */
+		n = (send_cmd(CMD9, 0) == 0 && rcvr_datablock(csd, 16)) ? csd[3] : 0x32;
+		SpiFast = fast_prescaler(n);
+	}
 	release_spi();
 
 	if (ty) {			/* Initialization succeeded */
@@ -736,16 +1181,13 @@ DSTATUS disk_status (
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
-	BYTE drv,			/* Physical drive number (0) */
+static
+BOOL read_blocks (
 	BYTE *buff,			/* Pointer to the data buffer to store read data */
 	DWORD sector,		/* Start sector number (LBA) */
 	BYTE count			/* Sector count (1..255) */
 )
 {
-	if (drv || !count) return RES_PARERR;
-	if (Stat & STA_NOINIT) return RES_NOTRDY;
-
 	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
 
 	if (count == 1) {	/* Single block read */
@@ -768,7 +1210,72 @@ DRESULT disk_read (
 	}
 	release_spi();
 
-	return count ? RES_ERROR : RES_OK;
+	return count == 0;
+}
+
+/* Read-ahead: continue the open CMD18 when sector follows the last read */
+static
+BOOL read_stream (
+	BYTE *buff,			/* Pointer to the data buffer to store read data */
+	DWORD sector,		/* Start sector number (LBA) */
+	BYTE count			/* Sector count (1..255) */
+)
+{
+	if (sector != ReadNext) {
+		read_stop();
+		if (send_cmd(CMD18, (CardType & CT_BLOCK) ? sector : sector * 512) != 0) {
+			release_spi();
+			return FALSE;
+		}
+		ReadNext = sector;
+	}
+
+	do {
+		if (!rcvr_datablock(buff, 512)) {
+			read_stop();
+			return FALSE;
+		}
+		buff += 512;
+		ReadNext++;
+	} while (--count);
+
+	return TRUE;					/* Card left selected for the next block */
+}
+
+/* End the read-ahead CMD18, before any other access to the card */
+static
+void read_stop (void)
+{
+	if (ReadNext == READ_NONE) return;
+	ReadNext = READ_NONE;
+	send_cmd(CMD12, 0);				/* STOP_TRANSMISSION */
+	release_spi();
+}
+
+DRESULT disk_read (
+	BYTE drv,			/* Physical drive number (0) */
+	BYTE *buff,			/* Pointer to the data buffer to store read data */
+	DWORD sector,		/* Start sector number (LBA) */
+	BYTE count			/* Sector count (1..255) */
+)
+{
+	BOOL ok;
+	BYTE n;
+
+	if (drv || !count) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	async_wait();
+
+	for (n = 1; ; n++) {	/* Retry on CRC errors, at a slower clock if they persist */
+		CrcFailed = FALSE;
+		ok = ReadAhead ? read_stream(buff, sector, count) : read_blocks(buff, sector, count);
+		if (ok || !CrcFailed || n >= SD_RETRIES) break;
+		Errors.retries++;
+		if (n > 1) interface_slower();
+	}
+	if (!ok) Errors.failures++;
+
+	return ok ? RES_OK : RES_ERROR;
 }
 
 
@@ -779,17 +1286,13 @@ DRESULT disk_read (
 
 #if _FS_READONLY == 0
 
-DRESULT disk_write (
-	BYTE drv,			/* Physical drive number (0) */
+static
+BOOL write_blocks (
 	const BYTE *buff,	/* Pointer to the data to be written */
 	DWORD sector,		/* Start sector number (LBA) */
 	BYTE count			/* Sector count (1..255) */
 )
 {
-	if (drv || !count) return RES_PARERR;
-	if (Stat & STA_NOINIT) return RES_NOTRDY;
-	if (Stat & STA_PROTECT) return RES_WRPRT;
-
 	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
 
 	if (count == 1) {	/* Single block write */
@@ -810,10 +1313,325 @@ DRESULT disk_write (
 	}
 	release_spi();
 
-	return count ? RES_ERROR : RES_OK;
+	return count == 0;
+}
+
+DRESULT disk_write (
+	BYTE drv,			/* Physical drive number (0) */
+	const BYTE *buff,	/* Pointer to the data to be written */
+	DWORD sector,		/* Start sector number (LBA) */
+	BYTE count			/* Sector count (1..255) */
+)
+{
+	BOOL ok;
+	BYTE n;
+
+	if (drv || !count) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (Stat & STA_PROTECT) return RES_WRPRT;
+	async_wait();
+	read_stop();
+
+	for (n = 1; ; n++) {	/* Retry blocks rejected for their CRC, as disk_read() */
+		CrcFailed = FALSE;
+		ok = write_blocks(buff, sector, count);
+		if (ok || !CrcFailed || n >= SD_RETRIES) break;
+		Errors.retries++;
+		if (n > 1) interface_slower();
+	}
+	if (!ok) Errors.failures++;
+
+	return ok ? RES_OK : RES_ERROR;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Streamed Write                                                        */
+/*-----------------------------------------------------------------------*/
+/* One CMD25 fed a block at a time by the caller, for runs that do not   */
+/* fit in RAM. Nothing else may access the card until disk_write_end().  */
+/* Blocks are not retried: on an error the caller starts the run over.   */
+
+static BOOL WriteOpen;		/* disk_write_begin() stream in progress */
+static BYTE WriteLeft;		/* Blocks announced and not sent yet */
+
+DRESULT disk_write_begin (
+	BYTE drv,			/* Physical drive number (0) */
+	DWORD sector,		/* Start sector number (LBA) */
+	BYTE count			/* Sector count (1..255) */
+)
+{
+	if (drv || !count || WriteOpen) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (Stat & STA_PROTECT) return RES_WRPRT;
+	async_wait();
+	read_stop();
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
+
+	if (CardType & CT_SDC) send_cmd(ACMD23, count);	/* Pre-erase the run */
+	if (send_cmd(CMD25, sector) != 0) {	/* WRITE_MULTIPLE_BLOCK */
+		release_spi();
+		Errors.failures++;
+		return RES_ERROR;
+	}
+	WriteOpen = TRUE;
+	WriteLeft = count;
+
+	return RES_OK;						/* Card left selected */
+}
+
+DRESULT disk_write_block (
+	BYTE drv,			/* Physical drive number (0) */
+	const BYTE *buff	/* 512 bytes, the next block of the stream */
+)
+{
+	if (drv || !WriteOpen || !WriteLeft) return RES_PARERR;
+
+	if (!xmit_datablock(buff, 0xFC)) {	/* The stream ends on the error */
+		xmit_datablock(0, 0xFD);		/* STOP_TRAN token */
+		release_spi();
+		WriteOpen = FALSE;
+		Errors.failures++;
+		return RES_ERROR;
+	}
+	WriteLeft--;
+
+	return RES_OK;
+}
+
+DRESULT disk_write_end (
+	BYTE drv			/* Physical drive number (0) */
+)
+{
+	BOOL ok;
+
+	if (drv) return RES_PARERR;
+	if (!WriteOpen) return RES_ERROR;	/* Ended by a block error */
+
+	ok = xmit_datablock(0, 0xFD);		/* STOP_TRAN token */
+	release_spi();
+	WriteOpen = FALSE;
+	if (!ok) Errors.failures++;
+
+	return (ok && !WriteLeft) ? RES_OK : RES_ERROR;	/* Blocks missing are undefined */
+}
+#endif /* _READONLY == 0 */
+
+
+
+#ifdef STM32_SD_USE_DMA
+/*-----------------------------------------------------------------------*/
+/* Asynchronous Read/Write Sector(s)                                     */
+/*-----------------------------------------------------------------------*/
+/* The command is sent at once. disk_async_poll() then checks the card a */
+/* few bytes at a time and the DMA interrupt moves each block. buff must */
+/* stay untouched until disk_async_poll() returns FALSE or the callback. */
+
+static
+void async_finish (
+	DRESULT res
+)
+{
+	release_spi();
+	async_result = res;
+	AsyncState = ASYNC_IDLE;
+	if (async_done) async_done(res);
+}
+
+static
+void async_abort (void)
+{
+	if (async_multi) {
+		if (!async_write) {
+			send_cmd(CMD12, 0);				/* STOP_TRANSMISSION */
+		}
+#if _FS_READONLY == 0
+		else if (!async_stop) {
+			xmit_datablock(0, 0xFD);		/* STOP_TRAN token */
+		}
+#endif
+	}
+	async_finish(RES_ERROR);
+}
+
+static
+void async_wait (void)
+{
+	while (disk_async_poll()) {
+		__disable_irq();				/* As in dma_wait() */
+		if (AsyncState == ASYNC_DMA) __WFI();
+		__enable_irq();
+	}
+}
+
+DRESULT disk_read_async (
+	BYTE drv,			/* Physical drive number (0) */
+	BYTE *buff,			/* Pointer to the data buffer to store read data */
+	DWORD sector,		/* Start sector number (LBA) */
+	BYTE count,			/* Sector count (1..255) */
+	disk_async_callback done	/* Called from disk_async_poll() at the end, may be 0 */
+)
+{
+	if (drv || !count) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	async_wait();
+	read_stop();
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
+
+	async_multi = (count > 1);
+	if (send_cmd(async_multi ? CMD18 : CMD17, sector) != 0) {
+		release_spi();
+		return RES_ERROR;
+	}
+
+	async_write = FALSE;
+	async_rbuff = buff;
+	async_count = count;
+	async_done = done;
+	Timer1 = 10;
+	async_since = tick_us();
+	AsyncState = ASYNC_WAIT_TOKEN;
+
+	return RES_OK;
+}
+
+#if _FS_READONLY == 0
+DRESULT disk_write_async (
+	BYTE drv,			/* Physical drive number (0) */
+	const BYTE *buff,	/* Pointer to the data to be written */
+	DWORD sector,		/* Start sector number (LBA) */
+	BYTE count,			/* Sector count (1..255) */
+	disk_async_callback done	/* Called from disk_async_poll() at the end, may be 0 */
+)
+{
+	if (drv || !count) return RES_PARERR;
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (Stat & STA_PROTECT) return RES_WRPRT;
+	async_wait();
+	read_stop();
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
+
+	async_multi = (count > 1);
+	if (async_multi && (CardType & CT_SDC)) send_cmd(ACMD23, count);
+	if (send_cmd(async_multi ? CMD25 : CMD24, sector) != 0) {
+		release_spi();
+		return RES_ERROR;
+	}
+
+	async_write = TRUE;
+	async_stop = !async_multi;
+	async_wbuff = buff;
+	async_count = count;
+	async_done = done;
+	Timer2 = 50;
+	async_since = tick_us();
+	AsyncState = ASYNC_WAIT_READY;
+
+	return RES_OK;
 }
 #endif /* _READONLY == 0 */
 
+/* Advance the pending transfer, TRUE while it is not finished */
+BOOL disk_async_poll (void)
+{
+	BYTE n, res = 0xFF;
+	WORD crc, rx;
+
+	switch (AsyncState) {
+	case ASYNC_WAIT_TOKEN:
+		for (n = ASYNC_POLL_BYTES; n && res == 0xFF; n--) {
+			res = rcvr_spi();
+		}
+		if (res == 0xFE) {					/* Data token, move the block */
+			busy_add(&Busy.token, tick_us() - async_since);
+			AsyncState = ASYNC_DMA;
+			async_hw = block_start(TRUE, async_rbuff, 512);
+		} else if (res != 0xFF || !Timer1) {
+			async_abort();
+		}
+		break;
+
+	case ASYNC_WAIT_READY:
+		for (n = ASYNC_POLL_BYTES; n && res != 0xFF; n--) {
+			res = rcvr_spi();
+		}
+		if (res != 0xFF) {					/* Still busy */
+			if (!Timer2) async_abort();
+			break;
+		}
+		busy_add(&Busy.ready, tick_us() - async_since);
+		if (async_count) {					/* Next block */
+			xmit_spi(async_multi ? 0xFC : 0xFE);
+			AsyncState = ASYNC_DMA;
+			async_hw = block_start(FALSE, async_wbuff, 512);
+		} else if (!async_stop) {			/* Last block of CMD25 done */
+			xmit_spi(0xFD);					/* STOP_TRAN token */
+			rcvr_spi();
+			async_stop = TRUE;
+			Timer2 = 50;
+			async_since = tick_us();
+		} else {							/* Card done programming */
+			async_finish(RES_OK);
+		}
+		break;
+
+	case ASYNC_DMA_DONE:
+		/* No retry here on a CRC error, the caller falls back to disk_read()/disk_write() */
+		crc = block_end(!async_write, async_rbuff, 512, async_hw);
+		if (async_write) {
+			xmit_spi((BYTE)(crc >> 8));		/* CRC */
+			xmit_spi((BYTE)crc);
+			res = rcvr_spi() & 0x1F;		/* Data response */
+			if (res == 0x0B) Errors.crc_write++;
+		} else {
+			rx = (WORD)rcvr_spi() << 8;		/* Check CRC */
+			rx |= rcvr_spi();
+			res = (rx == crc) ? 0x05 : 0x0B;
+			if (res == 0x0B) Errors.crc_read++;
+		}
+		if (res != 0x05) {
+			Errors.failures++;
+			async_abort();
+			break;
+		}
+		if (async_write)
+			async_wbuff += 512;
+		else
+			async_rbuff += 512;
+		async_count--;
+		async_since = tick_us();
+		if (async_write) {
+			Timer2 = 50;
+			AsyncState = ASYNC_WAIT_READY;
+		} else if (async_count) {
+			Timer1 = 10;
+			AsyncState = ASYNC_WAIT_TOKEN;
+		} else {
+			if (async_multi) send_cmd(CMD12, 0);	/* STOP_TRANSMISSION */
+			async_finish(RES_OK);
+		}
+		break;
+
+	case ASYNC_DMA:
+	case ASYNC_IDLE:
+	default:
+		break;
+	}
+
+	return AsyncState != ASYNC_IDLE;
+}
+
+/* Result of the last asynchronous transfer */
+DRESULT disk_async_result (void)
+{
+	return async_result;
+}
+#endif /* STM32_SD_USE_DMA */
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -828,10 +1646,12 @@ DRESULT disk_ioctl (
 )
 {
 	DRESULT res;
-	BYTE n, csd[16], *ptr = buff;
+	BYTE n, csd[64], *ptr = buff;
 	WORD csize;
 
 	if (drv) return RES_PARERR;
+	async_wait();
+	read_stop();
 
 	res = RES_ERROR;
 
@@ -887,8 +1707,7 @@ DRESULT disk_ioctl (
 			if (CardType & CT_SD2) {	/* SDC version 2.00 */
 				if (send_cmd(ACMD13, 0) == 0) {	/* Read SD status */
 					rcvr_spi();
-					if (rcvr_datablock(csd, 16)) {				/* Read partial block */
-						for (n = 64 - 16; n; n--) rcvr_spi();	/* Purge trailing data */
+					if (rcvr_datablock(csd, 64)) {				/* Whole block, for its CRC */
 						*(DWORD*)buff = 16UL << (csd[10] >> 4);
 						res = RES_OK;
 					}
@@ -929,6 +1748,26 @@ DRESULT disk_ioctl (
 			}
 			break;
 
+		case MMC_GET_ERRORS :	/* Error counters and fast clock (DISK_ERRORS) */
+			((DISK_ERRORS*)buff)->crc_read = Errors.crc_read;
+			((DISK_ERRORS*)buff)->crc_write = Errors.crc_write;
+			((DISK_ERRORS*)buff)->crc_cmd = Errors.crc_cmd;
+			((DISK_ERRORS*)buff)->retries = Errors.retries;
+			((DISK_ERRORS*)buff)->failures = Errors.failures;
+			((DISK_ERRORS*)buff)->prescaler = SpiFast;
+			res = RES_OK;
+			break;
+
+		case MMC_GET_BUSY :		/* Card busy times (DISK_BUSY) */
+			*(DISK_BUSY*)buff = Busy;
+			res = RES_OK;
+			break;
+
+		case MMC_READ_AHEAD :	/* Keep CMD18 open across sequential reads (1 byte: 0/1) */
+			ReadAhead = *ptr;
+			res = RES_OK;
+			break;
+
 		case MMC_GET_SDSTAT :	/* Receive SD status as a data block (64 bytes) */
 			if (send_cmd(ACMD13, 0) == 0) {	/* SD_STATUS */
 				rcvr_spi();
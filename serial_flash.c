@@ -0,0 +1,390 @@
+#include <stdio.h>
+
+#include "stm32f10x.h"
+#include "stm32f10x_gpio.h"
+#include "stm32f10x_rcc.h"
+#include "stm32f10x_spi.h"
+#include "stm32f10x_dma.h"
+
+#include "timer.h"
+#include "serial_flash.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+#define SF_SPI					SPI1
+#define SF_SPI_PORT				GPIOA
+#define SF_SCK_PIN				GPIO_Pin_5
+#define SF_MISO_PIN				GPIO_Pin_6
+#define SF_MOSI_PIN				GPIO_Pin_7
+#define SF_DMA_RX				DMA1_Channel2
+#define SF_DMA_TX				DMA1_Channel3
+#define SF_DMA_FLAG_TC_RX		DMA1_FLAG_TC2
+
+#define SF_SELECT()				GPIO_ResetBits(SF_CS_PORT, SF_CS_PIN)
+#define SF_DESELECT()			GPIO_SetBits(SF_CS_PORT, SF_CS_PIN)
+
+/* Shorter transfers are done by the CPU */
+#define SF_DMA_MIN				16
+
+/* Status reads between two calls of the yield hook */
+#define SF_POLL_READS			8
+
+/* Deep power-down exit time (tRES1), the slowest of the usual parts */
+#define SF_WAKE_US				30
+
+/* Worst case program and erase times, ms */
+#define SF_PAGE_TIMEOUT			(10 * TICK_1MS)
+#define SF_SECTOR_TIMEOUT		(3 * TICK_1S)
+#define SF_BULK_TIMEOUT			(250 * TICK_1S)
+
+struct serial_flash_stats_s serial_flash_stats;
+
+static serial_flash_yield_hook yield_hook;
+static uint32_t flash_size;
+/* The chip ignores everything but the wake up command while asleep */
+static bool asleep;
+/* Program or erase sent and not seen finished, its timeout */
+static bool pending;
+static uint32_t pending_timeout;
+static tick_t pending_start;
+
+static uint8_t sf_xfer(uint8_t out){
+	while (SPI_I2S_GetFlagStatus(SF_SPI, SPI_I2S_FLAG_TXE) == RESET);
+	SPI_I2S_SendData(SF_SPI, out);
+	while (SPI_I2S_GetFlagStatus(SF_SPI, SPI_I2S_FLAG_RXNE) == RESET);
+	return SPI_I2S_ReceiveData(SF_SPI);
+}
+
+static void sf_command(uint8_t cmd, uint32_t address){
+	sf_xfer(cmd);
+	sf_xfer(address >> 16);
+	sf_xfer(address >> 8);
+	sf_xfer(address);
+}
+
+/*
+ * Move a buffer with DMA, the TX channel sends the padding byte on a
+ * read and the RX channel drops the input on a write. The DMA stores
+ * into buf on a read only.
+ */
+static void sf_dma(bool receive, const uint8_t *buf, uint16_t len){
+	DMA_InitTypeDef DMA_InitStructure;
+	static uint8_t work;
+
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(&(SF_SPI->DR));
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_BufferSize = len;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+
+	DMA_DeInit(SF_DMA_RX);
+	DMA_DeInit(SF_DMA_TX);
+
+	work = SF_SPI_PADDING;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)(receive ? buf : &work);
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_MemoryInc = receive ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+	DMA_Init(SF_DMA_RX, &DMA_InitStructure);
+
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)(receive ? &work : buf);
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_MemoryInc = receive ? DMA_MemoryInc_Disable : DMA_MemoryInc_Enable;
+	DMA_Init(SF_DMA_TX, &DMA_InitStructure);
+
+	DMA_Cmd(SF_DMA_RX, ENABLE);
+	DMA_Cmd(SF_DMA_TX, ENABLE);
+	SPI_I2S_DMACmd(SF_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE);
+
+	/* A page at 36MHz is 57us, not worth an interrupt */
+	while (DMA_GetFlagStatus(SF_DMA_FLAG_TC_RX) == RESET);
+
+	SPI_I2S_DMACmd(SF_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE);
+	DMA_Cmd(SF_DMA_RX, DISABLE);
+	DMA_Cmd(SF_DMA_TX, DISABLE);
+}
+
+static void sf_wake(void){
+	uint32_t start;
+
+	if (asleep == FALSE) {
+		return;
+	}
+	SF_SELECT();
+	sf_xfer(SF_WAKE_UP);
+	SF_DESELECT();
+	start = tick_us();
+	while (tick_us() - start < SF_WAKE_US);
+	asleep = FALSE;
+	serial_flash_stats.wakeups++;
+}
+
+/* Wait for the end of the pending program or erase */
+static uint8_t sf_wait(void){
+	uint32_t start, us;
+	uint8_t status, n;
+
+	if (pending == FALSE) {
+		return SF_OK;
+	}
+	start = tick_us();
+	for (;;) {
+		SF_SELECT();
+		sf_xfer(SF_READ_STATUS);
+		n = SF_POLL_READS;
+		do {
+			status = sf_xfer(SF_SPI_PADDING);
+		} while ((status & SF_WRITE_IN_PROGRESS) && --n);
+		SF_DESELECT();
+		if ((status & SF_WRITE_IN_PROGRESS) == 0) {
+			break;
+		}
+		if (expire_timer(pending_start, pending_timeout)) {
+			serial_flash_stats.timeouts++;
+			DEBUGF("serial flash: timeout, status %02x\n", status);
+			return SF_TIMEOUT;
+		}
+		if (yield_hook) {
+			yield_hook();
+		}
+	}
+	pending = FALSE;
+
+	us = tick_us() - start;
+	serial_flash_stats.busy_us += us;
+	if (us > serial_flash_stats.busy_max_us) {
+		serial_flash_stats.busy_max_us = us;
+	}
+	return SF_OK;
+}
+
+/* Ready for a new command: awake and not busy */
+static uint8_t sf_ready(void){
+	sf_wake();
+	return sf_wait();
+}
+
+static void sf_start(uint32_t timeout){
+	pending = TRUE;
+	pending_timeout = timeout;
+	pending_start = tick_1khz();
+}
+
+void serial_flash_spi_config(void){
+	GPIO_InitTypeDef GPIO_InitStructure;
+	SPI_InitTypeDef SPI_InitStructure;
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA | RCC_APB2Periph_SPI1, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+
+	GPIO_SetBits(SF_CS_PORT, SF_CS_PIN);
+	GPIO_InitStructure.GPIO_Pin = SF_CS_PIN;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
+	GPIO_Init(SF_CS_PORT, &GPIO_InitStructure);
+
+	GPIO_InitStructure.GPIO_Pin = SF_SCK_PIN | SF_MOSI_PIN;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
+	GPIO_Init(SF_SPI_PORT, &GPIO_InitStructure);
+
+	GPIO_InitStructure.GPIO_Pin = SF_MISO_PIN;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+	GPIO_Init(SF_SPI_PORT, &GPIO_InitStructure);
+
+	/* Mode 0, 72MHz/2: within fast read and status read limits, not SF_READ */
+	SPI_I2S_DeInit(SF_SPI);
+	SPI_InitStructure.SPI_Direction = SPI_Direction_2Lines_FullDuplex;
+	SPI_InitStructure.SPI_Mode = SPI_Mode_Master;
+	SPI_InitStructure.SPI_DataSize = SPI_DataSize_8b;
+	SPI_InitStructure.SPI_CPOL = SPI_CPOL_Low;
+	SPI_InitStructure.SPI_CPHA = SPI_CPHA_1Edge;
+	SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
+	SPI_InitStructure.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_2;
+	SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
+	SPI_InitStructure.SPI_CRCPolynomial = 7;
+	SPI_Init(SF_SPI, &SPI_InitStructure);
+	SPI_Cmd(SF_SPI, ENABLE);
+}
+
+/* Identify the chip and leave it in deep power-down */
+void serial_flash_init(void){
+	uint16_t id;
+
+	serial_flash_spi_config();
+	asleep = TRUE;				/* maybe, since before the reset */
+	pending = FALSE;
+	id = serial_flash_readid();
+	flash_size = ((id & 0xFF) >= 16 && (id & 0xFF) <= 26) ? 1UL << (id & 0xFF) : 0;
+	DEBUGF("serial flash: id %04x, %lu KB\n", id, (unsigned long)(flash_size / 1024));
+	serial_flash_sleep();
+}
+
+void serial_flash_set_yield(serial_flash_yield_hook hook){
+	yield_hook = hook;
+}
+
+/* Memory type and capacity bytes of the JEDEC id, capacity = 2^low byte */
+uint16_t serial_flash_readid(void){
+	uint16_t id;
+
+	sf_ready();
+	SF_SELECT();
+	sf_xfer(SF_READ_ID);
+	sf_xfer(SF_SPI_PADDING);	/* manufacturer */
+	id = sf_xfer(SF_SPI_PADDING) << 8;
+	id |= sf_xfer(SF_SPI_PADDING);
+	SF_DESELECT();
+	return id;
+}
+
+/* Bytes, 0 when no chip answered */
+uint32_t serial_flash_size(void){
+	return flash_size;
+}
+
+uint8_t serial_flash_read_status(void){
+	uint8_t status;
+
+	sf_wake();
+	SF_SELECT();
+	sf_xfer(SF_READ_STATUS);
+	status = sf_xfer(SF_SPI_PADDING);
+	SF_DESELECT();
+	return status;
+}
+
+/* Non zero while a program or erase runs, never waits */
+uint8_t serial_flash_busy(void){
+	if (pending == FALSE) {
+		return 0;
+	}
+	if (serial_flash_read_status() & SF_WRITE_IN_PROGRESS) {
+		return 1;
+	}
+	pending = FALSE;
+	return 0;
+}
+
+void serial_flash_wait_write(void){
+	sf_ready();
+}
+
+void serial_write_enable(void){
+	SF_SELECT();
+	sf_xfer(SF_WRITE_ENABLE);
+	SF_DESELECT();
+}
+
+void serial_write_disable(void){
+	SF_SELECT();
+	sf_xfer(SF_WRITE_DISABLE);
+	SF_DESELECT();
+}
+
+/* Fast read, any length from any address */
+void serial_flash_read(uint32_t address, uint8_t *buf, uint16_t len){
+	uint16_t i;
+
+	sf_ready();
+	SF_SELECT();
+	sf_command(SF_READ_FAST, address);
+	sf_xfer(SF_SPI_PADDING);	/* dummy byte */
+	if (len >= SF_DMA_MIN) {
+		sf_dma(TRUE, buf, len);
+	} else {
+		for (i = 0; i < len; i++) {
+			buf[i] = sf_xfer(SF_SPI_PADDING);
+		}
+	}
+	SF_DESELECT();
+	serial_flash_stats.reads++;
+	serial_flash_stats.read_bytes += len;
+}
+
+/*
+ * Program len bytes, split at the page boundaries. Returns when the last
+ * page program is started, the bytes must have been erased.
+ */
+uint8_t serial_flash_program(uint32_t address, const uint8_t *buf, uint16_t len){
+	uint16_t chunk, i;
+	uint8_t res;
+
+	while (len) {
+		chunk = SF_PAGE_SIZE - (address & (SF_PAGE_SIZE - 1));
+		if (chunk > len) {
+			chunk = len;
+		}
+		res = sf_ready();
+		if (res != SF_OK) {
+			return res;
+		}
+		serial_write_enable();
+		SF_SELECT();
+		sf_command(SF_PAGE_PROGRAM, address);
+		if (chunk >= SF_DMA_MIN) {
+			sf_dma(FALSE, buf, chunk);
+		} else {
+			for (i = 0; i < chunk; i++) {
+				sf_xfer(buf[i]);
+			}
+		}
+		SF_DESELECT();
+		sf_start(SF_PAGE_TIMEOUT);
+		serial_flash_stats.pages++;
+		address += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+	return SF_OK;
+}
+
+/* Erase the SF_SECTOR_SIZE sector holding address, returns once started */
+uint8_t serial_flash_sector_erase(uint32_t address){
+	uint8_t res;
+
+	res = sf_ready();
+	if (res != SF_OK) {
+		return res;
+	}
+	serial_write_enable();
+	SF_SELECT();
+	sf_command(SF_SECTOR_ERASE, address & SF_SECTOR_MASK);
+	SF_DESELECT();
+	sf_start(SF_SECTOR_TIMEOUT);
+	serial_flash_stats.erases++;
+	return SF_OK;
+}
+
+uint8_t serial_flash_erase(void){
+	uint8_t res;
+
+	res = sf_ready();
+	if (res != SF_OK) {
+		return res;
+	}
+	serial_write_enable();
+	SF_SELECT();
+	sf_xfer(SF_BULK_ERASE);
+	SF_DESELECT();
+	sf_start(SF_BULK_TIMEOUT);
+	return SF_OK;
+}
+
+/* Deep power-down once the pending program or erase is over */
+void serial_flash_sleep(void){
+	if (asleep) {
+		return;
+	}
+	sf_wait();
+	SF_SELECT();
+	sf_xfer(SF_DEEP_POWER_DOWN);
+	SF_DESELECT();
+	asleep = TRUE;
+}
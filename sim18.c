@@ -9,6 +9,7 @@
 #include "tools.h"
 #include "timer.h"
 #include "hw_config.h"
+#include "gpsstat.h"
 
 
 #ifdef DEBUG
@@ -25,6 +26,10 @@ struct sim18_data_s gps_mydata;
 uint8_t sim18_in_buf[128];
 uint8_t sim18_out_buf[128];
 
+/* An on/off pulse toggles the receiver, both states are kept to pulse
+ * only on a change */
+static bool sim18_powered = FALSE;
+static bool sim18_measuring = FALSE;
 
 
 static void sim18_v_ant_enable(void){
@@ -41,14 +46,21 @@ static void sim18_on_off_pulse(void){
 	GPIO_ResetBits(SIM18_Port, SIM18_ON_OFF);
 }
 
+static void sim18_power(bool on){
+	if (sim18_powered != on) {
+		sim18_on_off_pulse();
+		sim18_powered = on;
+	}
+}
+
 static void sim18_enable_int(void){
-	USART_ITConfig(USART1, USART_IT_TXE, ENABLE);
-	USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);
+	USART_ITConfig(USART2, USART_IT_TXE, ENABLE);
+	USART_ITConfig(USART2, USART_IT_RXNE, ENABLE);
 }
 
 static void sim18_disable_int(void){
-	USART_ITConfig(USART1, USART_IT_TXE, DISABLE);
-	USART_ITConfig(USART1, USART_IT_RXNE, DISABLE);
+	USART_ITConfig(USART2, USART_IT_TXE, DISABLE);
+	USART_ITConfig(USART2, USART_IT_RXNE, DISABLE);
 }
 
 void sim18_reset(void){
@@ -59,7 +71,7 @@ void sim18_reset(void){
 }
 
 bool sim18_awake(void){
-	GPIO_ReadInputDataBit(SIM18_Port, SIM18_WAKEUP);
+	return (GPIO_ReadInputDataBit(SIM18_Port, SIM18_WAKEUP) == Bit_SET);
 }
 
 void sim18_set_baudrate(enum sim18_BAUDRATE baudrate){
@@ -77,6 +89,7 @@ void sim18_set_baudrate(enum sim18_BAUDRATE baudrate){
 	USART_InitStructure.USART_Mode = USART_Mode_Tx | USART_Mode_Rx;
 	/* Configure the USART2 */
 	USART_Init(USART2, &USART_InitStructure);
+	USART_Cmd(USART2, ENABLE);
 
 	sim18_port_config.baudrate =  baudrate;
 	sim18_disable_int();
@@ -128,8 +141,10 @@ void sim18_Init(void){
 	/*TODO
 	 * Read last params from SD_CRAD and call a warn start.
 	 * if there aren't caal for a cold start
+	 * A reset out of standby leaves the receiver as it was.
 	 */
-	sim18_on_off_pulse();
+	sim18_powered = sim18_awake();
+	sim18_power(TRUE);
 	mdelay(100);
 	/*--------------------------------------------------
 	 * if(){	
@@ -141,6 +156,7 @@ void sim18_Init(void){
 	 * }
 	 *--------------------------------------------------*/
 	nmea_switch_to_sirf(sim18_115200);
+	USART2_Wait_Empty();
 	sim18_set_baudrate(sim18_115200);
 	sim18_switch_to_sirf();
 }
@@ -167,11 +183,16 @@ void sim18_write_data( uint32_t length){
 }
 
 void sim18_start_measure(void){
+	if (sim18_measuring == TRUE) {
+		return;
+	}
 	sim18_v_ant_enable();
-	sim18_on_off_pulse();
+	sim18_power(TRUE);
 	*sim18_in_buf = 0;
 	*sim18_out_buf = 0;
 	sim18_enable_int();
+	sim18_measuring = TRUE;
+	gpsstat_start();
 }
 
 
@@ -179,9 +200,34 @@ void sim18_sleep(void){
 	/*--------------------------------------------------
 	* TIM_Cmd(TIM3, DISABLE);
 	*--------------------------------------------------*/
+	if (sim18_measuring == FALSE && sim18_powered == FALSE) {
+		return;
+	}
+	if (sim18_measuring == TRUE) {
+		gpsstat_stop();
+	}
 	sim18_disable_int();
-	sim18_on_off_pulse();
+	sim18_power(FALSE);
 	sim18_v_ant_disable();
+	sim18_measuring = FALSE;
+}
+
+/* Coordinate in 1e-7 degree, as sent by the receiver */
+int32_t sim18_coordonate(const struct coordonate_s *point){
+	int32_t value;
+
+	value = (int32_t)point->degree * 10000000
+		+ ((int32_t)point->minute * 100000 + point->dec_minute) * 10 / 6;
+
+	return (point->cardinal == '-') ? -value : value;
+}
+
+/*
+ * Copy of the last fix. gps_mydata is written by sirf_process_frames() in
+ * the main loop, the USART2 ISR only queues frames, so no lock is taken.
+ */
+void sim18_get_fix(struct sim18_data_s *fix){
+	memcpy(fix, &gps_mydata, sizeof(struct sim18_data_s));
 }
 
 /*--------------------------------------------------
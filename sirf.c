@@ -7,6 +7,9 @@
 #include "sim18.h"
 #include "sirf.h"
 #include "tools.h"
+#include "logsched.h"
+#include "timer.h"
+#include "fifo.h"
 
 #ifdef DEBUG
 #define DEBUGF(x, args...) printf(x, ##args)
@@ -20,6 +23,13 @@
 uint8_t * sirf_in_buf;
 uint8_t * sirf_out_buf;
 
+/* Frames received by the USART2 ISR, waiting for the main loop */
+static uint8_t sirf_queue[SIRF_QUEUE_SIZE][SIRF_FRAME_MAX];
+static volatile uint16_t queue_head = 0;
+static volatile uint16_t queue_tail = 0;
+
+struct sirf_queue_stats_s sirf_queue_stats;
+
 
 #define sirf_CRC_FILL		0
 static uint8_t sirf_crc_calculate(uint16_t *crc, uint8_t *data){
@@ -163,7 +173,11 @@ int sirf_set_trickle_mode(void){
 }
 
 
-int sirf_set_msg_41_2s(void){
+/*
+ * Set the output period of message 41, in seconds (1 to 30).
+ * The log scheduler lowers the fix rate when nothing happens.
+ */
+int sirf_set_msg_41_rate(uint8_t period){
 	static uint8_t msg[] = {
 
 		0xA0, 0xA2, 
@@ -177,16 +191,25 @@ int sirf_set_msg_41_2s(void){
 		0xB0, 0xB3};
 
 	uint16_t length = ((((uint16_t)msg[2]) << 8) | msg[3]) + 8;
+
+	if (period < 1 || period > 30) {
+		return -1;
+	}
+	msg[7] = period;
 	sirf_add_crc(msg, sizeof(msg));
 
 	print_buf(msg, sizeof(msg));	
-	memcpy(msg, sirf_out_buf, length);
+	memcpy(sirf_out_buf, msg, length);
 
 	sim18_write_data(length);
 
 	return 0;
 }
 
+int sirf_set_msg_41_2s(void){
+	return sirf_set_msg_41_rate(logsched_fix_period());
+}
+
 void sirf_stop(void){
 	static uint8_t msg[] = {
 		0xA0, 0xA2, 0x00, 0x00,
@@ -207,22 +230,28 @@ void sirf_stop(void){
 
 
 
-static int translate_sirf_coordonnate(uint8_t * data, uint8_t *indice
+/*
+ * SiRF gives the coordinates in 1e-7 degree, they are stored as
+ * sign, degrees, minutes and 1e-5 minutes.
+ */
+static int translate_sirf_coordonnate(uint8_t * data, int *indice
 		, struct coordonate_s * point){
- 	int degree;
- 
- 	pop_int32(data, &indice, &degree);
+ 	int32_t degree;
+	uint32_t rest;
  
- 	point->degree = degree / 10000000;
- 	point->minute = (degree - (point->degree *  10000000)) / 60;
- 	point->dec_minute = (degree - (point->degree *  10000000)) % 60;
+ 	pop_int32(data, indice, (uint32_t *)&degree);
  
-/*	if(degree >= 0){
+	if(degree >= 0){
  		point->cardinal = '+';
  	}else{
  		point->cardinal = '-';
+		degree = -degree;
  	}	
-*/
+ 	point->degree = degree / 10000000;
+	rest = (uint32_t)(degree % 10000000) * 6;	/* 1e-6 minute */
+ 	point->minute = rest / 1000000;
+ 	point->dec_minute = (rest % 1000000) / 10;
+
  	return 0;
 }
 
@@ -240,30 +269,38 @@ static int translate_sirf_coordonnate(uint8_t * data, uint8_t *indice
 int sirf_parse_message_id_41(uint8_t *data){
  	
 	int indice;
+	uint16_t nav_valid, nav_type, week;
  	gps_mydata.lock = 1;
  
 	indice = SIRF_MSG_41_NAV_VALID_INDEX;
- 	pop_int16(data, &indice, &gps_mydata.data_valide);
-	pop_int16(data, &indice, &gps_mydata.gps_mode);
+ 	pop_int16(data, &indice, &nav_valid);
+	pop_int16(data, &indice, &nav_type);
+	gps_mydata.data_valide = (nav_valid != 0);
+	gps_mydata.gps_mode = (char)(nav_type & 0x00FF);
 
+	/* Week U2, time of week U4 */
 	indice = SIRF_MSG_41_EXT_WEEK_NUM_INDEX;
-	pop_int16(data, &indice, &gps_mydata.week_no);
- 	pop_int16(data, &indice, &gps_mydata.time_of_week);
+	pop_int16(data, &indice, &week);
+	gps_mydata.week_no = week;
+ 	pop_int32(data, &indice, &gps_mydata.time_of_week);
 
 	indice = SIRF_MSG_41_LAT_INDEX;
  	translate_sirf_coordonnate(data, &indice, &gps_mydata.latitude);
  	translate_sirf_coordonnate(data, &indice, &gps_mydata.longitude);
 
 	indice = SIRF_MSG_41_ALT_MSL_INDEX;
- 	pop_int32(data, &indice, &gps_mydata.altitude);
+ 	pop_int32(data, &indice, (uint32_t *)&gps_mydata.altitude);
 
  	indice = SIRF_MSG_41_SPEED_OVER_GOURND_INDEX;
  	pop_int16(data, &indice, &gps_mydata.speed_horizontal);
 
+	indice = SIRF_MSG_41_COURSE_OVER_GROUND_INDEX;
+ 	pop_int16(data, &indice, &gps_mydata.azimuth);
+
 	indice = SIRF_MSG_41_CLIMB_RATE_INDEX;
  	pop_int16(data, &indice, &gps_mydata.speed_vertical);
 
-	indice = SIRF_MSG_41_MONTH_INDEX;
+	indice = SIRF_MSG_41_YEAR_INDEX;
  	pop_int16(data, &indice, &gps_mydata.date_time.year);
  	gps_mydata.date_time.month	= *(data + indice++);
  	gps_mydata.date_time.day	= *(data + indice++);
@@ -276,8 +313,12 @@ int sirf_parse_message_id_41(uint8_t *data){
 
 	indice = SIRF_MSG_41_NB_SV_IN_FIX_INDEX;
  	gps_mydata.sat_number	= *(data + indice++);
+ 	gps_mydata.hdop			= *(data + indice++);
 	
 // 	gps_mydata.GPS_ALMANAC_RESET_MODE	= ;
+	if (nav_valid == 0) {
+		gps_mydata.fix_seq++;
+	}
  	gps_mydata.lock = 0;
  	return 0;
 }
@@ -285,8 +326,11 @@ int sirf_parse_message_id_41(uint8_t *data){
 int sirf_parse_data(void){
 
 	uint8_t * data = sirf_in_buf;
-	switch (*(data + 3))
+	switch (*(data + SIRF_MSG_41_ID_INDEX))
 	{
+		case 0x29:		/* Geodetic Navigation Information */
+			return sirf_parse_message_id_41(data);
+
 		/*--------------------------------------------------
 		* case 0x02:		/ * Measure Navigation Data Out * /
 		* 	return sirf_msg_navsol(session, buf, len);
@@ -477,7 +521,8 @@ void sirf_get_frame(uint8_t read_value){
 
 	switch (state){
 		case SIRF_WAIT_START1:
-			data_ptr = sirf_in_buf;
+			data_ptr = sirf_queue[queue_head];
+			frame_byte_number = 0;
 			if(read_value == (unsigned char)SIRF_CHAR_START_1){
 				state++;
 				*data_ptr = (uint8_t)read_value;
@@ -504,6 +549,9 @@ void sirf_get_frame(uint8_t read_value){
 			*data_ptr = (uint8_t)read_value;
 			data_ptr++;
 			frame_length |= read_value;
+			if (frame_length == 0 || frame_length > SIRF_FRAME_MAX - 8) {
+				state = SIRF_WAIT_START1;
+			}
 			break;
 		case SIRF_FILL_FRAME:
 			*data_ptr = (uint8_t)read_value;
@@ -552,15 +600,65 @@ void sirf_get_frame(uint8_t read_value){
 			break;
 	}
 	if (frame_completed){
-		/*--------------------------------------------------
-		* print_buf(data, frame_length + 8);
-		*--------------------------------------------------*/
+		/* Hand the frame to the main loop, drop it when the queue is full */
+		if (FIFO_FULL(queue_tail, queue_head, SIRF_QUEUE_SIZE)) {
+			sirf_queue_stats.overflow++;
+		} else {
+			FIFO_NEXT(queue_head, SIRF_QUEUE_SIZE);
+		}
+	}
+}
+
+/*
+ * Validate and parse queued frames, at most budget_frames frames or
+ * budget_us microseconds per call. The budget grows while a backlog
+ * remains after a pass and shrinks back once the queue is empty.
+ */
+int sirf_process_frames(void){
+	static uint8_t budget_frames = SIRF_DRAIN_FRAMES;
+	static uint32_t budget_us = SIRF_DRAIN_BUDGET_US;
+	uint32_t start = tick_us();
+	uint8_t depth, done = 0;
+
+	depth = FIFO_EMPTY(queue_tail, queue_head, SIRF_QUEUE_SIZE) ? 0
+		: FIFO_LEN(queue_tail, queue_head, SIRF_QUEUE_SIZE);
+	if (depth > sirf_queue_stats.max_depth) {
+		sirf_queue_stats.max_depth = depth;
+	}
+
+	while (FIFO_EMPTY(queue_tail, queue_head, SIRF_QUEUE_SIZE) == FALSE
+			&& done < budget_frames
+			&& (tick_us() - start) < budget_us) {
+		sirf_in_buf = sirf_queue[queue_tail];
 		if (sirf_validate_sentence()){
-			DEBUGF("VALIDATE ERROR '%s'\n", sirf_in_buf);
+			sirf_queue_stats.invalid++;
 		}else{
 			sirf_parse_data();
 		}
+		FIFO_NEXT(queue_tail, SIRF_QUEUE_SIZE);
+		done++;
+	}
+	sirf_queue_stats.processed += done;
+
+	if (FIFO_EMPTY(queue_tail, queue_head, SIRF_QUEUE_SIZE) == FALSE) {
+		if (budget_frames < SIRF_QUEUE_SIZE) {
+			budget_frames++;
+		}
+		if (budget_us < SIRF_DRAIN_BUDGET_US_MAX) {
+			budget_us <<= 1;
+		}
+	} else {
+		if (budget_frames > SIRF_DRAIN_FRAMES) {
+			budget_frames--;
+		}
+		if (budget_us > SIRF_DRAIN_BUDGET_US) {
+			budget_us >>= 1;
+		}
 	}
+	sirf_queue_stats.budget_frames = budget_frames;
+	sirf_queue_stats.budget_us = budget_us;
+
+	return done;
 }
 
 void sirf_init(void){
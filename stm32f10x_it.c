@@ -7,6 +7,9 @@
 #include "hw_config.h"
 
 #include "timer.h"
+#include "ff.h"
+#include "diskio.h"
+#include "logbuf.h"
 
 volatile uint16_t IC2Value = 0;
 volatile uint16_t IC1Value = 0;
@@ -187,6 +190,11 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
 	tick_increment();
+
+	/* SD card timeouts run at 100Hz */
+	if ((tick_1khz() % 10) == 0) {
+		disk_timerproc();
+	}
 }
 
 /*--------------------------------------------------
@@ -201,6 +209,12 @@ void DMA1_Channel1_IRQHandler(void)
 	DMA_ClearFlag(DMA1_FLAG_TC1);
 }
 
+/* SPI2 RX DMA, SD card block transfer complete */
+void DMA1_Channel4_IRQHandler(void)
+{
+	disk_dma_irq();
+}
+
 /*--------------------------------------------------
 * void SPI1_IRQHandler(void)
 * {
@@ -228,6 +242,12 @@ void USART2_IRQHandler(void)
 	USART2_Istr();
 }
 
+void PVD_IRQHandler(void)
+{
+	EXTI_ClearITPendingBit(EXTI_Line16);
+	logbuf_power_fail();
+}
+
 /**
  * @brief  This function handles RTC_IRQHandler .
  * @param  None
@@ -39,3 +39,20 @@ void tick_increment()
 {
   timer_1khz++;
 }
+
+/*
+ * Microsecond time stamp built from the 1 kHz tick and the SysTick
+ * down counter. Wraps every 71 minutes, only use it for differences.
+ */
+uint32_t tick_us(void)
+{
+  uint32_t ms, val, load;
+
+  load = SysTick->LOAD + 1;
+  do {
+    ms = timer_1khz;
+    val = SysTick->VAL;
+  } while (ms != timer_1khz);
+
+  return ms * 1000 + ((load - val) * 1000) / load;
+}
@@ -42,12 +42,12 @@ void push_int16(unsigned char *buf, unsigned char *indice, uint16_t data)
 	*--------------------------------------------------*/
 }
 
-void pop_int32(unsigned char *buf, unsigned char *indice, uint32_t *data)
+void pop_int32(unsigned char *buf, int *indice, uint32_t *data)
 {
 	int i;
 	*data = 0;
 	for (i = 0; i < 4; i++){
-		*data <<= (i << 8);
+		*data <<= 8;
 		*data |= *(buf + *indice);
 		*indice += 1;
 	}
@@ -61,12 +61,12 @@ void pop_int32(unsigned char *buf, unsigned char *indice, uint32_t *data)
 *--------------------------------------------------*/
 }
 
-void pop_int16(unsigned char *buf, unsigned char *indice, unsigned short *data)
+void pop_int16(unsigned char *buf, int *indice, unsigned short *data)
 {
 	int i;
 	*data = 0;
 	for (i = 0; i < 2; i++){
-		*data <<= (i << 8);
+		*data <<= 8;
 		*data |= *(buf + *indice);
 		*indice += 1;
 	}
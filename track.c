@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+#include "stm32f10x_rtc.h"
+
+#include "sim18.h"
+#include "track.h"
+#include "trackpack.h"
+#include "sht1x.h"
+#include "hw_config.h"
+#include "ff.h"
+#include "diskio.h"
+#include "logbuf.h"
+#include "flashlog.h"
+#include "logsched.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+static FIL track_file;
+static bool track_opened = FALSE;
+static DWORD track_linkmap[TRACK_LINKMAP_SIZE];
+/* Header CRC of the open file, seed of its record CRCs */
+static uint16_t track_seed;
+static DWORD track_records;
+static struct track_summary_s track_sum;
+/* Encoding of the open file and of new files */
+static uint16_t track_encoding;
+static uint16_t track_new_encoding = TRACK_ENCODING_DEFAULT;
+static struct trackpack_s track_pack;
+
+void track_header_encode(uint8_t *sector, uint16_t encoding){
+	memset(sector, 0, TRACK_HEADER_SIZE);
+	memcpy(sector + TRACK_HDR_MAGIC, TRACK_MAGIC, 4);
+	ST_WORD(sector + TRACK_HDR_VERSION, TRACK_VERSION);
+	ST_WORD(sector + TRACK_HDR_RECORD_SIZE, TRACK_RECORD_SIZE);
+	ST_WORD(sector + TRACK_HDR_RECORDS_PER_SECTOR, TRACK_RECORDS_PER_SECTOR);
+	ST_WORD(sector + TRACK_HDR_HEADER_SIZE, TRACK_HEADER_SIZE);
+	ST_WORD(sector + TRACK_HDR_ENCODING, encoding);
+	ST_DWORD(sector + TRACK_HDR_CREATED, RTC_GetCounter());
+	ST_DWORD(sector + TRACK_HDR_SERIAL, DEVICE_ID(0));
+	ST_DWORD(sector + TRACK_HDR_SERIAL + 4, DEVICE_ID(1));
+	ST_DWORD(sector + TRACK_HDR_SERIAL + 8, DEVICE_ID(2));
+	ST_WORD(sector + TRACK_HDR_CRC, track_crc(sector, TRACK_HDR_CRC));
+}
+
+void track_fill(struct track_point_s *point, const struct sim18_data_s *fix, uint8_t flags){
+	point->time = RTC_GetCounter();
+	point->latitude = sim18_coordonate(&fix->latitude);
+	point->longitude = sim18_coordonate(&fix->longitude);
+	point->altitude = fix->altitude;
+	point->speed = fix->speed_horizontal;
+	point->course = fix->azimuth;
+	point->sat_number = fix->sat_number;
+	point->hdop = fix->hdop;
+	point->temperature = SHT1x_get_data(TEMPERATURE);
+	point->humidity = SHT1x_get_data(HUMIDITY);
+	point->battery = vbat_value();
+	point->flags = flags;
+	if (fix->data_valide == 0) {
+		point->flags |= TRACK_FLAG_FIX;
+	}
+}
+
+static void track_summary_add(const struct track_point_s *point){
+	struct track_summary_s *sum = &track_sum;
+
+	if (sum->records++ == 0) {
+		sum->start = point->time;
+	}
+	sum->end = point->time;
+
+	if ((point->flags & TRACK_FLAG_FIX) == 0) {
+		return;
+	}
+	if (sum->fixes++ == 0) {
+		sum->lat_min = sum->lat_max = point->latitude;
+		sum->lon_min = sum->lon_max = point->longitude;
+	} else {
+		sum->distance += logsched_distance(point->latitude, point->longitude,
+				sum->latitude, sum->longitude);
+	}
+	if (point->latitude < sum->lat_min) {
+		sum->lat_min = point->latitude;
+	}
+	if (point->latitude > sum->lat_max) {
+		sum->lat_max = point->latitude;
+	}
+	if (point->longitude < sum->lon_min) {
+		sum->lon_min = point->longitude;
+	}
+	if (point->longitude > sum->lon_max) {
+		sum->lon_max = point->longitude;
+	}
+	sum->latitude = point->latitude;
+	sum->longitude = point->longitude;
+}
+
+/*
+ * Rebuild the summary of a reopened file, a sector at a time, and the
+ * packing state from its last sector. Return the number of records.
+ */
+static DWORD track_scan(uint8_t *sector){
+	struct track_point_s point;
+	DWORD records = 0;
+	UINT br, i;
+	BYTE ahead = 1;
+
+	memset(&track_pack, 0, sizeof(track_pack));
+	f_lseek(&track_file, TRACK_HEADER_SIZE);
+	disk_ioctl(0, MMC_READ_AHEAD, &ahead);	/* the reads are sequential */
+	while (f_read(&track_file, sector, TRACK_SECTOR_SIZE, &br) == FR_OK && br) {
+		if (track_encoding == TRACK_ENCODING_PACKED) {
+			memset(sector + br, 0, TRACK_SECTOR_SIZE - br);
+			track_pack.used = 0;
+			while (trackpack_decode(&track_pack, sector, &point, track_seed) == 0) {
+				track_summary_add(&point);
+				records++;
+			}
+		} else {
+			for (i = 0; i < br / TRACK_RECORD_SIZE; i++, records++) {
+				if (track_decode(sector + i * TRACK_RECORD_SIZE, &point, track_seed) == 0) {
+					track_summary_add(&point);
+				}
+			}
+		}
+	}
+	ahead = 0;
+	disk_ioctl(0, MMC_READ_AHEAD, &ahead);
+	track_pack.used = (track_file.fsize - TRACK_HEADER_SIZE) % TRACK_SECTOR_SIZE;
+	return records;
+}
+
+/* Map the file clusters so seeks and reads skip the FAT */
+static void track_map(void){
+	track_file.cltbl = track_linkmap;
+	track_linkmap[0] = TRACK_LINKMAP_SIZE;
+	if (f_lseek(&track_file, CREATE_LINKMAP) != FR_OK) {
+		DEBUGF("Track: %d fragments, no link map.\n", (int)(track_linkmap[0] / 2 - 1));
+		track_file.cltbl = 0;
+	}
+}
+
+/* Bytes in the clusters of the link map, the preallocated ones included */
+static DWORD track_allocated(void){
+	DWORD *tbl = track_linkmap + 1;
+	DWORD ncl = 0;
+
+	while (*tbl) {
+		ncl += *tbl;
+		tbl += 2;
+	}
+	return ncl * track_file.fs->csize * TRACK_SECTOR_SIZE;
+}
+
+/* Recovery unit: a record, or a sector of packed items */
+static DWORD track_unit(void){
+	return (track_encoding == TRACK_ENCODING_PACKED) ? TRACK_SECTOR_SIZE : TRACK_RECORD_SIZE;
+}
+
+/*
+ * Read the sector holding ofs around FatFs since it may lie past the
+ * file size, the last one read stays in sector.
+ */
+static int track_read(DWORD ofs, uint8_t *sector, DWORD *cached){
+	DWORD sect;
+
+	sect = f_map_sect(&track_file, ofs);
+	if (sect == 0) {
+		return -1;
+	}
+	if (sect != *cached) {
+		*cached = 0;
+		if (disk_read(track_file.fs->drive, sector, sect, 1) != RES_OK) {
+			return -1;
+		}
+		*cached = sect;
+	}
+	return 0;
+}
+
+/* TRUE when recovery unit index on the card belongs to the open file */
+static bool track_valid(DWORD index, uint8_t *sector, DWORD *cached){
+	struct track_point_s point;
+	DWORD ofs = TRACK_HEADER_SIZE + index * track_unit();
+
+	if (track_read(ofs, sector, cached)) {
+		return FALSE;
+	}
+	if (track_encoding == TRACK_ENCODING_PACKED) {
+		return (sector[0] == TRACKPACK_TAG_KEY
+				&& track_decode(sector + 1, &point, track_seed) == 0);
+	}
+	return (track_decode(sector + ofs % TRACK_SECTOR_SIZE, &point, track_seed) == 0
+			&& point.seq == (uint8_t)index);
+}
+
+/*
+ * Records are only synced to the directory every few minutes, the ones
+ * written since then sit past the file size in the preallocated block.
+ * They are written in order, so the last record, or the last packed
+ * sector, is found by a binary search over the allocated clusters.
+ * Return the end of the data.
+ */
+static DWORD track_recover(uint8_t *sector){
+	struct trackpack_s pack;
+	struct track_point_s point;
+	DWORD unit = track_unit();
+	DWORD lo, hi, mid;
+	DWORD cached = 0;
+
+	lo = (track_file.fsize - TRACK_HEADER_SIZE) / unit;
+	hi = (track_allocated() - TRACK_HEADER_SIZE) / unit;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (track_valid(mid - 1, sector, &cached)) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	if (track_encoding != TRACK_ENCODING_PACKED || lo == 0) {
+		return TRACK_HEADER_SIZE + lo * unit;
+	}
+	/* The packed items of the last sector end at the first bad or end tag */
+	lo = TRACK_HEADER_SIZE + (lo - 1) * unit;
+	if (track_read(lo, sector, &cached)) {
+		return track_file.fsize;
+	}
+	memset(&pack, 0, sizeof(pack));
+	while (trackpack_decode(&pack, sector, &point, track_seed) == 0) {
+	}
+	return lo + pack.used;
+}
+
+void track_set_encoding(uint16_t encoding){
+	if (encoding <= TRACK_ENCODING_PACKED) {
+		track_new_encoding = encoding;
+	}
+}
+
+/*
+ * Open or create a track file. A new file gets a contiguous block and
+ * its header sector, an existing one is checked, gets back the records
+ * lost with the directory update and is cut to its last whole record.
+ * Closed before a standby, it was trimmed to its data: a new block is
+ * appended for the rest of the day.
+ */
+int track_open(const char *path){
+	uint8_t sector[TRACK_HEADER_SIZE];
+	DWORD end, records, allocated;
+	UINT bw;
+
+	memset(&track_sum, 0, sizeof(track_sum));
+
+	if (f_open(&track_file, path, FA_OPEN_ALWAYS | FA_READ | FA_WRITE) != FR_OK) {
+		DEBUGF("Track: cannot open %s.\n", path);
+		return -1;
+	}
+	/* Sectors staged in the flash before a power loss, recovered below */
+	flashlog_restore(&track_file);
+
+	if (track_file.fsize < TRACK_HEADER_SIZE) {
+		if (track_file.fsize == 0
+				&& f_expand(&track_file, TRACK_PREALLOC_SIZE) != FR_OK) {
+			DEBUGF("Track: no contiguous space for %s.\n", path);
+		}
+		track_encoding = track_new_encoding;
+		track_header_encode(sector, track_encoding);
+		track_seed = LD_WORD(sector + TRACK_HDR_CRC);
+		f_lseek(&track_file, 0);
+		if (f_write(&track_file, sector, TRACK_HEADER_SIZE, &bw) != FR_OK
+				|| bw != TRACK_HEADER_SIZE) {
+			f_close(&track_file);
+			return -2;
+		}
+		f_truncate(&track_file);
+	} else {
+		if (f_read(&track_file, sector, TRACK_HEADER_SIZE, &bw) != FR_OK
+				|| bw != TRACK_HEADER_SIZE || track_header_check(sector)) {
+			DEBUGF("Track: %s is not a track file.\n", path);
+			f_close(&track_file);
+			return -3;
+		}
+		track_encoding = LD_WORD(sector + TRACK_HDR_ENCODING);
+		track_seed = LD_WORD(sector + TRACK_HDR_CRC);
+		end = track_file.fsize;
+		if (track_encoding == TRACK_ENCODING_FIXED) {
+			end -= (end - TRACK_HEADER_SIZE) % TRACK_RECORD_SIZE;
+		}
+		track_map();
+		if (track_file.cltbl) {
+			end = track_recover(sector);
+			if (end > track_file.fsize) {
+				DEBUGF("Track: %d bytes recovered.\n", (int)(end - track_file.fsize));
+			}
+		}
+		/* Past the file size this extends it over the recovered data */
+		f_lseek(&track_file, end);
+		if (end != track_file.fsize) {
+			f_truncate(&track_file);
+		}
+		allocated = track_file.cltbl ? track_allocated() : track_file.fsize;
+		if (allocated < TRACK_PREALLOC_SIZE
+				&& f_expand(&track_file, TRACK_PREALLOC_SIZE - allocated) != FR_OK) {
+			DEBUGF("Track: no contiguous space to extend %s.\n", path);
+		}
+	}
+	f_sync(&track_file);
+	if (track_file.cltbl == 0) {
+		track_map();
+	}
+	records = track_scan(sector);
+	f_lseek(&track_file, track_file.fsize);
+
+	if (logbuf_Init(&track_file)) {
+		f_close(&track_file);
+		return -4;
+	}
+
+	track_records = records;
+	track_opened = TRUE;
+	DEBUGF("Track: %s, %d records.\n", path, (int)records);
+	return 0;
+}
+
+/* Append one record to the write-behind ring, point->seq is set here */
+int track_write(struct track_point_s *point){
+	uint8_t item[TRACKPACK_ITEM_MAX];
+	uint8_t len;
+
+	if (track_opened == FALSE) {
+		return -1;
+	}
+
+	point->seq = (uint8_t)track_records++;
+	track_summary_add(point);
+	if (track_encoding == TRACK_ENCODING_PACKED) {
+		len = trackpack_encode(&track_pack, point, item, track_seed);
+		if (len == 0) {
+			/* Items never straddle sectors, the next one starts with a key */
+			logbuf_pad();
+			track_pack.used = 0;
+			len = trackpack_encode(&track_pack, point, item, track_seed);
+		}
+	} else {
+		track_encode(point, item, track_seed);
+		len = TRACK_RECORD_SIZE;
+	}
+	/* On error the record is still queued in the ring */
+	if (logbuf_write(item, len)) {
+		return -2;
+	}
+	return 0;
+}
+
+int track_close(void){
+	if (track_opened == FALSE) {
+		return 0;
+	}
+	track_opened = FALSE;
+	logbuf_flush();
+	return (f_close(&track_file) == FR_OK) ? 0 : -1;
+}
+
+const struct track_summary_s *track_summary(void){
+	return &track_sum;
+}
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+#include "stm32f10x_rtc.h"
+
+#include "rtc.h"
+#include "sim18.h"
+#include "track.h"
+#include "trackidx.h"
+#include "ff.h"
+
+#ifdef DEBUG
+#define DEBUGF(x, args...) printf(x, ##args)
+#else
+#define DEBUGF(x, args...)
+#endif
+
+/* Open track file, empty when none */
+static char current[TRACKIDX_NAME_SIZE];
+/* Newest file with an entry */
+static char last_indexed[TRACKIDX_NAME_SIZE];
+/* RTC counter of the next rotation */
+static uint32_t rotate_at;
+/* First entry whose file may still be on the card */
+static uint16_t oldest;
+
+/* Retry period when today's file cannot be opened, s */
+#define TRACKIDX_RETRY				60
+
+static void trackidx_digits(char *s, uint16_t value, uint8_t n){
+	while (n--) {
+		s[n] = '0' + value % 10;
+		value /= 10;
+	}
+}
+
+/* Name of today's file, the next rotation is set to the next local midnight */
+static void trackidx_today(char *name){
+	RTC_t rtc;
+
+	rtc_gettime(&rtc);
+	trackidx_digits(name, rtc.year, 4);
+	trackidx_digits(name + 4, rtc.month, 2);
+	trackidx_digits(name + 6, rtc.mday, 2);
+	memcpy(name + 8, TRACKIDX_TRACK_EXT, sizeof(TRACKIDX_TRACK_EXT));
+
+	rotate_at = RTC_GetCounter() + 86400UL
+		- ((uint32_t)rtc.hour * 3600 + (uint32_t)rtc.min * 60 + rtc.sec);
+}
+
+/* YYYYMMDD.TRK */
+static bool trackidx_is_track(const char *name){
+	uint8_t i;
+
+	for (i = 0; i < 8; i++) {
+		if (name[i] < '0' || name[i] > '9') {
+			return FALSE;
+		}
+	}
+	return (memcmp(name + 8, TRACKIDX_TRACK_EXT, sizeof(TRACKIDX_TRACK_EXT)) == 0);
+}
+
+static void trackidx_encode(const struct trackidx_entry_s *entry, uint8_t *buf){
+	const struct track_summary_s *sum = &entry->summary;
+
+	memset(buf, 0, TRACKIDX_ENTRY_SIZE);
+	memcpy(buf + TRACKIDX_ENT_NAME, entry->name, TRACKIDX_NAME_SIZE);
+	ST_DWORD(buf + TRACKIDX_ENT_START, sum->start);
+	ST_DWORD(buf + TRACKIDX_ENT_END, sum->end);
+	ST_DWORD(buf + TRACKIDX_ENT_RECORDS, sum->records);
+	ST_DWORD(buf + TRACKIDX_ENT_FIXES, sum->fixes);
+	ST_DWORD(buf + TRACKIDX_ENT_LAT_MIN, sum->lat_min);
+	ST_DWORD(buf + TRACKIDX_ENT_LAT_MAX, sum->lat_max);
+	ST_DWORD(buf + TRACKIDX_ENT_LON_MIN, sum->lon_min);
+	ST_DWORD(buf + TRACKIDX_ENT_LON_MAX, sum->lon_max);
+	ST_DWORD(buf + TRACKIDX_ENT_DISTANCE, sum->distance);
+	ST_WORD(buf + TRACKIDX_ENT_FLAGS, entry->flags);
+	ST_WORD(buf + TRACKIDX_ENT_CRC, track_crc(buf, TRACKIDX_ENT_CRC));
+}
+
+/* Return -1 when the entry CRC does not match */
+static int trackidx_decode(const uint8_t *buf, struct trackidx_entry_s *entry){
+	struct track_summary_s *sum = &entry->summary;
+
+	if (LD_WORD(buf + TRACKIDX_ENT_CRC) != track_crc(buf, TRACKIDX_ENT_CRC)) {
+		return -1;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	memcpy(entry->name, buf + TRACKIDX_ENT_NAME, TRACKIDX_NAME_SIZE - 1);
+	sum->start = LD_DWORD(buf + TRACKIDX_ENT_START);
+	sum->end = LD_DWORD(buf + TRACKIDX_ENT_END);
+	sum->records = LD_DWORD(buf + TRACKIDX_ENT_RECORDS);
+	sum->fixes = LD_DWORD(buf + TRACKIDX_ENT_FIXES);
+	sum->lat_min = (int32_t)LD_DWORD(buf + TRACKIDX_ENT_LAT_MIN);
+	sum->lat_max = (int32_t)LD_DWORD(buf + TRACKIDX_ENT_LAT_MAX);
+	sum->lon_min = (int32_t)LD_DWORD(buf + TRACKIDX_ENT_LON_MIN);
+	sum->lon_max = (int32_t)LD_DWORD(buf + TRACKIDX_ENT_LON_MAX);
+	sum->distance = LD_DWORD(buf + TRACKIDX_ENT_DISTANCE);
+	entry->flags = LD_WORD(buf + TRACKIDX_ENT_FLAGS);
+
+	return 0;
+}
+
+/* Append the entry of a closed file, a torn last entry is overwritten */
+static int trackidx_append(const char *name, const struct track_summary_s *sum){
+	struct trackidx_entry_s entry;
+	uint8_t buf[TRACKIDX_ENTRY_SIZE];
+	FIL file;
+	FRESULT res;
+	UINT bw = 0;
+
+	memcpy(entry.name, name, TRACKIDX_NAME_SIZE);
+	entry.flags = 0;
+	entry.summary = *sum;
+	trackidx_encode(&entry, buf);
+
+	if (f_open(&file, TRACKIDX_FILE_NAME, FA_OPEN_ALWAYS | FA_WRITE) != FR_OK) {
+		return -1;
+	}
+	res = f_lseek(&file, file.fsize - file.fsize % TRACKIDX_ENTRY_SIZE);
+	if (res == FR_OK) {
+		res = f_write(&file, buf, TRACKIDX_ENTRY_SIZE, &bw);
+	}
+	if (f_close(&file) != FR_OK || res != FR_OK || bw != TRACKIDX_ENTRY_SIZE) {
+		DEBUGF("Track: cannot index %s.\n", name);
+		return -2;
+	}
+
+	memcpy(last_indexed, name, TRACKIDX_NAME_SIZE);
+	DEBUGF("Track: %s indexed, %d records, %d m.\n", name,
+			(int)sum->records, (int)sum->distance);
+	return 0;
+}
+
+/* Index a file that was never rotated, opening it rebuilds its summary */
+static int trackidx_add(const char *name){
+	if (track_open(name)) {
+		return -1;
+	}
+	track_close();
+	return trackidx_append(name, track_summary());
+}
+
+/* Find the newest valid entry */
+static void trackidx_load(void){
+	struct trackidx_entry_s entry;
+	uint8_t buf[TRACKIDX_ENTRY_SIZE];
+	FIL file;
+	DWORD n;
+	UINT br;
+
+	memset(last_indexed, 0, sizeof(last_indexed));
+	oldest = 0;
+
+	if (f_open(&file, TRACKIDX_FILE_NAME, FA_READ) != FR_OK) {
+		return;
+	}
+	for (n = file.fsize / TRACKIDX_ENTRY_SIZE; n; n--) {
+		if (f_lseek(&file, (n - 1) * TRACKIDX_ENTRY_SIZE) != FR_OK
+				|| f_read(&file, buf, TRACKIDX_ENTRY_SIZE, &br) != FR_OK
+				|| br != TRACKIDX_ENTRY_SIZE) {
+			break;
+		}
+		if (trackidx_decode(buf, &entry) == 0) {
+			memcpy(last_indexed, entry.name, TRACKIDX_NAME_SIZE);
+			break;
+		}
+	}
+	f_close(&file);
+}
+
+/*
+ * Index the files left without an entry, the device being off at
+ * midnight, oldest first. Today's file gets its entry on rotation.
+ */
+static void trackidx_catch_up(const char *today){
+	char next[TRACKIDX_NAME_SIZE];
+	FILINFO info;
+	DIR dir;
+
+#if _USE_LFN
+	info.lfname = 0;
+	info.lfsize = 0;
+#endif
+	for (;;) {
+		next[0] = '\0';
+		if (f_opendir(&dir, "") != FR_OK) {
+			return;
+		}
+		while (f_readdir(&dir, &info) == FR_OK && info.fname[0]) {
+			if (trackidx_is_track(info.fname) == FALSE
+					|| memcmp(info.fname, last_indexed, TRACKIDX_NAME_SIZE - 1) <= 0
+					|| memcmp(info.fname, today, TRACKIDX_NAME_SIZE - 1) >= 0) {
+				continue;
+			}
+			if (next[0] == '\0' || memcmp(info.fname, next, TRACKIDX_NAME_SIZE - 1) < 0) {
+				memcpy(next, info.fname, TRACKIDX_NAME_SIZE);
+			}
+		}
+		if (next[0] == '\0') {
+			return;
+		}
+		/* Skipped for good when it cannot be read */
+		if (trackidx_add(next)) {
+			memcpy(last_indexed, next, TRACKIDX_NAME_SIZE);
+		}
+	}
+}
+
+/*
+ * Delete the oldest files until TRACKIDX_MIN_FREE is free again. FatFs
+ * keeps the free cluster count once known, so this is cheap when there
+ * is room.
+ */
+static void trackidx_cleanup(void){
+	struct trackidx_entry_s entry;
+	uint8_t buf[TRACKIDX_ENTRY_SIZE];
+	FATFS *fs;
+	FIL file;
+	DWORD free_clust, need;
+	FRESULT res;
+	UINT br;
+
+	if (f_getfree("", &free_clust, &fs) != FR_OK) {
+		return;
+	}
+	need = TRACKIDX_MIN_FREE / ((DWORD)fs->csize * TRACK_SECTOR_SIZE) + 1;
+	if (free_clust >= need
+			|| f_open(&file, TRACKIDX_FILE_NAME, FA_READ | FA_WRITE) != FR_OK) {
+		return;
+	}
+
+	while (free_clust < need
+			&& (DWORD)(oldest + 1) * TRACKIDX_ENTRY_SIZE <= file.fsize) {
+		if (f_lseek(&file, (DWORD)oldest * TRACKIDX_ENTRY_SIZE) != FR_OK
+				|| f_read(&file, buf, TRACKIDX_ENTRY_SIZE, &br) != FR_OK
+				|| br != TRACKIDX_ENTRY_SIZE) {
+			break;
+		}
+		if (trackidx_decode(buf, &entry) == 0
+				&& (entry.flags & TRACKIDX_FLAG_DELETED) == 0) {
+			if (memcmp(entry.name, current, TRACKIDX_NAME_SIZE) == 0) {
+				break;
+			}
+			res = f_unlink(entry.name);
+			if (res != FR_OK && res != FR_NO_FILE) {
+				break;
+			}
+			entry.flags |= TRACKIDX_FLAG_DELETED;
+			trackidx_encode(&entry, buf);
+			if (f_lseek(&file, (DWORD)oldest * TRACKIDX_ENTRY_SIZE) != FR_OK
+					|| f_write(&file, buf, TRACKIDX_ENTRY_SIZE, &br) != FR_OK) {
+				break;
+			}
+			f_getfree("", &free_clust, &fs);
+			DEBUGF("Track: %s deleted, %d clusters free.\n", entry.name, (int)free_clust);
+		}
+		oldest++;
+	}
+	f_close(&file);
+}
+
+/* Close the current file and index it, make room and open today's file */
+int trackidx_rotate(void){
+	char name[TRACKIDX_NAME_SIZE];
+
+	trackidx_today(name);
+	if (memcmp(name, current, TRACKIDX_NAME_SIZE) == 0) {
+		return 0;
+	}
+
+	if (current[0]) {
+		track_close();
+		trackidx_append(current, track_summary());
+		current[0] = '\0';
+	}
+
+	trackidx_cleanup();
+	if (track_open(name)) {
+		rotate_at = RTC_GetCounter() + TRACKIDX_RETRY;
+		return -1;
+	}
+	memcpy(current, name, TRACKIDX_NAME_SIZE);
+	return 0;
+}
+
+int trackidx_Init(void){
+	char today[TRACKIDX_NAME_SIZE];
+
+	current[0] = '\0';
+	trackidx_load();
+	trackidx_today(today);
+	trackidx_catch_up(today);
+	return trackidx_rotate();
+}
+
+/* Rotate at local midnight, or right away when the clock is set back */
+void trackidx_Mgmt(void){
+	uint32_t now = RTC_GetCounter();
+
+	if (now >= rotate_at || now + 86400UL < rotate_at) {
+		trackidx_rotate();
+	}
+}
+
+/*
+ * Next entry from *next on whose time range meets [from, to]. The open
+ * file has no entry yet. Return -1 past the last entry.
+ */
+int trackidx_find(uint32_t from, uint32_t to, uint16_t *next, struct trackidx_entry_s *entry){
+	uint8_t buf[TRACKIDX_ENTRY_SIZE];
+	FIL file;
+	UINT br;
+	int res = -1;
+
+	if (f_open(&file, TRACKIDX_FILE_NAME, FA_READ) != FR_OK) {
+		return -1;
+	}
+	if (f_lseek(&file, (DWORD)*next * TRACKIDX_ENTRY_SIZE) == FR_OK) {
+		while (f_read(&file, buf, TRACKIDX_ENTRY_SIZE, &br) == FR_OK
+				&& br == TRACKIDX_ENTRY_SIZE) {
+			(*next)++;
+			if (trackidx_decode(buf, entry) == 0
+					&& (entry->flags & TRACKIDX_FLAG_DELETED) == 0
+					&& entry->summary.start <= to && entry->summary.end >= from) {
+				res = 0;
+				break;
+			}
+		}
+	}
+	f_close(&file);
+	return res;
+}
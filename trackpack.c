@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+
+#include "track.h"
+#include "trackpack.h"
+#include "crc.h"
+#include "ff.h"
+
+/*
+ * Track record coding, free of any hardware so the host decoder builds
+ * it as is: CRCs, header check, fixed size records and packed items.
+ */
+
+uint16_t track_crc(const uint8_t *data, uint16_t length){
+	return crc16_block(CRC_FEED, data, length);
+}
+
+/* 0 when the header is valid and describes this record layout */
+int track_header_check(const uint8_t *sector){
+	if (memcmp(sector + TRACK_HDR_MAGIC, TRACK_MAGIC, 4) != 0) {
+		return -1;
+	}
+	if (LD_WORD(sector + TRACK_HDR_CRC) != track_crc(sector, TRACK_HDR_CRC)) {
+		return -2;
+	}
+	if (LD_WORD(sector + TRACK_HDR_VERSION) != TRACK_VERSION
+			|| LD_WORD(sector + TRACK_HDR_RECORD_SIZE) != TRACK_RECORD_SIZE
+			|| LD_WORD(sector + TRACK_HDR_ENCODING) > TRACK_ENCODING_PACKED) {
+		return -3;
+	}
+	return 0;
+}
+
+void track_encode(const struct track_point_s *point, uint8_t *record, uint16_t seed){
+	ST_DWORD(record + TRACK_REC_TIME, point->time);
+	ST_DWORD(record + TRACK_REC_LATITUDE, point->latitude);
+	ST_DWORD(record + TRACK_REC_LONGITUDE, point->longitude);
+	ST_DWORD(record + TRACK_REC_ALTITUDE, point->altitude);
+	ST_WORD(record + TRACK_REC_SPEED, point->speed);
+	ST_WORD(record + TRACK_REC_COURSE, point->course);
+	record[TRACK_REC_SAT_NUMBER] = point->sat_number;
+	record[TRACK_REC_HDOP] = point->hdop;
+	ST_WORD(record + TRACK_REC_TEMPERATURE, point->temperature);
+	ST_WORD(record + TRACK_REC_HUMIDITY, point->humidity);
+	ST_WORD(record + TRACK_REC_BATTERY, point->battery);
+	record[TRACK_REC_FLAGS] = point->flags;
+	record[TRACK_REC_SEQ] = point->seq;
+	ST_WORD(record + TRACK_REC_CRC, crc16_block(seed, record, TRACK_REC_CRC));
+}
+
+/* Return -1 when the record CRC does not match, seed is the header CRC */
+int track_decode(const uint8_t *record, struct track_point_s *point, uint16_t seed){
+	if (LD_WORD(record + TRACK_REC_CRC) != crc16_block(seed, record, TRACK_REC_CRC)) {
+		return -1;
+	}
+
+	point->time = LD_DWORD(record + TRACK_REC_TIME);
+	point->latitude = (int32_t)LD_DWORD(record + TRACK_REC_LATITUDE);
+	point->longitude = (int32_t)LD_DWORD(record + TRACK_REC_LONGITUDE);
+	point->altitude = (int32_t)LD_DWORD(record + TRACK_REC_ALTITUDE);
+	point->speed = LD_WORD(record + TRACK_REC_SPEED);
+	point->course = LD_WORD(record + TRACK_REC_COURSE);
+	point->sat_number = record[TRACK_REC_SAT_NUMBER];
+	point->hdop = record[TRACK_REC_HDOP];
+	point->temperature = (int16_t)LD_WORD(record + TRACK_REC_TEMPERATURE);
+	point->humidity = LD_WORD(record + TRACK_REC_HUMIDITY);
+	point->battery = LD_WORD(record + TRACK_REC_BATTERY);
+	point->flags = record[TRACK_REC_FLAGS];
+	point->seq = record[TRACK_REC_SEQ];
+
+	return 0;
+}
+
+/* Zigzag varint, 7 bits a byte, low bits first */
+static uint8_t trackpack_put(uint8_t *p, int32_t delta){
+	uint32_t v = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+	uint8_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+static int trackpack_get(const uint8_t **p, const uint8_t *end, int32_t *delta){
+	uint32_t v = 0;
+	uint8_t shift = 0;
+	uint8_t c;
+
+	do {
+		if (*p == end || shift > 28) {
+			return -1;
+		}
+		c = *(*p)++;
+		v |= (uint32_t)(c & 0x7F) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	*delta = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	return 0;
+}
+
+/*
+ * Item for point after pack->last, a key at the start of a sector and
+ * every TRACKPACK_KEY_PERIOD records. Return its size, or 0 when it does
+ * not fit in the current sector: pad the sector, clear pack->used and
+ * encode again.
+ */
+uint8_t trackpack_encode(struct trackpack_s *pack, const struct track_point_s *point,
+		uint8_t *item, uint16_t seed){
+	const struct track_point_s *last = &pack->last;
+	bool key = (pack->used == 0 || pack->since_key >= TRACKPACK_KEY_PERIOD);
+	uint8_t mask = 0;
+	uint8_t len = 1;
+
+	if (key) {
+		item[0] = TRACKPACK_TAG_KEY;
+		track_encode(point, item + 1, seed);
+		len += TRACK_RECORD_SIZE;
+	} else {
+		len += trackpack_put(item + len, (int32_t)(point->time - last->time));
+		len += trackpack_put(item + len, (int32_t)((uint32_t)point->latitude - (uint32_t)last->latitude));
+		len += trackpack_put(item + len, (int32_t)((uint32_t)point->longitude - (uint32_t)last->longitude));
+		len += trackpack_put(item + len, (int32_t)((uint32_t)point->altitude - (uint32_t)last->altitude));
+		len += trackpack_put(item + len, (int16_t)(point->speed - last->speed));
+		len += trackpack_put(item + len, (int16_t)(point->course - last->course));
+		if (point->sat_number != last->sat_number) {
+			mask |= TRACKPACK_SAT_NUMBER;
+			item[len++] = point->sat_number;
+		}
+		if (point->hdop != last->hdop) {
+			mask |= TRACKPACK_HDOP;
+			item[len++] = point->hdop;
+		}
+		if (point->temperature != last->temperature) {
+			mask |= TRACKPACK_TEMPERATURE;
+			len += trackpack_put(item + len, (int16_t)(point->temperature - last->temperature));
+		}
+		if (point->humidity != last->humidity) {
+			mask |= TRACKPACK_HUMIDITY;
+			len += trackpack_put(item + len, (int16_t)(point->humidity - last->humidity));
+		}
+		if (point->battery != last->battery) {
+			mask |= TRACKPACK_BATTERY;
+			len += trackpack_put(item + len, (int16_t)(point->battery - last->battery));
+		}
+		if (point->flags != last->flags) {
+			mask |= TRACKPACK_FLAGS;
+			item[len++] = point->flags;
+		}
+		item[0] = TRACKPACK_TAG_DELTA | mask;
+	}
+
+	if (pack->used + len > TRACK_SECTOR_SIZE) {
+		return 0;
+	}
+	pack->used = (pack->used + len) % TRACK_SECTOR_SIZE;
+	pack->since_key = key ? 0 : pack->since_key + 1;
+	pack->last = *point;
+	return len;
+}
+
+/*
+ * Decode the item at pack->used in sector, pack->used is 0 for a new
+ * sector. Return 0 with the point, 1 at the end of the sector data, -1
+ * on a bad item: the rest of the sector cannot be trusted.
+ */
+int trackpack_decode(struct trackpack_s *pack, const uint8_t *sector,
+		struct track_point_s *point, uint16_t seed){
+	const uint8_t *p = sector + pack->used;
+	const uint8_t *end = sector + TRACK_SECTOR_SIZE;
+	int32_t d[6];
+	uint8_t tag, i;
+
+	if (p >= end || *p == TRACKPACK_TAG_END) {
+		return 1;
+	}
+	tag = *p++;
+
+	if (tag == TRACKPACK_TAG_KEY) {
+		if (end - p < TRACK_RECORD_SIZE || track_decode(p, point, seed)) {
+			return -1;
+		}
+		p += TRACK_RECORD_SIZE;
+		pack->since_key = 0;
+	} else if ((tag & ~TRACKPACK_MASK) == TRACKPACK_TAG_DELTA && pack->used) {
+		for (i = 0; i < 6; i++) {
+			if (trackpack_get(&p, end, &d[i])) {
+				return -1;
+			}
+		}
+		*point = pack->last;
+		point->time += d[0];
+		point->latitude = (int32_t)((uint32_t)point->latitude + d[1]);
+		point->longitude = (int32_t)((uint32_t)point->longitude + d[2]);
+		point->altitude = (int32_t)((uint32_t)point->altitude + d[3]);
+		point->speed += d[4];
+		point->course += d[5];
+		if (tag & TRACKPACK_SAT_NUMBER) {
+			if (p == end) {
+				return -1;
+			}
+			point->sat_number = *p++;
+		}
+		if (tag & TRACKPACK_HDOP) {
+			if (p == end) {
+				return -1;
+			}
+			point->hdop = *p++;
+		}
+		if (tag & TRACKPACK_TEMPERATURE) {
+			if (trackpack_get(&p, end, &d[0])) {
+				return -1;
+			}
+			point->temperature += d[0];
+		}
+		if (tag & TRACKPACK_HUMIDITY) {
+			if (trackpack_get(&p, end, &d[0])) {
+				return -1;
+			}
+			point->humidity += d[0];
+		}
+		if (tag & TRACKPACK_BATTERY) {
+			if (trackpack_get(&p, end, &d[0])) {
+				return -1;
+			}
+			point->battery += d[0];
+		}
+		if (tag & TRACKPACK_FLAGS) {
+			if (p == end) {
+				return -1;
+			}
+			point->flags = *p++;
+		}
+		point->seq++;
+		pack->since_key++;
+	} else {
+		return -1;
+	}
+
+	pack->used = p - sector;
+	pack->last = *point;
+	return 0;
+}